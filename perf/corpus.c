@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "corpus.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const corpus_options *opts;
+    unsigned long long rng;
+    yajl_gen g;
+    yajl_print_t print;
+    void *ctx;
+    size_t bytes;
+    /* scratch space for one string */
+    unsigned char *str;
+    size_t strCap;
+    /* the type of each member of a record */
+    unsigned char *kinds;
+} generator;
+
+void corpus_defaults(corpus_options *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+    opts->seed = 1;
+    opts->size = 64 * 1024;
+    opts->shape = corpus_shape_mixed;
+    opts->width = 16;
+    opts->depth = 8;
+    opts->numberRatio = 0.4;
+    opts->stringRatio = 0.4;
+    opts->doubleRatio = 0.3;
+    opts->minString = 1;
+    opts->maxString = 64;
+    opts->escapeDensity = 0.01;
+    opts->nonAsciiRatio = 0.01;
+}
+
+int corpus_shape_parse(const char *name, corpus_shape *shape)
+{
+    static const char *names[] = {"wide", "deep", "array", "mixed",
+                                  "records"};
+    int i;
+    for (i = 0; i < 5; i++) {
+        if (!strcmp(name, names[i])) {
+            *shape = (corpus_shape) i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* xorshift64* */
+static unsigned long long next(generator *gen)
+{
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return gen->rng * 2685821657736338717ULL;
+}
+
+/* uniform in [0, 1) */
+static double unit(generator *gen)
+{
+    return (next(gen) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static unsigned int below(generator *gen, unsigned int n)
+{
+    return n ? (unsigned int) (next(gen) % n) : 0;
+}
+
+static void count_bytes(void *ctx, const char *str, size_t len)
+{
+    generator *gen = ctx;
+    gen->bytes += len;
+    gen->print(gen->ctx, str, len);
+}
+
+static size_t put_utf8(unsigned char *out, unsigned int cp)
+{
+    if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F);
+    out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+static void gen_string(generator *gen)
+{
+    static const char plain[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789 ";
+    static const char escaped[] = "\"\\\n\t\r\b\f\x01\x1f";
+    const corpus_options *o = gen->opts;
+    const double lo = o->minString ? (double) o->minString : 1.0;
+    const double hi = o->maxString > lo ? (double) o->maxString : lo;
+    const size_t chars = (size_t) (lo * pow(hi / lo, unit(gen)));
+    size_t i, len = 0;
+
+    if (gen->strCap < chars * 4) {
+        gen->strCap = chars * 4;
+        gen->str = realloc(gen->str, gen->strCap);
+    }
+
+    for (i = 0; i < chars; i++) {
+        const double r = unit(gen);
+        if (r < o->escapeDensity) {
+            gen->str[len++] = escaped[below(gen, sizeof(escaped) - 1)];
+        } else if (r < o->escapeDensity + o->nonAsciiRatio) {
+            unsigned int cp;
+            switch (below(gen, 3)) {
+                case 0: cp = 0x80 + below(gen, 0x800 - 0x80); break;
+                case 1:
+                    /* skip the surrogates */
+                    cp = 0x800 + below(gen, 0xD800 - 0x800);
+                    break;
+                default:
+                    cp = 0x10000 + below(gen, 0x110000 - 0x10000);
+                    break;
+            }
+            len += put_utf8(gen->str + len, cp);
+        } else {
+            gen->str[len++] = plain[below(gen, sizeof(plain) - 1)];
+        }
+    }
+
+    yajl_gen_string(gen->g, gen->str, len);
+}
+
+static void gen_double(generator *gen)
+{
+    const double mantissa = (double) (long long) next(gen) / 9.2e18;
+    const int exponent = (int) below(gen, 40) - 20;
+    yajl_gen_double(gen->g, mantissa * pow(10, exponent));
+}
+
+static void gen_integer(generator *gen)
+{
+    /* mostly small, occasionally up to 64 bits.  negated unsigned, as
+     * -v would overflow for LLONG_MIN */
+    unsigned long long v = next(gen) >> below(gen, 64);
+    if (next(gen) & 1) v = 0 - v;
+    yajl_gen_integer(gen->g, (long long) v);
+}
+
+/* the kinds of scalar */
+enum { kind_integer, kind_double, kind_string, kind_bool };
+
+static unsigned char gen_kind(generator *gen)
+{
+    const corpus_options *o = gen->opts;
+    const double r = unit(gen);
+
+    if (r < o->numberRatio) {
+        return unit(gen) < o->doubleRatio ? kind_double : kind_integer;
+    }
+    return r < o->numberRatio + o->stringRatio ? kind_string : kind_bool;
+}
+
+static void gen_scalar(generator *gen)
+{
+    switch (gen_kind(gen)) {
+        case kind_integer: gen_integer(gen); break;
+        case kind_double: gen_double(gen); break;
+        case kind_string: gen_string(gen); break;
+        default:
+            switch (below(gen, 3)) {
+                case 0: yajl_gen_bool(gen->g, 1); break;
+                case 1: yajl_gen_bool(gen->g, 0); break;
+                default: yajl_gen_null(gen->g); break;
+            }
+            break;
+    }
+}
+
+static void gen_key(generator *gen, unsigned int i)
+{
+    char key[32];
+    const int len = snprintf(key, sizeof(key), "field%u", i);
+    yajl_gen_string(gen->g, key, (size_t) len);
+}
+
+static void gen_shape(generator *gen, corpus_shape shape)
+{
+    const corpus_options *o = gen->opts;
+    unsigned int i;
+
+    switch (shape) {
+        case corpus_shape_wide:
+            yajl_gen_map_open(gen->g);
+            for (i = 0; i < o->width; i++) {
+                gen_key(gen, i);
+                gen_scalar(gen);
+            }
+            yajl_gen_map_close(gen->g);
+            break;
+        case corpus_shape_deep:
+            for (i = 0; i < o->depth; i++) {
+                if (i & 1) {
+                    yajl_gen_array_open(gen->g);
+                } else {
+                    yajl_gen_map_open(gen->g);
+                    gen_key(gen, i);
+                }
+            }
+            gen_scalar(gen);
+            while (i-- > 0) {
+                if (i & 1) yajl_gen_array_close(gen->g);
+                else yajl_gen_map_close(gen->g);
+            }
+            break;
+        case corpus_shape_array:
+            yajl_gen_array_open(gen->g);
+            for (i = 0; i < o->width; i++) gen_scalar(gen);
+            yajl_gen_array_close(gen->g);
+            break;
+        case corpus_shape_mixed:
+            gen_shape(gen, (corpus_shape) below(gen, 3));
+            break;
+        case corpus_shape_records:
+            yajl_gen_map_open(gen->g);
+            for (i = 0; i < o->width; i++) {
+                gen_key(gen, i);
+                /* one in sixteen is null */
+                if (below(gen, 16) == 0) {
+                    yajl_gen_null(gen->g);
+                    continue;
+                }
+                switch (gen->kinds[i]) {
+                    case kind_integer: gen_integer(gen); break;
+                    case kind_double: gen_double(gen); break;
+                    case kind_string: gen_string(gen); break;
+                    default: yajl_gen_bool(gen->g, next(gen) & 1); break;
+                }
+            }
+            yajl_gen_map_close(gen->g);
+            break;
+    }
+}
+
+size_t corpus_generate(const corpus_options *opts, yajl_print_t print,
+                       void *ctx)
+{
+    generator gen;
+    unsigned long long z;
+    unsigned int n;
+
+    memset(&gen, 0, sizeof(gen));
+    gen.opts = opts;
+    /* scramble the seed (splitmix64) so that nearby seeds give unrelated
+     * sequences, a zero state would stay zero */
+    z = opts->seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    gen.rng = (z ^ (z >> 31)) | 1;
+    gen.print = print;
+    gen.ctx = ctx;
+    gen.g = yajl_gen_alloc();
+    yajl_gen_config(gen.g, yajl_gen_print_callback, count_bytes, &gen);
+
+    if (opts->shape == corpus_shape_records) {
+        gen.kinds = malloc(opts->width ? opts->width : 1);
+        for (n = 0; n < opts->width; n++) gen.kinds[n] = gen_kind(&gen);
+    }
+
+    /* a wide document is one big object, anything else one big array */
+    if (opts->shape == corpus_shape_wide) yajl_gen_map_open(gen.g);
+    else yajl_gen_array_open(gen.g);
+
+    for (n = 0; gen.bytes < opts->size; n++) {
+        if (opts->shape == corpus_shape_wide) gen_key(&gen, n);
+        gen_shape(&gen, opts->shape);
+        yajl_gen_flush(gen.g);
+    }
+
+    if (opts->shape == corpus_shape_wide) yajl_gen_map_close(gen.g);
+    else yajl_gen_array_close(gen.g);
+    yajl_gen_flush(gen.g);
+
+    yajl_gen_deinit(gen.g);
+    yajl_gen_free(gen.g);
+    free(gen.str);
+    free(gen.kinds);
+    return gen.bytes;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+/* a deterministic generator of synthetic json documents.  The same options
+ * (including the seed) always produce the same bytes, so benchmark inputs
+ * can be described by a command line instead of being checked in. */
+
+#include <yajl/yajl_gen.h>
+#include <stddef.h>
+
+typedef enum {
+    /* an object of objects, each with 'width' members */
+    corpus_shape_wide,
+    /* an array of chains nested 'depth' levels deep */
+    corpus_shape_deep,
+    /* an array of arrays, each with 'width' elements */
+    corpus_shape_array,
+    /* a random mix of the above */
+    corpus_shape_mixed,
+    /* an array of flat objects with the same 'width' members, each of
+     * which keeps one type (or null) from one object to the next */
+    corpus_shape_records
+} corpus_shape;
+
+typedef struct {
+    unsigned long long seed;
+    /* the document is grown until it is at least this many bytes */
+    size_t size;
+    corpus_shape shape;
+    unsigned int width;
+    unsigned int depth;
+    /* the fractions of scalars which are numbers and strings, the rest
+     * are true, false and null */
+    double numberRatio;
+    double stringRatio;
+    /* the fraction of numbers which are doubles rather than integers */
+    double doubleRatio;
+    /* string lengths (in characters) are log-uniform in this range */
+    size_t minString;
+    size_t maxString;
+    /* the chance that a string character must be escaped, and that it is
+     * a non-ASCII (multibyte UTF8) character */
+    double escapeDensity;
+    double nonAsciiRatio;
+} corpus_options;
+
+/* a mixed shape 64KB document with some of everything */
+void corpus_defaults(corpus_options *opts);
+
+/* parse a shape name, returns non-zero on success */
+int corpus_shape_parse(const char *name, corpus_shape *shape);
+
+/* generate one document, handing the text to 'print' as it is produced.
+ * returns the number of bytes generated. */
+size_t corpus_generate(const corpus_options *opts, yajl_print_t print,
+                       void *ctx);
+
+#endif
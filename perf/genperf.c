@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* generator throughput: the twitter document is parsed once into a list of
+ * events, which is then replayed into a generator over and over, first
+ * generating map keys with yajl_gen_string() and then with prepared keys
+ * from yajl_gen_key_prepare(). */
+
+#include <yajl/yajl_parse.h>
+#include <yajl/yajl_gen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "documents.h"
+
+#ifndef WIN32
+#include <sys/time.h>
+static double mygettime(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + (now.tv_usec / 1000000.0);
+}
+#else
+#define _WIN32 1
+#include <windows.h>
+static double mygettime(void) {
+    long long tval;
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    tval = ft.dwHighDateTime;
+    tval <<= 32;
+    tval |= ft.dwLowDateTime;
+    return tval / 10000000.00;
+}
+#endif
+
+#define GEN_TIME_SECS 2
+
+typedef enum {
+    ev_null, ev_bool, ev_number, ev_string, ev_key,
+    ev_map_open, ev_map_close, ev_array_open, ev_array_close
+} event_type;
+
+typedef struct {
+    event_type type;
+    char *str;
+    size_t len;
+    yajl_gen_prepared_key key;
+} event;
+
+typedef struct {
+    event *events;
+    size_t count;
+    size_t cap;
+    /* indexes of the distinct keys seen so far, so each one is prepared
+     * once */
+    size_t *keys;
+    size_t numKeys;
+} recording;
+
+static event * push(recording *r, event_type type, const void *s, size_t len)
+{
+    event *e;
+    if (r->count == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 256;
+        r->events = realloc(r->events, r->cap * sizeof(event));
+    }
+    e = &r->events[r->count++];
+    e->type = type;
+    e->str = NULL;
+    e->len = len;
+    e->key = NULL;
+    if (s) {
+        e->str = malloc(len ? len : 1);
+        memcpy(e->str, s, len);
+    }
+    return e;
+}
+
+static int rec_null(void *ctx) { push(ctx, ev_null, NULL, 0); return 1; }
+static int rec_bool(void *ctx, int b) { push(ctx, ev_bool, NULL, b); return 1; }
+static int rec_number(void *ctx, const char *s, size_t l)
+{ push(ctx, ev_number, s, l); return 1; }
+static int rec_string(void *ctx, const unsigned char *s, size_t l)
+{ push(ctx, ev_string, s, l); return 1; }
+static int rec_map_open(void *ctx) { push(ctx, ev_map_open, NULL, 0); return 1; }
+static int rec_map_close(void *ctx) { push(ctx, ev_map_close, NULL, 0); return 1; }
+static int rec_array_open(void *ctx) { push(ctx, ev_array_open, NULL, 0); return 1; }
+static int rec_array_close(void *ctx) { push(ctx, ev_array_close, NULL, 0); return 1; }
+
+static int rec_key(void *ctx, const unsigned char *s, size_t l)
+{
+    recording *r = ctx;
+    event *e = push(r, ev_key, s, l);
+    size_t i;
+
+    for (i = 0; i < r->numKeys; i++) {
+        const event *k = &r->events[r->keys[i]];
+        if (k->len == l && !memcmp(k->str, s, l)) {
+            e->key = k->key;
+            return 1;
+        }
+    }
+
+    e->key = yajl_gen_key_prepare(NULL, s, l);
+    r->keys = realloc(r->keys, (r->numKeys + 1) * sizeof(size_t));
+    r->keys[r->numKeys++] = r->count - 1;
+    return 1;
+}
+
+static yajl_callbacks callbacks = {
+    rec_null, rec_bool, NULL, NULL, rec_number, rec_string,
+    rec_map_open, rec_key, rec_map_close, rec_array_open, rec_array_close,
+    NULL
+};
+
+static size_t replay(yajl_gen g, const recording *r, int prepared)
+{
+    const event *e = r->events;
+    const event *end = r->events + r->count;
+    void *buf;
+    size_t len;
+
+    for (; e < end; e++) {
+        switch (e->type) {
+            case ev_null: yajl_gen_null(g); break;
+            case ev_bool: yajl_gen_bool(g, (int) e->len); break;
+            case ev_number: yajl_gen_number(g, e->str, e->len); break;
+            case ev_string: yajl_gen_string(g, e->str, e->len); break;
+            case ev_key:
+                if (prepared) yajl_gen_key(g, e->key);
+                else yajl_gen_string(g, e->str, e->len);
+                break;
+            case ev_map_open: yajl_gen_map_open(g); break;
+            case ev_map_close: yajl_gen_map_close(g); break;
+            case ev_array_open: yajl_gen_array_open(g); break;
+            case ev_array_close: yajl_gen_array_close(g); break;
+        }
+    }
+
+    yajl_gen_get_buf(g, &buf, &len);
+    return len;
+}
+
+static double run(const recording *r, int prepared, int beautify)
+{
+    long long bytes = 0;
+    double starttime = mygettime();
+    double now;
+    yajl_gen g = yajl_gen_alloc();
+
+    for (;;) {
+        int i;
+        now = mygettime();
+        if (now - starttime >= GEN_TIME_SECS) break;
+
+        for (i = 0; i < 100; i++) {
+            yajl_gen_config(g, yajl_gen_beautify, beautify);
+            bytes += replay(g, r, prepared);
+            yajl_gen_clear(g);
+            yajl_gen_reset(g, NULL);
+        }
+    }
+
+    yajl_gen_deinit(g);
+    yajl_gen_free(g);
+    return bytes / (now - starttime) / (1024.0 * 1024.0);
+}
+
+int
+main(void)
+{
+    recording r;
+    yajl_handle hand;
+    const char **d;
+    char *text;
+    size_t textLen = 0;
+    size_t i;
+    int beautify;
+
+    memset(&r, 0, sizeof(r));
+
+    /* the twitter document */
+    text = malloc(doc_size(0) + 1);
+    for (d = get_doc(0); *d; d++) {
+        memcpy(text + textLen, *d, strlen(*d));
+        textLen += strlen(*d);
+    }
+
+    hand = yajl_alloc(&callbacks, NULL, &r);
+    if (yajl_parse(hand, (unsigned char *) text, textLen) != yajl_status_ok ||
+        yajl_complete_parse(hand) != yajl_status_ok)
+    {
+        fprintf(stderr, "failed to parse the sample document\n");
+        return 1;
+    }
+    yajl_free(hand);
+
+    printf("-- generator throughput replaying %zu events (%zu distinct "
+           "keys) --\n", r.count, r.numKeys);
+
+    for (beautify = 0; beautify < 2; beautify++) {
+        double plain = run(&r, 0, beautify);
+        double prepared = run(&r, 1, beautify);
+        printf("%s: yajl_gen_string keys %.1f MB/s, prepared keys %.1f MB/s "
+               "(%+.1f%%)\n", beautify ? "beautified" : "compact",
+               plain, prepared, (prepared / plain - 1.0) * 100.0);
+    }
+
+    /* the events of one key share its prepared key */
+    for (i = 0; i < r.numKeys; i++) yajl_gen_key_free(r.events[r.keys[i]].key);
+    for (i = 0; i < r.count; i++) free(r.events[i].str);
+    free(r.events);
+    free(r.keys);
+    free(text);
+    return 0;
+}
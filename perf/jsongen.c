@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* write synthetic json documents described by the command line, see
+ * corpus.h.  Output is streamed, so documents can be far larger than
+ * memory. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "corpus.h"
+
+static void write_out(void *ctx, const char *str, size_t len)
+{
+    if (fwrite(str, 1, len, ctx) != len) {
+        fprintf(stderr, "error writing output\n");
+        exit(1);
+    }
+}
+
+/* a byte count with an optional K, M or G suffix */
+static size_t parse_size(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end) {
+        case 'k': case 'K': v *= 1024.0; break;
+        case 'm': case 'M': v *= 1024.0 * 1024.0; break;
+        case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; break;
+        default: break;
+    }
+    return (size_t) v;
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr,
+            "usage:  %s [options]\n"
+            "    -s SIZE    bytes per document, K/M/G suffixes allowed (64K)\n"
+            "    -n COUNT   number of documents, one per line (1)\n"
+            "    -S SEED    random seed (1)\n"
+            "    -p SHAPE   wide, deep, array, mixed or records (mixed)\n"
+            "    -w WIDTH   members per object / elements per array (16)\n"
+            "    -d DEPTH   nesting depth of the deep shape (8)\n"
+            "    -N RATIO   fraction of scalars which are numbers (0.4)\n"
+            "    -T RATIO   fraction of scalars which are strings (0.4)\n"
+            "    -D RATIO   fraction of numbers which are doubles (0.3)\n"
+            "    -l MIN:MAX string length range in characters (1:64)\n"
+            "    -e RATIO   chance that a string character is escaped (0.01)\n"
+            "    -u RATIO   chance that a string character is non-ASCII (0.01)\n"
+            "    -o FILE    write to FILE instead of stdout\n",
+            progname);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    corpus_options opts;
+    unsigned long count = 1, i;
+    FILE *out = stdout;
+    int a;
+
+    corpus_defaults(&opts);
+
+    for (a = 1; a < argc; a++) {
+        const char *arg;
+        if (argv[a][0] != '-' || strlen(argv[a]) != 2 || a + 1 >= argc) {
+            usage(argv[0]);
+        }
+        arg = argv[++a];
+        switch (argv[a - 1][1]) {
+            case 's': opts.size = parse_size(arg); break;
+            case 'n': count = strtoul(arg, NULL, 10); break;
+            case 'S': opts.seed = strtoull(arg, NULL, 0); break;
+            case 'p':
+                if (!corpus_shape_parse(arg, &opts.shape)) usage(argv[0]);
+                break;
+            case 'w': opts.width = (unsigned int) strtoul(arg, NULL, 10); break;
+            case 'd': opts.depth = (unsigned int) strtoul(arg, NULL, 10); break;
+            case 'N': opts.numberRatio = atof(arg); break;
+            case 'T': opts.stringRatio = atof(arg); break;
+            case 'D': opts.doubleRatio = atof(arg); break;
+            case 'l':
+                if (sscanf(arg, "%zu:%zu", &opts.minString,
+                           &opts.maxString) != 2) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'e': opts.escapeDensity = atof(arg); break;
+            case 'u': opts.nonAsciiRatio = atof(arg); break;
+            case 'o':
+                out = fopen(arg, "wb");
+                if (!out) {
+                    fprintf(stderr, "can't open '%s'\n", arg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        corpus_options docOpts = opts;
+        /* every document differs, but the set is still reproducible */
+        docOpts.seed = opts.seed + i;
+        corpus_generate(&docOpts, write_out, out);
+        write_out(out, "\n", 1);
+    }
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "error writing output\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -14,121 +14,1072 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+/* benchmark harness: every stage (lexer, parser whole and in 1, 16 and 4096
+ * byte chunks, tree build, tree build and read every number, tree free,
+ * opening a snapshot of the tree and reading it, generator, tree
+ * serializer, reformat, parsing and replaying a tape to the same callbacks,
+ * transcoding to MessagePack and CBOR, reading MessagePack back into those
+ * callbacks, converting records to columns, and validation through the
+ * parser and through yajl_validate) is run against every corpus.  A sample
+ * is one pass over all the documents of a corpus; only the work of the
+ * stage itself is timed, handles are allocated and freed outside the timed
+ * region.  After a warmup, samples are collected until the time budget is
+ * spent and reported as percentiles, bytes/s and docs/s. */
+
+#ifndef WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <yajl/yajl_parse.h>
+#include <yajl/yajl_gen.h>
+#include <yajl/yajl_tree.h>
+#include <yajl/yajl_snap.h>
+#include <yajl/yajl_tape.h>
+#include <yajl/yajl_pack.h>
+#include <yajl/yajl_column.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "yajl_lex.h"
+#include "corpus.h"
 #include "documents.h"
 
-/* a platform specific defn' of a function to get a high res time in a
- * portable format */
+/* a platform specific monotonic clock, and a temporary file to write a
+ * snapshot to */
 #ifndef WIN32
-#include <sys/time.h>
-static double mygettime(void) {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    return now.tv_sec + (now.tv_usec / 1000000.0);
+#include <time.h>
+#include <unistd.h>
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int make_temp(char *name)
+{
+    int fd = mkstemp(name);
+    if (fd < 0) return 0;
+    close(fd);
+    return 1;
 }
 #else
 #define _WIN32 1
+#include <io.h>
 #include <windows.h>
-static double mygettime(void) {
-    long long tval;
-	FILETIME ft;
-	GetSystemTimeAsFileTime(&ft);
-	tval = ft.dwHighDateTime;
-	tval <<=32;
-	tval |= ft.dwLowDateTime;
-	return tval / 10000000.00;
+static double now(void)
+{
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double) count.QuadPart / freq.QuadPart;
+}
+
+static int make_temp(char *name)
+{
+    return _mktemp(name) != NULL;
 }
 #endif
 
-#define PARSE_TIME_SECS 3
+/** corpora **/
+
+typedef struct {
+    const char *name;
+    /* each document is null terminated, as yajl_tree_parse() wants */
+    char **docs;
+    size_t *lens;
+    size_t count;
+    size_t cap;
+    size_t bytes;
+} corpus;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} text;
+
+static void put(text *t, const char *s, size_t len)
+{
+    if (t->len + len + 1 > t->cap) {
+        while (t->len + len + 1 > t->cap) t->cap = t->cap ? t->cap * 2 : 4096;
+        t->data = realloc(t->data, t->cap);
+    }
+    memcpy(t->data + t->len, s, len);
+    t->len += len;
+    t->data[t->len] = 0;
+}
+
+/* evaluates 's' twice */
+#define PUTS(t, s) put((t), (s), strlen(s))
+
+static void add_doc(corpus *c, text *t)
+{
+    if (c->count == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 64;
+        c->docs = realloc(c->docs, c->cap * sizeof(char *));
+        c->lens = realloc(c->lens, c->cap * sizeof(size_t));
+    }
+    c->docs[c->count] = t->data;
+    c->lens[c->count] = t->len;
+    c->count++;
+    c->bytes += t->len;
+    memset(t, 0, sizeof(*t));
+}
+
+static void build_embedded(corpus *c, size_t size)
+{
+    int i;
+    (void) size;
+    for (i = 0; i < num_docs(); i++) {
+        text t = {0};
+        const char **d;
+        for (d = get_doc(i); *d; d++) PUTS(&t, *d);
+        add_doc(c, &t);
+    }
+}
+
+static void put_text(void *ctx, const char *str, size_t len)
+{
+    put(ctx, str, len);
+}
+
+static void add_generated(corpus *c, const corpus_options *opts)
+{
+    text t = {0};
+    corpus_generate(opts, put_text, &t);
+    add_doc(c, &t);
+}
+
+static void build_numbers(corpus *c, size_t size)
+{
+    corpus_options o;
+    corpus_defaults(&o);
+    o.size = size;
+    o.shape = corpus_shape_array;
+    o.width = 64;
+    o.numberRatio = 1.0;
+    o.doubleRatio = 0.5;
+    add_generated(c, &o);
+}
+
+static void build_strings(corpus *c, size_t size)
+{
+    corpus_options o;
+    corpus_defaults(&o);
+    o.size = size;
+    o.shape = corpus_shape_array;
+    o.numberRatio = 0.0;
+    o.stringRatio = 1.0;
+    o.minString = 8;
+    o.maxString = 256;
+    o.escapeDensity = 0.02;
+    o.nonAsciiRatio = 0.0;
+    add_generated(c, &o);
+}
+
+static void build_deep(corpus *c, size_t size)
+{
+    corpus_options o;
+    corpus_defaults(&o);
+    o.size = size;
+    o.shape = corpus_shape_deep;
+    o.depth = 256;
+    add_generated(c, &o);
+}
+
+static void build_unicode(corpus *c, size_t size)
+{
+    corpus_options o;
+    corpus_defaults(&o);
+    o.size = size;
+    o.shape = corpus_shape_wide;
+    o.numberRatio = 0.0;
+    o.stringRatio = 1.0;
+    o.nonAsciiRatio = 0.5;
+    add_generated(c, &o);
+}
+
+static void build_small(corpus *c, size_t size)
+{
+    corpus_options o;
+    size_t n;
+
+    corpus_defaults(&o);
+    /* each document is a single small object */
+    o.size = 1;
+    o.shape = corpus_shape_wide;
+    o.width = 4;
+    o.maxString = 12;
+    for (n = 0; c->bytes < size; n++) {
+        o.seed = n + 1;
+        add_generated(c, &o);
+    }
+}
+
+static void build_records(corpus *c, size_t size)
+{
+    corpus_options o;
+    corpus_defaults(&o);
+    o.size = size;
+    o.shape = corpus_shape_records;
+    o.maxString = 32;
+    add_generated(c, &o);
+}
+
+static const struct {
+    const char *name;
+    void (*build)(corpus *, size_t size);
+} corpora[] = {
+    {"embedded", build_embedded},
+    {"numbers", build_numbers},
+    {"strings", build_strings},
+    {"deep", build_deep},
+    {"unicode", build_unicode},
+    {"small", build_small},
+    {"records", build_records},
+};
+
+#define NUM_CORPORA (sizeof(corpora) / sizeof(*corpora))
+
+/** stages.  each performs one pass over a corpus and returns the time
+ *  spent in the stage itself, or a negative number on failure **/
+
+/* returned by a stage which doesn't apply to the corpus */
+#define SKIPPED -2.0
+
+static double stage_lex(const corpus *c)
+{
+    yajl_lexer *lx = malloc(c->count * sizeof(yajl_lexer));
+    double start, elapsed;
+    int failed = 0;
+    size_t i;
+
+    for (i = 0; i < c->count; i++) lx[i] = yajl_lex_alloc(0, 1, 0);
+
+    start = now();
+    for (i = 0; i < c->count; i++) {
+        const unsigned char *doc = (const unsigned char *) c->docs[i];
+        const unsigned char *out;
+        size_t outLen, offset = 0;
+        yajl_tok tok;
+        do {
+            tok = yajl_lex_lex(lx[i], doc, c->lens[i], &offset, &out, &outLen);
+        } while (tok != yajl_tok_eof && tok != yajl_tok_error);
+        failed |= tok == yajl_tok_error;
+    }
+    elapsed = now() - start;
+
+    for (i = 0; i < c->count; i++) yajl_lex_free(lx[i]);
+    free(lx);
+    return failed ? -1 : elapsed;
+}
+
+/* parse every document, handing it to the parser 'chunk' bytes at a time
+ * (all at once if 0) as a network stream would */
+static double parse_corpus(const corpus *c, const yajl_callbacks *cb,
+                           void **ctx, int validate, size_t chunk)
+{
+    yajl_handle *h = malloc(c->count * sizeof(yajl_handle));
+    double start, elapsed;
+    int failed = 0;
+    size_t i;
+
+    for (i = 0; i < c->count; i++) {
+        h[i] = yajl_alloc(cb, NULL, ctx ? ctx[i] : NULL);
+        yajl_config(h[i], yajl_dont_validate_strings, !validate);
+    }
+
+    start = now();
+    for (i = 0; i < c->count; i++) {
+        const unsigned char *doc = (const unsigned char *) c->docs[i];
+        size_t off = 0, len = chunk ? chunk : c->lens[i];
+        for (; off < c->lens[i]; off += len) {
+            if (len > c->lens[i] - off) len = c->lens[i] - off;
+            failed |= yajl_parse(h[i], doc + off, len) != yajl_status_ok;
+        }
+        failed |= yajl_complete_parse(h[i]) != yajl_status_ok;
+    }
+    elapsed = now() - start;
+
+    for (i = 0; i < c->count; i++) yajl_free(h[i]);
+    free(h);
+    return failed ? -1 : elapsed;
+}
+
+static double stage_parse(const corpus *c)
+{
+    return parse_corpus(c, NULL, NULL, 0, 0);
+}
+
+/* streaming at tiny, small and typical socket read sizes */
+static double stage_parse_1(const corpus *c)
+{
+    return parse_corpus(c, NULL, NULL, 0, 1);
+}
+
+static double stage_parse_16(const corpus *c)
+{
+    return parse_corpus(c, NULL, NULL, 0, 16);
+}
+
+static double stage_parse_4096(const corpus *c)
+{
+    return parse_corpus(c, NULL, NULL, 0, 4096);
+}
+
+static double stage_validate(const corpus *c)
+{
+    return parse_corpus(c, NULL, NULL, 1, 0);
+}
+
+/* the same check as 'validate' without a parser: yajl_validate() */
+static double stage_verify(const corpus *c)
+{
+    double start, elapsed;
+    int failed = 0;
+    size_t i;
+
+    start = now();
+    for (i = 0; i < c->count; i++) {
+        failed |= yajl_validate((const unsigned char *) c->docs[i],
+                                c->lens[i], 0, NULL) != yajl_status_ok;
+    }
+    elapsed = now() - start;
+
+    return failed ? -1 : elapsed;
+}
+
+static yajl_val *build_trees(const corpus *c, double *elapsed)
+{
+    yajl_val *trees = malloc(c->count * sizeof(yajl_val));
+    double start = now();
+    size_t i;
+
+    for (i = 0; i < c->count; i++) {
+        trees[i] = yajl_tree_parse(c->docs[i], NULL, 0);
+    }
+    *elapsed = now() - start;
+
+    for (i = 0; i < c->count; i++) {
+        if (!trees[i]) {
+            *elapsed = -1;
+        }
+    }
+    return trees;
+}
+
+static void free_trees(const corpus *c, yajl_val *trees)
+{
+    size_t i;
+    for (i = 0; i < c->count; i++) yajl_tree_free(trees[i]);
+    free(trees);
+}
 
-static int
-run(int validate_utf8)
+static double stage_tree_build(const corpus *c)
 {
-    long long times = 0; 
-    double starttime;
+    double elapsed;
+    free_trees(c, build_trees(c, &elapsed));
+    return elapsed;
+}
 
-    starttime = mygettime();
+/* so that the numbers read aren't optimised away */
+static volatile double numberSum;
 
-    /* allocate a parser */
-    for (;;) {
-		int i;
-        {
-            double now = mygettime();
-            if (now - starttime >= PARSE_TIME_SECS) break;
+/* read every number in a tree as a double, as a caller that wants them all
+ * would */
+static double sum_numbers(yajl_val v)
+{
+    double sum = 0;
+    size_t i;
+    if (YAJL_IS_NUMBER(v)) {
+        sum = YAJL_GET_DOUBLE(v);
+    } else if (YAJL_IS_OBJECT(v)) {
+        for (i = 0; i < v->u.object.len; i++) {
+            sum += sum_numbers(v->u.object.values[i]);
+        }
+    } else if (YAJL_IS_ARRAY(v)) {
+        for (i = 0; i < v->u.array.len; i++) {
+            sum += sum_numbers(v->u.array.values[i]);
         }
+    }
+    return sum;
+}
+
+static double stage_tree_read(const corpus *c)
+{
+    double elapsed, start, sum = 0;
+    yajl_val *trees = build_trees(c, &elapsed);
+    size_t i;
+
+    if (elapsed < 0) {
+        free_trees(c, trees);
+        return -1;
+    }
 
-        for (i = 0; i < 100; i++) {
-            yajl_handle hand = yajl_alloc(NULL, NULL, NULL);
-            yajl_status stat;        
-            const char ** d;
+    start = now();
+    for (i = 0; i < c->count; i++) sum += sum_numbers(trees[i]);
+    elapsed += now() - start;
 
-            yajl_config(hand, yajl_dont_validate_strings, validate_utf8 ? 0 : 1);
+    free_trees(c, trees);
+    numberSum = sum;
+    return elapsed;
+}
+
+static double stage_tree_free(const corpus *c)
+{
+    double elapsed, start;
+    yajl_val *trees = build_trees(c, &elapsed);
+
+    if (elapsed < 0) {
+        free_trees(c, trees);
+        return -1;
+    }
 
-            for (d = get_doc(times % num_docs()); *d; d++) {
-                stat = yajl_parse(hand, (unsigned char *) *d, strlen(*d));
-                if (stat != yajl_status_ok) break;
+    start = now();
+    free_trees(c, trees);
+    return now() - start;
+}
+
+static void gen_tree(yajl_gen g, yajl_val v)
+{
+    size_t i;
+    switch (v->type) {
+        case yajl_t_string:
+            yajl_gen_string(g, v->u.string, strlen(v->u.string));
+            break;
+        case yajl_t_number: {
+            const char *r = YAJL_GET_NUMBER(v);
+            yajl_gen_number(g, r, strlen(r));
+            break;
+        }
+        case yajl_t_object:
+            yajl_gen_map_open(g);
+            for (i = 0; i < v->u.object.len; i++) {
+                yajl_gen_string(g, v->u.object.keys[i],
+                                strlen(v->u.object.keys[i]));
+                gen_tree(g, v->u.object.values[i]);
             }
-            
-            stat = yajl_complete_parse(hand);
-
-            if (stat != yajl_status_ok) {
-                unsigned char * str =
-                    yajl_get_error(hand, 1,
-                                   (unsigned char *) *d,
-                                   (*d ? strlen(*d) : 0));
-                fprintf(stderr, "%s", (const char *) str);
-                yajl_free_error(hand, str);
-                return 1;
+            yajl_gen_map_close(g);
+            break;
+        case yajl_t_array:
+            yajl_gen_array_open(g);
+            for (i = 0; i < v->u.array.len; i++) {
+                gen_tree(g, v->u.array.values[i]);
             }
-            yajl_free(hand);
-            times++;
+            yajl_gen_array_close(g);
+            break;
+        case yajl_t_true: yajl_gen_bool(g, 1); break;
+        case yajl_t_false: yajl_gen_bool(g, 0); break;
+        default: yajl_gen_null(g); break;
+    }
+}
+
+static double stage_gen(const corpus *c)
+{
+    double elapsed, start;
+    yajl_val *trees = build_trees(c, &elapsed);
+    yajl_gen g = yajl_gen_alloc();
+    size_t i;
+
+    if (elapsed >= 0) {
+        start = now();
+        for (i = 0; i < c->count; i++) {
+            gen_tree(g, trees[i]);
+            yajl_gen_clear(g);
+            yajl_gen_reset(g, NULL);
+        }
+        elapsed = now() - start;
+    }
+
+    yajl_gen_deinit(g);
+    yajl_gen_free(g);
+    free_trees(c, trees);
+    return elapsed;
+}
+
+/* the same output as 'gen', written straight from the tree.  The buffer
+ * starts out the size of the largest input document, which is what a
+ * caller writing back what it parsed would reserve, and is only grown (after
+ * measuring) when a document doesn't fit */
+static double stage_serialize(const corpus *c)
+{
+    double elapsed, start;
+    yajl_val *trees = build_trees(c, &elapsed);
+    size_t i, len, cap = 0;
+    char *buf;
+
+    for (i = 0; i < c->count; i++) {
+        if (c->lens[i] + 1 > cap) cap = c->lens[i] + 1;
+    }
+    buf = malloc(cap);
+
+    if (elapsed >= 0) {
+        start = now();
+        for (i = 0; i < c->count; i++) {
+            len = yajl_tree_serialize(trees[i], 0, buf, cap);
+            if (len >= cap) {
+                cap = len + 1;
+                buf = realloc(buf, cap);
+                yajl_tree_serialize(trees[i], 0, buf, cap);
+            }
+        }
+        elapsed = now() - start;
+    }
+
+    free(buf);
+    free_trees(c, trees);
+    return elapsed;
+}
+
+/* start-up: save each document's tree as a snapshot file (untimed), then
+ * time opening them, against 'tree_build' and 'tree_read' which parse.
+ * The files are in the page cache, as they would be for a service which
+ * restarts, and the parse stages don't count reading the json from disk */
+
+static char **save_snapshots(const corpus *c)
+{
+    const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : getenv("TEMP");
+    char **names = calloc(c->count, sizeof(char *));
+    double elapsed;
+    yajl_val *trees = build_trees(c, &elapsed);
+    int failed = elapsed < 0;
+    size_t i;
+
+    for (i = 0; i < c->count && !failed; i++) {
+        names[i] = malloc(strlen(dir ? dir : "/tmp") + 32);
+        sprintf(names[i], "%s/perftest-XXXXXX", dir ? dir : "/tmp");
+        if (!make_temp(names[i])) {
+            free(names[i]);
+            names[i] = NULL;
+            failed = 1;
+            break;
+        }
+        failed = !yajl_snap_save(trees[i], names[i], NULL, 0);
+    }
+
+    free_trees(c, trees);
+    if (failed) {
+        for (i = 0; i < c->count; i++) {
+            if (names[i]) remove(names[i]);
+            free(names[i]);
+        }
+        free(names);
+        return NULL;
+    }
+    return names;
+}
+
+static void remove_snapshots(const corpus *c, char **names)
+{
+    size_t i;
+    for (i = 0; i < c->count; i++) {
+        remove(names[i]);
+        free(names[i]);
+    }
+    free(names);
+}
+
+static double sum_snap_numbers(yajl_snap_val v)
+{
+    double sum = 0;
+    size_t i;
+    if (YAJL_SNAP_IS_NUMBER(v)) {
+        sum = YAJL_SNAP_GET_DOUBLE(v);
+    } else if (YAJL_SNAP_IS_OBJECT(v)) {
+        for (i = 0; i < YAJL_SNAP_GET_COUNT(v); i++) {
+            sum += sum_snap_numbers(YAJL_SNAP_GET_VALUE(v, i));
         }
+    } else if (YAJL_SNAP_IS_ARRAY(v)) {
+        for (i = 0; i < YAJL_SNAP_GET_COUNT(v); i++) {
+            sum += sum_snap_numbers(YAJL_SNAP_GET_ELEMENT(v, i));
+        }
+    }
+    return sum;
+}
+
+/* open, and optionally read every number as 'tree_read' does */
+static double open_snapshots(const corpus *c, int read)
+{
+    char **names = save_snapshots(c);
+    double start, elapsed, sum = 0;
+    int failed = 0;
+    size_t i;
+
+    if (!names) return -1;
+
+    start = now();
+    for (i = 0; i < c->count; i++) {
+        yajl_snap s = yajl_snap_open(names[i], NULL, 0);
+        if (!s) {
+            failed = 1;
+            continue;
+        }
+        if (read) sum += sum_snap_numbers(yajl_snap_root(s));
+        else failed |= yajl_snap_root(s)->type == 0;
+        yajl_snap_close(s);
+    }
+    elapsed = now() - start;
+
+    remove_snapshots(c, names);
+    numberSum = sum;
+    return failed ? -1 : elapsed;
+}
+
+static double stage_snap_open(const corpus *c)
+{
+    return open_snapshots(c, 0);
+}
+
+static double stage_snap_read(const corpus *c)
+{
+    return open_snapshots(c, 1);
+}
+
+/* reformat: parser callbacks feeding a generator, as json_reformat does */
+
+static int rf_null(void *ctx) { return yajl_gen_null(ctx) == yajl_gen_status_ok; }
+static int rf_bool(void *ctx, int b) { return yajl_gen_bool(ctx, b) == yajl_gen_status_ok; }
+static int rf_number(void *ctx, const char *s, size_t l)
+{ return yajl_gen_number(ctx, s, l) == yajl_gen_status_ok; }
+static int rf_string(void *ctx, const unsigned char *s, size_t l)
+{ return yajl_gen_string(ctx, s, l) == yajl_gen_status_ok; }
+static int rf_map_open(void *ctx) { return yajl_gen_map_open(ctx) == yajl_gen_status_ok; }
+static int rf_map_close(void *ctx) { return yajl_gen_map_close(ctx) == yajl_gen_status_ok; }
+static int rf_array_open(void *ctx) { return yajl_gen_array_open(ctx) == yajl_gen_status_ok; }
+static int rf_array_close(void *ctx) { return yajl_gen_array_close(ctx) == yajl_gen_status_ok; }
+
+static const yajl_callbacks reformat_callbacks = {
+    rf_null, rf_bool, NULL, NULL, rf_number, rf_string,
+    rf_map_open, rf_string, rf_map_close, rf_array_open, rf_array_close,
+    NULL
+};
+
+static double stage_reformat(const corpus *c)
+{
+    void **gens = malloc(c->count * sizeof(void *));
+    double elapsed;
+    size_t i;
+
+    for (i = 0; i < c->count; i++) gens[i] = yajl_gen_alloc();
+    elapsed = parse_corpus(c, &reformat_callbacks, gens, 1, 0);
+    for (i = 0; i < c->count; i++) {
+        yajl_gen_deinit(gens[i]);
+        yajl_gen_free(gens[i]);
+    }
+    free(gens);
+    return elapsed;
+}
+
+/* events: a consumer which wants every value converted, fed by the parser
+ * and then by a replay of a tape recorded from it (untimed).  replay_fmt
+ * is 'reformat' fed by a replay */
+
+static size_t eventCount;
+
+static int ev_null(void *ctx) { eventCount++; return 1; }
+static int ev_bool(void *ctx, int b) { eventCount += b; return 1; }
+static int ev_integer(void *ctx, long long i) { eventCount += i & 1; return 1; }
+static int ev_double(void *ctx, double d) { eventCount += d > 0; return 1; }
+static int ev_string(void *ctx, const unsigned char *s, size_t l)
+{ eventCount += l; return 1; }
+static int ev_unsigned(void *ctx, unsigned long long u)
+{ eventCount += u & 1; return 1; }
+
+static const yajl_callbacks event_callbacks = {
+    ev_null, ev_bool, ev_integer, ev_double, NULL, ev_string,
+    ev_null, ev_string, ev_null, ev_null, ev_null,
+    ev_unsigned
+};
+
+static double stage_events(const corpus *c)
+{
+    return parse_corpus(c, &event_callbacks, NULL, 1, 0);
+}
+
+static yajl_tape *record_tapes(const corpus *c)
+{
+    yajl_tape *tapes = malloc(c->count * sizeof(yajl_tape));
+    int failed = 0;
+    size_t i;
+
+    for (i = 0; i < c->count; i++) {
+        yajl_handle h;
+        tapes[i] = yajl_tape_alloc();
+        h = yajl_alloc(yajl_tape_recorder(), NULL, tapes[i]);
+        failed |= yajl_parse(h, (const unsigned char *) c->docs[i],
+                             c->lens[i]) != yajl_status_ok;
+        failed |= yajl_complete_parse(h) != yajl_status_ok;
+        yajl_free(h);
+    }
+
+    if (failed) {
+        for (i = 0; i < c->count; i++) yajl_tape_free(tapes[i]);
+        free(tapes);
+        return NULL;
+    }
+    return tapes;
+}
+
+static double replay_tapes(const corpus *c, const yajl_callbacks *cb,
+                           void **ctx)
+{
+    yajl_tape *tapes = record_tapes(c);
+    double start, elapsed;
+    int failed = 0;
+    size_t i;
+
+    if (!tapes) return -1;
+
+    start = now();
+    for (i = 0; i < c->count; i++) {
+        failed |= yajl_tape_replay(tapes[i], cb, ctx ? ctx[i] : NULL) !=
+                  yajl_status_ok;
+    }
+    elapsed = now() - start;
+
+    for (i = 0; i < c->count; i++) yajl_tape_free(tapes[i]);
+    free(tapes);
+    return failed ? -1 : elapsed;
+}
+
+static double stage_replay(const corpus *c)
+{
+    return replay_tapes(c, &event_callbacks, NULL);
+}
+
+static double stage_replay_reformat(const corpus *c)
+{
+    void **gens = malloc(c->count * sizeof(void *));
+    double elapsed;
+    size_t i;
+
+    for (i = 0; i < c->count; i++) gens[i] = yajl_gen_alloc();
+    elapsed = replay_tapes(c, &reformat_callbacks, gens);
+    for (i = 0; i < c->count; i++) {
+        yajl_gen_deinit(gens[i]);
+        yajl_gen_free(gens[i]);
     }
+    free(gens);
+    return elapsed;
+}
+
+/* transcoding to MessagePack and CBOR as the documents are parsed */
+static double pack_corpus(const corpus *c, yajl_pack_format format)
+{
+    yajl_pack *packs = malloc(c->count * sizeof(yajl_pack));
+    void **ctx = malloc(c->count * sizeof(void *));
+    double elapsed;
+    size_t i;
+
+    for (i = 0; i < c->count; i++) ctx[i] = packs[i] = yajl_pack_alloc(format);
+    elapsed = parse_corpus(c, yajl_pack_callbacks(packs[0]), ctx, 1, 0);
+    for (i = 0; i < c->count; i++) yajl_pack_free(packs[i]);
+    free(packs);
+    free(ctx);
+    return elapsed;
+}
+
+static double stage_msgpack(const corpus *c)
+{
+    return pack_corpus(c, yajl_pack_msgpack);
+}
+
+static double stage_cbor(const corpus *c)
+{
+    return pack_corpus(c, yajl_pack_cbor);
+}
+
+/* reading the MessagePack of each document (packed untimed) into the
+ * same callbacks as events and reformat */
+static double unpack_corpus(const corpus *c, const yajl_callbacks *cb,
+                            void **ctx)
+{
+    yajl_pack *packs = malloc(c->count * sizeof(yajl_pack));
+    yajl_unpack *unpacks = malloc(c->count * sizeof(yajl_unpack));
+    double start, elapsed;
+    int failed = 0;
+    size_t i;
+
+    for (i = 0; i < c->count; i++) {
+        yajl_handle h;
+        packs[i] = yajl_pack_alloc(yajl_pack_msgpack);
+        h = yajl_alloc(yajl_pack_callbacks(packs[i]), NULL, packs[i]);
+        failed |= yajl_parse(h, (const unsigned char *) c->docs[i],
+                             c->lens[i]) != yajl_status_ok;
+        failed |= yajl_complete_parse(h) != yajl_status_ok;
+        yajl_free(h);
+        unpacks[i] = yajl_unpack_alloc(cb, ctx ? ctx[i] : NULL);
+    }
+
+    start = now();
+    for (i = 0; i < c->count && !failed; i++) {
+        const unsigned char *buf;
+        size_t len;
+        yajl_pack_get_buf(packs[i], &buf, &len);
+        failed |= yajl_unpack_parse(unpacks[i], buf, len) != yajl_status_ok;
+        failed |= yajl_unpack_complete(unpacks[i]) != yajl_status_ok;
+    }
+    elapsed = now() - start;
+
+    for (i = 0; i < c->count; i++) {
+        yajl_pack_free(packs[i]);
+        yajl_unpack_free(unpacks[i]);
+    }
+    free(packs);
+    free(unpacks);
+    return failed ? -1 : elapsed;
+}
+
+static double stage_unpack(const corpus *c)
+{
+    return unpack_corpus(c, &event_callbacks, NULL);
+}
+
+static double stage_unpack_reformat(const corpus *c)
+{
+    void **gens = malloc(c->count * sizeof(void *));
+    double elapsed;
+    size_t i;
+
+    for (i = 0; i < c->count; i++) gens[i] = yajl_gen_alloc();
+    elapsed = unpack_corpus(c, &reformat_callbacks, gens);
+    for (i = 0; i < c->count; i++) {
+        yajl_gen_deinit(gens[i]);
+        yajl_gen_free(gens[i]);
+    }
+    free(gens);
+    return elapsed;
+}
+
+/* converting records to columns, as the events stage parses them.  Only
+ * the records corpus is made of flat records. */
+static double stage_columns(const corpus *c)
+{
+    void **columns;
+    double elapsed;
+    size_t i;
+
+    if (strcmp(c->name, "records")) return SKIPPED;
+    columns = malloc(c->count * sizeof(void *));
+    for (i = 0; i < c->count; i++) columns[i] = yajl_columns_alloc();
+    elapsed = parse_corpus(c, yajl_columns_callbacks(columns[0]), columns, 1,
+                           0);
+    for (i = 0; i < c->count; i++) yajl_columns_free(columns[i]);
+    free(columns);
+    return elapsed;
+}
+
+static const struct {
+    const char *name;
+    double (*run)(const corpus *);
+} stages[] = {
+    {"lex", stage_lex},
+    {"parse", stage_parse},
+    {"parse_1", stage_parse_1},
+    {"parse_16", stage_parse_16},
+    {"parse_4096", stage_parse_4096},
+    {"tree_build", stage_tree_build},
+    {"tree_read", stage_tree_read},
+    {"tree_free", stage_tree_free},
+    {"snap_open", stage_snap_open},
+    {"snap_read", stage_snap_read},
+    {"gen", stage_gen},
+    {"serialize", stage_serialize},
+    {"reformat", stage_reformat},
+    {"events", stage_events},
+    {"replay", stage_replay},
+    {"replay_fmt", stage_replay_reformat},
+    {"msgpack", stage_msgpack},
+    {"cbor", stage_cbor},
+    {"unpack", stage_unpack},
+    {"unpack_fmt", stage_unpack_reformat},
+    {"columns", stage_columns},
+    {"validate", stage_validate},
+    {"verify", stage_verify},
+};
+
+#define NUM_STAGES (sizeof(stages) / sizeof(*stages))
+
+/** measurement and reporting **/
 
-    /* parsed doc 'times' times */
-    {
-        double throughput;
-        double now;
-        const char * all_units[] = { "B/s", "KB/s", "MB/s", (char *) 0 };
-        const char ** units = all_units;
-        int i, avg_doc_size = 0;
+typedef enum { out_text, out_csv, out_json } output_format;
 
-        now = mygettime();
+static int cmp_double(const void *a, const void *b)
+{
+    const double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p)
+{
+    size_t i = (size_t) (p / 100.0 * (n - 1) + 0.5);
+    return sorted[i < n ? i : n - 1];
+}
 
-        for (i = 0; i < num_docs(); i++) avg_doc_size += doc_size(i);
-        avg_doc_size /= num_docs();
+#define MIN_SAMPLES 5
+
+static int measure(size_t s, const corpus *c, double warmup, double budget,
+                   output_format fmt)
+{
+    double *samples = NULL;
+    size_t n = 0, cap = 0;
+    double start = now();
+    double p50, p90, p99;
+
+    if (stages[s].run(c) == SKIPPED) return 0;
+    while (now() - start < warmup) {
+        if (stages[s].run(c) < 0) goto failed;
+    }
 
-        throughput = (times * avg_doc_size) / (now - starttime);
-        
-        while (*(units + 1) && throughput > 1024) {
-            throughput /= 1024;
-            units++;
+    start = now();
+    while (n < MIN_SAMPLES || now() - start < budget) {
+        double t = stages[s].run(c);
+        if (t < 0) goto failed;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            samples = realloc(samples, cap * sizeof(double));
         }
-        
-        printf("Parsing speed: %g %s\n", throughput, *units);
+        samples[n++] = t;
     }
 
+    qsort(samples, n, sizeof(double), cmp_double);
+    p50 = percentile(samples, n, 50);
+    p90 = percentile(samples, n, 90);
+    p99 = percentile(samples, n, 99);
+
+    switch (fmt) {
+        case out_text:
+            printf("%-10s %-9s %6zu %10zu %7zu %9.1f %9.1f %9.1f %9.1f %9.1f "
+                   "%12.0f\n", stages[s].name, c->name, n, c->bytes, c->count,
+                   samples[0] * 1e6, p50 * 1e6, p90 * 1e6, p99 * 1e6,
+                   c->bytes / p50 / (1024.0 * 1024.0), c->count / p50);
+            break;
+        case out_csv:
+            printf("%s,%s,%zu,%zu,%zu,%.9f,%.9f,%.9f,%.9f,%.9f,%.1f,%.1f\n",
+                   stages[s].name, c->name, n, c->bytes, c->count,
+                   samples[0], p50, p90, p99, samples[n - 1],
+                   c->bytes / p50, c->count / p50);
+            break;
+        case out_json:
+            printf("{\"stage\":\"%s\",\"corpus\":\"%s\",\"samples\":%zu,"
+                   "\"bytes\":%zu,\"docs\":%zu,\"min_s\":%.9f,\"p50_s\":%.9f,"
+                   "\"p90_s\":%.9f,\"p99_s\":%.9f,\"max_s\":%.9f,"
+                   "\"bytes_per_s\":%.1f,\"docs_per_s\":%.1f}\n",
+                   stages[s].name, c->name, n, c->bytes, c->count,
+                   samples[0], p50, p90, p99, samples[n - 1],
+                   c->bytes / p50, c->count / p50);
+            break;
+    }
+
+    free(samples);
     return 0;
+
+failed:
+    fprintf(stderr, "stage '%s' failed on corpus '%s'\n", stages[s].name,
+            c->name);
+    free(samples);
+    return 1;
+}
+
+static int selected(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = list;
+
+    if (!list) return 1;
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == 0)) {
+            return 1;
+        }
+        p += len;
+    }
+    return 0;
+}
+
+static void usage(const char *progname)
+{
+    size_t i;
+    fprintf(stderr,
+            "usage:  %s [options]\n"
+            "    -s LIST  comma separated stages to run (default all)\n"
+            "    -c LIST  comma separated corpora to use (default all)\n"
+            "    -t SECS  time budget per stage and corpus (default 1)\n"
+            "    -w SECS  warmup per stage and corpus (default 0.2)\n"
+            "    -f FMT   output format: text, csv or json (default text)\n"
+            "    -z SIZE  bytes in each synthetic corpus (default 256K)\n"
+            "stages:", progname);
+    for (i = 0; i < NUM_STAGES; i++) fprintf(stderr, " %s", stages[i].name);
+    fprintf(stderr, "\ncorpora:");
+    for (i = 0; i < NUM_CORPORA; i++) fprintf(stderr, " %s", corpora[i].name);
+    fprintf(stderr, "\n");
+    exit(1);
 }
 
 int
-main(void)
+main(int argc, char **argv)
 {
-    int rv = 0;
+    const char *stageList = NULL, *corpusList = NULL;
+    double budget = 1.0, warmup = 0.2;
+    size_t size = 256 * 1024;
+    output_format fmt = out_text;
+    size_t s, i;
+    int a, rv = 0;
 
-    printf("-- speed tests determine parsing throughput given %d different sample documents --\n",
-           num_docs());
+    for (a = 1; a < argc; a++) {
+        if (a + 1 >= argc) usage(argv[0]);
+        if (!strcmp(argv[a], "-s")) stageList = argv[++a];
+        else if (!strcmp(argv[a], "-c")) corpusList = argv[++a];
+        else if (!strcmp(argv[a], "-t")) budget = atof(argv[++a]);
+        else if (!strcmp(argv[a], "-w")) warmup = atof(argv[++a]);
+        else if (!strcmp(argv[a], "-z")) {
+            char *end;
+            double v = strtod(argv[++a], &end);
+            if (*end == 'K' || *end == 'k') v *= 1024.0;
+            else if (*end == 'M' || *end == 'm') v *= 1024.0 * 1024.0;
+            else if (*end == 'G' || *end == 'g') v *= 1024.0 * 1024.0 * 1024.0;
+            size = (size_t) v;
+        }
+        else if (!strcmp(argv[a], "-f")) {
+            const char *f = argv[++a];
+            if (!strcmp(f, "text")) fmt = out_text;
+            else if (!strcmp(f, "csv")) fmt = out_csv;
+            else if (!strcmp(f, "json")) fmt = out_json;
+            else usage(argv[0]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (fmt == out_text) {
+        printf("%-10s %-9s %6s %10s %7s %9s %9s %9s %9s %9s %12s\n", "stage",
+               "corpus", "n", "bytes", "docs", "min_us", "p50_us", "p90_us",
+               "p99_us", "MB/s", "docs/s");
+    } else if (fmt == out_csv) {
+        printf("stage,corpus,samples,bytes,docs,min_s,p50_s,p90_s,p99_s,"
+               "max_s,bytes_per_s,docs_per_s\n");
+    }
+
+    for (i = 0; i < NUM_CORPORA; i++) {
+        corpus c;
+        size_t d;
+
+        if (!selected(corpusList, corpora[i].name)) continue;
+        memset(&c, 0, sizeof(c));
+        c.name = corpora[i].name;
+        corpora[i].build(&c, size);
+
+        for (s = 0; s < NUM_STAGES; s++) {
+            if (!selected(stageList, stages[s].name)) continue;
+            rv |= measure(s, &c, warmup, budget, fmt);
+            fflush(stdout);
+        }
+
+        for (d = 0; d < c.count; d++) free(c.docs[d]);
+        free(c.docs);
+        free(c.lens);
+    }
 
-    printf("With UTF8 validation:\n");
-    rv = run(1);
-    if (rv != 0) return rv;
-    printf("Without UTF8 validation:\n");
-    rv = run(0);
     return rv;
 }
-
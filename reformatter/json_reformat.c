@@ -101,7 +101,8 @@ static yajl_callbacks callbacks = {
     reformat_map_key,
     reformat_end_map,
     reformat_start_array,
-    reformat_end_array
+    reformat_end_array,
+    NULL
 };
 
 static void
@@ -129,9 +130,11 @@ main(int argc, char ** argv)
     int retval = 0;
     int a = 1;
 
-    g = yajl_gen_alloc(NULL);
+    g = yajl_gen_alloc();
     yajl_gen_config(g, yajl_gen_beautify, 1);
     yajl_gen_config(g, yajl_gen_validate_utf8, 1);
+    /* output is written to stdout as it's generated */
+    yajl_gen_config(g, yajl_gen_output_fd, 1);
 
     /* ok.  open file.  let's read and parse */
     hand = yajl_alloc(&callbacks, NULL, (void *) g);
@@ -184,14 +187,6 @@ main(int argc, char ** argv)
         stat = yajl_parse(hand, fileData, rd);
 
         if (stat != yajl_status_ok) break;
-
-        {
-            const unsigned char * buf;
-            size_t len;
-            yajl_gen_get_buf(g, &buf, &len);
-            fwrite(buf, 1, len, stdout);
-            yajl_gen_clear(g);
-        }
     }
 
     stat = yajl_complete_parse(hand);
@@ -203,6 +198,11 @@ main(int argc, char ** argv)
         retval = 1;
     }
 
+    if (yajl_gen_flush(g) != yajl_gen_status_ok) {
+        fprintf(stderr, "error writing output.\n");
+        retval = 1;
+    }
+
     yajl_gen_free(g);
     yajl_free(hand);
 
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file yajl_bind.h
+ * Describe the layout of C structs with field tables and generate JSON
+ * directly from struct instances.
+ *
+ * A field table is plain static data:
+ *
+ *   typedef struct { long long id; const char *name; } user;
+ *
+ *   static const yajl_bind_field userFields[] = {
+ *       YAJL_BIND_FIELD(user, id, yajl_bind_long_long),
+ *       YAJL_BIND_FIELD(user, name, yajl_bind_cstring)};
+ *   static const yajl_bind_table userTable =
+ *       YAJL_BIND_TABLE(user, userFields);
+ *
+ * The table is compiled once with yajl_bind_alloc(), which escapes every
+ * key up front, and the result can then be used to generate any number of
+ * structs with yajl_gen_struct().  Generating doesn't change a compiled
+ * table, so one can be shared by generators in several threads, beautifying
+ * or not.
+ */
+
+#ifndef __YAJL_BIND_H__
+#define __YAJL_BIND_H__
+
+#include "yajl_gen.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** the C type found at a field's offset */
+typedef enum {
+    /** int */
+    yajl_bind_int,
+    /** long long */
+    yajl_bind_long_long,
+    /** double, infinity and NaN are generated as null */
+    yajl_bind_double,
+    /** int, zero is false and anything else is true */
+    yajl_bind_bool,
+    /** const char *, null terminated.  NULL is generated as null */
+    yajl_bind_cstring,
+    /** a struct embedded in place, described by 'nested' */
+    yajl_bind_object,
+    /** a pointer to an array of structs described by 'nested'.  The
+     *  element count is a size_t found at 'countOffset'. */
+    yajl_bind_object_array
+} yajl_bind_type;
+
+struct yajl_bind_table;
+
+/** describes one member of a struct */
+typedef struct yajl_bind_field {
+    /** the map key generated for this member */
+    const char *name;
+    yajl_bind_type type;
+    /** offsetof() the member */
+    size_t offset;
+    /** offsetof() the element count, yajl_bind_object_array only */
+    size_t countOffset;
+    /** layout of the nested struct for yajl_bind_object and
+     *  yajl_bind_object_array */
+    const struct yajl_bind_table *nested;
+} yajl_bind_field;
+
+/** describes a whole struct */
+typedef struct yajl_bind_table {
+    const yajl_bind_field *fields;
+    size_t count;
+    /** sizeof() the struct, used to step through arrays */
+    size_t size;
+} yajl_bind_table;
+
+#define YAJL_BIND_FIELD(st, member, type)                                      \
+    { #member, type, offsetof(st, member), 0, NULL }
+
+#define YAJL_BIND_OBJECT(st, member, table)                                    \
+    { #member, yajl_bind_object, offsetof(st, member), 0, table }
+
+#define YAJL_BIND_OBJECT_ARRAY(st, member, countMember, table)                 \
+    {                                                                          \
+        #member, yajl_bind_object_array, offsetof(st, member),                 \
+            offsetof(st, countMember), table                                   \
+    }
+
+#define YAJL_BIND_TABLE(st, fieldArray)                                        \
+    { fieldArray, sizeof(fieldArray) / sizeof(*(fieldArray)), sizeof(st) }
+
+/** an opaque handle to a compiled field table */
+typedef struct yajl_bind_t *yajl_bind;
+
+/** compile a field table (and any tables nested within it).  Keys are
+ *  escaped and combined with their surrounding punctuation once, here,
+ *  rather than every time a struct is generated.  Each table is compiled
+ *  once however often it is nested, so a table may nest itself to
+ *  describe a tree.  The table must outlive the returned handle.
+ *
+ *  \returns a handle which must be freed with yajl_bind_free(), or NULL
+ *           if the table is malformed (a nested field without a table).
+ */
+YAJL_API yajl_bind yajl_bind_alloc(const yajl_bind_table *table);
+
+/** free a compiled field table */
+YAJL_API void yajl_bind_free(yajl_bind bind);
+
+/** generate a map holding every field of the struct pointed to by 's'.
+ *  The map is generated at the current position of the generator exactly
+ *  as if the corresponding yajl_gen_XXX calls had been made. */
+YAJL_API yajl_gen_status yajl_gen_struct(yajl_gen g, yajl_bind bind,
+                                         const void *s);
+
+/** generate an array of 'count' maps from a C array of structs */
+YAJL_API yajl_gen_status yajl_gen_struct_array(yajl_gen g, yajl_bind bind,
+                                               const void *array,
+                                               size_t count);
+
+#ifdef __cplusplus
+}
+
+#endif
+
+#endif
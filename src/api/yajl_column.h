@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file yajl_column.h
+ * Turn an array of flat records into columns as it is parsed, without
+ * building a tree.
+ *
+ *   yajl_columns c = yajl_columns_alloc();
+ *   yajl_handle h = yajl_alloc(yajl_columns_callbacks(c), NULL, c);
+ *   yajl_parse(h, json, jsonLen);
+ *   yajl_complete_parse(h);
+ *   yajl_columns_get(c, 0, &column);
+ *
+ * Records are the objects of a top-level array, or top-level objects
+ * when the parser allows several values.  Each member is appended to the
+ * column of its name; a record without it has a null there.  The layout
+ * follows Apache Arrow: fixed width values, strings as offsets into one
+ * buffer of their bytes, booleans and validity as bitmaps, so memory is
+ * what the columns take and nothing more.
+ */
+
+#ifndef __YAJL_COLUMN_H__
+#define __YAJL_COLUMN_H__
+
+#include "yajl_common.h"
+#include "yajl_parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** the type of a column */
+typedef enum {
+    /** nothing but nulls so far, the type is taken from the first value.
+     *  A column declared with it has its type inferred like any other. */
+    yajl_column_null,
+    /** 64 bit integers.  An inferred integer column becomes a double
+     *  column when it meets a number which is not an integer or is above
+     *  LLONG_MAX. */
+    yajl_column_int64,
+    /** doubles, which also take integers */
+    yajl_column_double,
+    yajl_column_bool,
+    /** UTF-8 strings */
+    yajl_column_string
+} yajl_column_type;
+
+/** a column, valid until the converter is next used.  Row i is null
+ *  unless bit (i % 8) of validity[i / 8] is set; its value is then found
+ *  in the one array that goes with the column's type. */
+typedef struct {
+    const char *name;
+    size_t nameLen;
+    yajl_column_type type;
+    size_t length;
+    size_t nulls;
+    const unsigned char *validity;
+    const long long *integers;
+    const double *doubles;
+    /** a bitmap like validity */
+    const unsigned char *booleans;
+    /** string i is data[offsets[i]] to data[offsets[i + 1]], not null
+     *  terminated.  There are length + 1 offsets. */
+    const long long *offsets;
+    const char *data;
+} yajl_column;
+
+/** a converter, the context for its callbacks */
+typedef struct yajl_columns_s *yajl_columns;
+
+/** allocate a converter which infers its columns from the records */
+YAJL_API yajl_columns yajl_columns_alloc(void);
+
+/** free a converter.  Passing NULL is a no-op. */
+YAJL_API void yajl_columns_free(yajl_columns c);
+
+/** declare a column before parsing.  Once any column is declared only
+ *  those are kept and other members are skipped, however deeply they
+ *  nest.  A value which doesn't fit its declared type fails the parse.
+ *  Returns zero if the name is already a column or rows have been
+ *  added. */
+YAJL_API int yajl_columns_declare(yajl_columns c, const char *name,
+                                  yajl_column_type type);
+
+/** the callbacks which feed the converter, to be passed to yajl_alloc()
+ *  with the converter as their context.  They fail the parse (with
+ *  yajl_status_client_canceled) on a record which isn't an object, a
+ *  member given twice in one record, a nested value in a column, or a
+ *  value of the wrong type; yajl_columns_error() says which. */
+YAJL_API const yajl_callbacks *yajl_columns_callbacks(yajl_columns c);
+
+/** the number of complete records so far */
+YAJL_API size_t yajl_columns_rows(yajl_columns c);
+
+/** the number of columns, in the order they were declared or first
+ *  seen */
+YAJL_API size_t yajl_columns_count(yajl_columns c);
+
+/** fill in \em column with column \em i, which must be below
+ *  yajl_columns_count() */
+YAJL_API void yajl_columns_get(yajl_columns c, size_t i,
+                               yajl_column *column);
+
+/** drop the rows so far, keeping the columns and their types, to convert
+ *  a stream in batches */
+YAJL_API void yajl_columns_clear(yajl_columns c);
+
+/** why the callbacks failed, or NULL if they haven't */
+YAJL_API const char *yajl_columns_error(yajl_columns c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
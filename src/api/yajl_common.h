@@ -51,6 +51,37 @@ typedef struct {
     void *ctx;
 } yajl_alloc_funcs;
 
+/** counters describing the work done and the memory held by a parser,
+ *  generator or parse tree.  See yajl_get_stats(), yajl_gen_get_stats()
+ *  and yajl_tree_parse_stats().  Counters which don't apply are zero. */
+typedef struct {
+    /** heap blocks allocated */
+    size_t allocations;
+    /** times a heap block was grown */
+    size_t reallocs;
+    /** the most bytes of heap held at once */
+    size_t peakBytes;
+    /** times the string decoding, lexer or output buffer had to grow */
+    size_t bufferGrowths;
+    /** tokens which were split across two yajl_parse() calls and had to
+     *  be pieced together in the lexer's buffer */
+    size_t splicedTokens;
+    /** the deepest nesting of maps and arrays */
+    size_t maxDepth;
+    /** values seen, by type */
+    size_t nulls;
+    size_t booleans;
+    size_t integers;
+    size_t doubles;
+    size_t strings;
+    size_t maps;
+    size_t arrays;
+    /** map keys seen */
+    size_t keys;
+    /** strings and keys which contained escapes and had to be decoded */
+    size_t escapedStrings;
+} yajl_stats;
+
 #ifdef __cplusplus
 }
 
@@ -56,7 +56,14 @@ typedef enum {
     /** returned from yajl_gen_string() when the yajl_gen_validate_utf8
      *  option is enabled and an invalid was passed by client code.
      */
-    yajl_gen_invalid_string
+    yajl_gen_invalid_string,
+    /** returned from yajl_gen_raw_value() when passed an empty fragment, or
+     *  from yajl_gen_raw_value_validate() when the fragment is not a single
+     *  valid JSON value */
+    yajl_gen_invalid_value,
+    /** writing buffered output to the yajl_gen_output_fd failed (errno
+     *  holds the reason).  The generator is left in an error state. */
+    yajl_gen_output_error
 } yajl_gen_status;
 
 typedef enum __attribute__((packed)) yajl_gen_state {
@@ -64,6 +71,9 @@ typedef enum __attribute__((packed)) yajl_gen_state {
     yajl_gen_map_start,
     yajl_gen_map_key,
     yajl_gen_map_val,
+    /* a prepared key was generated along with its ':', so the value
+     * needs no separator */
+    yajl_gen_map_colon,
     yajl_gen_array_start,
     yajl_gen_in_array,
     yajl_gen_complete,
@@ -86,14 +96,20 @@ typedef struct yajl_gen_t {
      * a bigger problem than running out of bits for depth storage... */
     uint64_t depth : 56;
     uint64_t flags : 8; /* flags are an instance of 'yajl_gen_option' */
+    /* where output goes in sink mode, NULL when it's only buffered */
+    struct yajl_gen_sink_t *sink;
 } yajl_gen_t;
 
-_Static_assert(sizeof(yajl_gen_t) == (8 * 3) + ((8 * 2) + (8 * 2)) + (8),
+_Static_assert(sizeof(yajl_gen_t) == (8 * 4) + ((8 * 2) + (8 * 2)) + (8) + (8),
                "gen_t bigger than we think?");
 
 /** an opaque handle to a generator */
 typedef struct yajl_gen_t *yajl_gen;
 
+/** a function which receives generated output in sink mode, see
+ *  yajl_gen_print_callback */
+typedef void (*yajl_print_t)(void *ctx, const char *str, size_t len);
+
 /** configuration parameters for the parser, these may be passed to
  *  yajl_gen_config() along with option specific argument(s).  In general,
  *  all configuration parameters default to *off*. */
@@ -106,6 +122,18 @@ typedef enum yajl_gen_option {
      * spaces.  The default is four spaces ' '.
      */
     yajl_gen_indent_string = 0x02,
+    /**
+     * Set a function and a void * context pointer that receive the
+     * generated output, rather than collecting it all in the internal
+     * buffer.  Output is buffered until the yajl_gen_flush_threshold is
+     * reached or a complete JSON value has been generated, and is then
+     * handed over and the buffer emptied, so memory use stays bounded no
+     * matter how much is generated.  yajl_gen_get_buf() returns
+     * yajl_gen_no_buf in this mode.  This replaces any output fd.  Pass a
+     * NULL function to go back to buffering everything.  Output still
+     * pending for the previous callback or fd is flushed to it first.
+     */
+    yajl_gen_print_callback = 0x04,
     /**
      * Normally the generator does not validate that strings you
      * pass to it via yajl_gen_string() are valid UTF8.  Enabling
@@ -118,9 +146,38 @@ typedef enum yajl_gen_option {
      * iterest of saving bytes.  Setting this flag will cause YAJL to
      * always escape '/' in generated JSON strings.
      */
-    yajl_gen_escape_solidus = 0x10
+    yajl_gen_escape_solidus = 0x10,
+    /**
+     * Like yajl_gen_print_callback, but output is written straight to a
+     * file descriptor (an int), retrying short writes.  This replaces any
+     * print callback.  Pass -1 to go back to buffering everything.  Output
+     * still pending for the previous callback or fd is flushed to it
+     * first, and the option fails if that write fails.
+     */
+    yajl_gen_output_fd = 0x20,
+    /**
+     * The number of bytes (a size_t) buffered before output is flushed to
+     * the print callback or output fd.  Defaults to
+     * YAJL_GEN_FLUSH_THRESHOLD.
+     */
+    yajl_gen_flush_threshold = 0x40,
+    /**
+     * Zero-copy mode: strings passed to yajl_gen_string() containing a run
+     * of at least this many bytes (a size_t) which need no escaping, and
+     * yajl_gen_raw_value() fragments of at least this size, are referenced
+     * in place rather than copied into the output buffer.  The output then
+     * is a chain of pieces to be fetched with yajl_gen_get_iov(), and
+     * yajl_gen_get_buf() returns yajl_gen_no_buf.  Referenced memory must
+     * stay valid and unchanged until the output has been consumed and
+     * yajl_gen_clear() called; with a print callback or output fd it is
+     * written out before the generating call returns.  0 (the default)
+     * turns zero-copy mode off.
+     */
+    yajl_gen_zero_copy_threshold = 0x80
 } yajl_gen_option;
 
+#define YAJL_GEN_FLUSH_THRESHOLD (64 * 1024)
+
 /** allow the modification of generator options subsequent to handle
  *  allocation (via yajl_alloc)
  *  \returns zero in case of errors, non-zero otherwise
@@ -160,12 +217,92 @@ YAJL_API yajl_gen_status yajl_gen_map_close(yajl_gen hand);
 YAJL_API yajl_gen_status yajl_gen_array_open(yajl_gen hand);
 YAJL_API yajl_gen_status yajl_gen_array_close(yajl_gen hand);
 
+/** insert an already serialized JSON value at the current position, for
+ *  example a cached fragment, without re-parsing it.  The fragment is
+ *  copied verbatim: it is not checked and, in beautify mode, it is not
+ *  re-indented.  It is up to the caller to pass exactly one complete
+ *  value; anything else produces invalid output. */
+YAJL_API yajl_gen_status yajl_gen_raw_value(yajl_gen hand, const void *json,
+                                            size_t len);
+
+/** like yajl_gen_raw_value(), but the fragment is validated first and
+ *  yajl_gen_invalid_value is returned (with nothing generated) unless it
+ *  holds exactly one valid JSON value. */
+YAJL_API yajl_gen_status yajl_gen_raw_value_validate(yajl_gen hand,
+                                                     const void *json,
+                                                     size_t len);
+
+/** an opaque handle to a map key which has been escaped and quoted ahead
+ *  of time, see yajl_gen_key_prepare() */
+typedef struct yajl_gen_key_t *yajl_gen_prepared_key;
+
+/** escape and quote a map key once so it can be generated any number of
+ *  times with yajl_gen_key().  This pays off for the fixed set of keys
+ *  most programs emit over and over.
+ *
+ *  \param hand the generator whose yajl_gen_escape_solidus and
+ *              yajl_gen_validate_utf8 options should apply, or NULL for
+ *              the defaults.
+ *
+ *  \returns a handle which must be freed with yajl_gen_key_free(), or NULL
+ *           if 'hand' validates UTF8 and the key is not valid UTF8.
+ */
+YAJL_API yajl_gen_prepared_key yajl_gen_key_prepare(yajl_gen hand,
+                                                    const void *key,
+                                                    size_t len);
+
+/** free a prepared key */
+YAJL_API void yajl_gen_key_free(yajl_gen_prepared_key key);
+
+/** generate a prepared key.  Where a map key is expected the separator,
+ *  quoted key and ':' are written with a single append (in beautify mode
+ *  the indentation is written before the key as usual).  Anywhere else
+ *  the key is generated as a plain string value.
+ *
+ *  Generating a key doesn't change it, so a prepared key may be shared
+ *  by any number of generators, in any number of threads. */
+YAJL_API yajl_gen_status yajl_gen_key(yajl_gen hand, yajl_gen_prepared_key key);
+
 /** access the null terminated generator buffer.  If incrementally
  *  outputing JSON, one should call yajl_gen_clear to clear the
  *  buffer.  This allows stream generation. */
 YAJL_API yajl_gen_status yajl_gen_get_buf(yajl_gen hand, void **buf,
                                           size_t *len);
 
+/** hand everything buffered so far to the print callback or output fd
+ *  and empty the buffer.  Call this once generation is finished, since
+ *  output is only flushed automatically when the threshold is reached or
+ *  a complete value has been generated.  Does nothing unless a sink is
+ *  configured.
+ *
+ *  \returns yajl_gen_output_error if writing to the output fd failed */
+YAJL_API yajl_gen_status yajl_gen_flush(yajl_gen hand);
+
+/** one piece of the generated output.  On POSIX systems it has the
+ *  layout of struct iovec, so a vector of them may be passed to writev()
+ *  with a cast. */
+typedef struct {
+    void *base;
+    size_t len;
+} yajl_gen_iovec;
+
+/** access the generated output as a vector suitable for writev(): pieces
+ *  of the internal buffer interleaved with caller memory referenced in
+ *  zero-copy mode (without zero-copy mode there is at most one piece).
+ *  The vector belongs to the generator and is valid until the next call
+ *  to any generator function.
+ *
+ *  \returns yajl_gen_no_buf if a print callback or output fd is set, or
+ *           memory for the vector can't be allocated */
+YAJL_API yajl_gen_status yajl_gen_get_iov(yajl_gen hand,
+                                          const yajl_gen_iovec **iov,
+                                          size_t *count);
+
+/** get the memory used by the generator: the output buffer and its
+ *  growth, deep nesting state and the output sink.  The handle itself is
+ *  not included, and the value counters are left at zero. */
+YAJL_API void yajl_gen_get_stats(yajl_gen hand, yajl_stats *stats);
+
 /** clear yajl's output buffer, but maintain all internal generation
  *  state.  This function will not "reset" the generator state, and is
  *  intended to enable incremental JSON outputing. */
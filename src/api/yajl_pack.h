@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file yajl_pack.h
+ * Transcode JSON to MessagePack or CBOR as it is parsed.
+ *
+ *   yajl_pack p = yajl_pack_alloc(yajl_pack_msgpack);
+ *   yajl_handle h = yajl_alloc(yajl_pack_callbacks(p), NULL, p);
+ *   yajl_parse(h, json, jsonLen);
+ *   yajl_complete_parse(h);
+ *   yajl_pack_get_buf(p, &out, &outLen);
+ *
+ * Integers which fit 64 bits (signed, or unsigned above LLONG_MAX) are
+ * packed as integers, larger ones are a parse error as they are for
+ * yajl_integer.  Other numbers are packed as 64 bit floats.
+ *
+ * MessagePack can also be read back into any set of callbacks, in chunks
+ * split anywhere:
+ *
+ *   yajl_unpack u = yajl_unpack_alloc(&callbacks, ctx);
+ *   yajl_unpack_parse(u, chunk, chunkLen);
+ *   ...
+ *   yajl_unpack_complete(u);
+ */
+
+#ifndef __YAJL_PACK_H__
+#define __YAJL_PACK_H__
+
+#include "yajl_common.h"
+#include "yajl_parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** the binary format to produce */
+typedef enum {
+    /** MessagePack.  The callbacks don't say how big a map or array is
+     *  until it closes, so its header is patched in afterwards and each
+     *  top-level value is only complete (and compacted to the smallest
+     *  headers) once it has been parsed entirely. */
+    yajl_pack_msgpack,
+    /** CBOR, with maps and arrays of indefinite length, so output is
+     *  final as soon as it is produced and can be taken at any time. */
+    yajl_pack_cbor
+} yajl_pack_format;
+
+/** a transcoder, the context for its callbacks */
+typedef struct yajl_pack_s *yajl_pack;
+
+/** allocate a transcoder producing \em format */
+YAJL_API yajl_pack yajl_pack_alloc(yajl_pack_format format);
+
+/** free a transcoder.  Passing NULL is a no-op. */
+YAJL_API void yajl_pack_free(yajl_pack p);
+
+/** the callbacks which feed the transcoder, to be passed to yajl_alloc()
+ *  with the transcoder as their context */
+YAJL_API const yajl_callbacks *yajl_pack_callbacks(yajl_pack p);
+
+/** the output so far.  For MessagePack, only complete top-level values
+ *  are final. */
+YAJL_API void yajl_pack_get_buf(yajl_pack p, const unsigned char **buf,
+                                size_t *len);
+
+/** drop the output so far, to be called between top-level values when
+ *  streaming */
+YAJL_API void yajl_pack_clear(yajl_pack p);
+
+/** a MessagePack reader */
+typedef struct yajl_unpack_s *yajl_unpack;
+
+/** allocate a reader which hands what it reads to \em callbacks, as the
+ *  parser would for the equivalent JSON.  Strings are passed straight
+ *  from the input unless they are split across chunks.  They are not
+ *  checked to be UTF-8, which MessagePack already requires of them. */
+YAJL_API yajl_unpack yajl_unpack_alloc(const yajl_callbacks *callbacks,
+                                       void *ctx);
+
+/** free a reader.  Passing NULL is a no-op. */
+YAJL_API void yajl_unpack_free(yajl_unpack u);
+
+/**
+ * Read the next chunk of input, which may hold any number of top-level
+ * values and end part way through one.
+ *
+ * Numbers go to yajl_number as text if it is set, and otherwise to
+ * whichever of yajl_integer, yajl_unsigned_integer or yajl_double the
+ * parser would have used.
+ *
+ * \returns yajl_status_ok, yajl_status_client_canceled if a callback
+ * returned zero, or yajl_status_error for input which is not MessagePack
+ * or has no JSON equivalent: binary and extension types, keys which are
+ * not strings, an integer above LLONG_MAX which only yajl_integer could
+ * take, or a NaN or infinity for yajl_number.  Once a call has failed,
+ * so do all the following ones.
+ */
+YAJL_API yajl_status yajl_unpack_parse(yajl_unpack u,
+                                       const unsigned char *data, size_t len);
+
+/** check that the input so far ended with a complete value.  Returns
+ *  yajl_status_error if it stopped part way through one. */
+YAJL_API yajl_status yajl_unpack_complete(yajl_unpack u);
+
+/** what went wrong, or NULL if nothing has */
+YAJL_API const char *yajl_unpack_error(yajl_unpack u);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
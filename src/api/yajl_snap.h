@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file yajl_snap.h
+ * Binary snapshots of parse trees, which can be mapped and read in place.
+ *
+ * A document which is parsed at every start-up can be parsed once and
+ * saved as a snapshot:
+ *
+ *   yajl_val tree = yajl_tree_parse(json, err, sizeof(err));
+ *   yajl_snap_save(tree, "config.snap", err, sizeof(err));
+ *
+ * after which opening it costs an mmap() and a look at the header, no
+ * matter how big the document is:
+ *
+ *   yajl_snap s = yajl_snap_open("config.snap", err, sizeof(err));
+ *   yajl_snap_val port = yajl_snap_get(yajl_snap_root(s), path,
+ *                                      yajl_t_number);
+ *
+ * A snapshot holds no pointers, each node refers to its data by an offset
+ * from the node itself, so the mapping is read-only and shared between
+ * every process which opens the same file.  Numbers are converted when
+ * the snapshot is saved, so reading them never writes to the mapping.
+ *
+ * Snapshots are in the byte order of the machine that saved them, and are
+ * refused elsewhere.  Opening one checks only its header: one from an
+ * untrusted source should be checked with yajl_snap_verify() first.
+ */
+
+#ifndef __YAJL_SNAP_H__
+#define __YAJL_SNAP_H__
+
+#include "yajl_common.h"
+#include "yajl_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** a node in a snapshot.  These are read in place from the snapshot, use
+ *  the accessors below rather than the members */
+struct yajl_snap_node_s {
+    /** a yajl_type */
+    uint8_t type;
+    /** YAJL_NUMBER_INT_VALID and YAJL_NUMBER_DOUBLE_VALID, for numbers */
+    uint8_t flags;
+    uint16_t reserved;
+    /** bytes in a string or number's text, members of an object or
+     *  elements of an array */
+    uint32_t len;
+    /** from this node to the text of a string or number (null
+     *  terminated), or the children of an object or array.  An array's
+     *  children are its elements, an object's are the nodes of its keys
+     *  (which are strings) followed by the nodes of its values. */
+    int64_t off;
+    /** a number's value, \em i if it is an integer */
+    union {
+        int64_t i;
+        double d;
+    } value;
+};
+
+/** a node in a snapshot */
+typedef const struct yajl_snap_node_s *yajl_snap_val;
+
+/** an open snapshot */
+typedef struct yajl_snap_s *yajl_snap;
+
+/**
+ * Write a snapshot of a tree into a buffer.
+ * Like \em yajl_tree_serialize the snapshot is only written if it fits,
+ * pass a NULL buffer to find its size.  \em buf must be aligned for a
+ * double, as memory from malloc() is.
+ * \returns the size of the snapshot, or 0 if the tree holds a string or
+ * container too big for one.
+ */
+YAJL_API size_t yajl_snap_serialize(yajl_val v, void *buf, size_t bufLen);
+
+/**
+ * Save a snapshot of a tree to a file, replacing it if it exists.
+ * \returns non-zero on success.  On failure a null terminated message is
+ * stored in \em error_buffer if it is not \c NULL.
+ */
+YAJL_API int yajl_snap_save(yajl_val v, const char *filename,
+                            char *error_buffer, size_t error_buffer_size);
+
+/**
+ * Open a snapshot file by mapping it read-only.
+ * \returns the snapshot, to be released with \em yajl_snap_close, or
+ * \c NULL on error with a message in \em error_buffer if it is not
+ * \c NULL.
+ */
+YAJL_API yajl_snap yajl_snap_open(const char *filename, char *error_buffer,
+                                  size_t error_buffer_size);
+
+/**
+ * Use a snapshot that is already in memory, from \em yajl_snap_serialize
+ * or read from elsewhere.  It is not copied, so must outlive the returned
+ * handle, and must be aligned for a double.
+ */
+YAJL_API yajl_snap yajl_snap_from_buffer(const void *buf, size_t len,
+                                         char *error_buffer,
+                                         size_t error_buffer_size);
+
+/**
+ * Check that every node and string of a snapshot lies within it, so that
+ * reading it can't stray outside.
+ * \returns non-zero if the snapshot is sound.
+ */
+YAJL_API int yajl_snap_verify(yajl_snap s);
+
+/** the top-level value of a snapshot */
+YAJL_API yajl_snap_val yajl_snap_root(yajl_snap s);
+
+/** release a snapshot and unmap it.  Nodes from it can't be used after
+ *  this.  Passing NULL is a no-op. */
+YAJL_API void yajl_snap_close(yajl_snap s);
+
+/**
+ * Access a nested value inside a snapshot, as \em yajl_tree_get does in a
+ * tree.
+ * \returns the found value, or NULL if there is none of the given type.
+ */
+YAJL_API yajl_snap_val yajl_snap_get(yajl_snap_val parent, const char **path,
+                                     yajl_type type);
+
+/* Type checks, as the YAJL_IS_ macros of yajl_tree.h */
+#define YAJL_SNAP_IS_STRING(v) (((v) != NULL) && ((v)->type == yajl_t_string))
+#define YAJL_SNAP_IS_NUMBER(v) (((v) != NULL) && ((v)->type == yajl_t_number))
+#define YAJL_SNAP_IS_INTEGER(v)                                                \
+    (YAJL_SNAP_IS_NUMBER(v) && ((v)->flags & YAJL_NUMBER_INT_VALID))
+#define YAJL_SNAP_IS_DOUBLE(v)                                                 \
+    (YAJL_SNAP_IS_NUMBER(v) && ((v)->flags & YAJL_NUMBER_DOUBLE_VALID))
+#define YAJL_SNAP_IS_OBJECT(v) (((v) != NULL) && ((v)->type == yajl_t_object))
+#define YAJL_SNAP_IS_ARRAY(v) (((v) != NULL) && ((v)->type == yajl_t_array))
+#define YAJL_SNAP_IS_TRUE(v) (((v) != NULL) && ((v)->type == yajl_t_true))
+#define YAJL_SNAP_IS_FALSE(v) (((v) != NULL) && ((v)->type == yajl_t_false))
+#define YAJL_SNAP_IS_NULL(v) (((v) != NULL) && ((v)->type == yajl_t_null))
+
+/** where a node's data is */
+#define YAJL_SNAP_DATA(v) ((const char *)(v) + (v)->off)
+
+/** the null terminated text of a string, or NULL if the value is not a
+ *  string */
+#define YAJL_SNAP_GET_STRING(v) (YAJL_SNAP_IS_STRING(v) ? YAJL_SNAP_DATA(v) : NULL)
+
+/** the length of a string or a number's text.  You should check type
+ *  first */
+#define YAJL_SNAP_GET_LENGTH(v) ((size_t)(v)->len)
+
+/** the null terminated text of a number.  You should check type first,
+ *  perhaps using YAJL_SNAP_IS_NUMBER */
+#define YAJL_SNAP_GET_NUMBER(v) YAJL_SNAP_DATA(v)
+
+/** the integer value of a number.  You should check type first, perhaps
+ *  using YAJL_SNAP_IS_INTEGER */
+#define YAJL_SNAP_GET_INTEGER(v) ((long long)(v)->value.i)
+
+/** the double value of a number, integers included.  You should check type
+ *  first, perhaps using YAJL_SNAP_IS_DOUBLE */
+#define YAJL_SNAP_GET_DOUBLE(v)                                                \
+    (((v)->flags & YAJL_NUMBER_INT_VALID) ? (double)(v)->value.i              \
+                                          : (v)->value.d)
+
+/** the number of members of an object or elements of an array.  You
+ *  should check type first */
+#define YAJL_SNAP_GET_COUNT(v) ((size_t)(v)->len)
+
+/** the i'th element of an array.  You should check type and bounds
+ *  first */
+#define YAJL_SNAP_GET_ELEMENT(v, i) ((yajl_snap_val)YAJL_SNAP_DATA(v) + (i))
+
+/** the null terminated key of the i'th member of an object.  You should
+ *  check type and bounds first */
+#define YAJL_SNAP_GET_KEY(v, i)                                                \
+    YAJL_SNAP_DATA((yajl_snap_val)YAJL_SNAP_DATA(v) + (i))
+
+/** the value of the i'th member of an object.  You should check type and
+ *  bounds first */
+#define YAJL_SNAP_GET_VALUE(v, i)                                              \
+    ((yajl_snap_val)YAJL_SNAP_DATA(v) + (v)->len + (i))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
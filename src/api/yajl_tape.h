@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file yajl_tape.h
+ * Record the events of a parse once and replay them any number of times.
+ *
+ * A tape is recorded by parsing with the recorder's callbacks:
+ *
+ *   yajl_tape tape = yajl_tape_alloc();
+ *   yajl_handle h = yajl_alloc(yajl_tape_recorder(), NULL, tape);
+ *   yajl_parse(h, json, jsonLen);
+ *   yajl_complete_parse(h);
+ *   yajl_free(h);
+ *
+ * and then handed to any set of callbacks, which see just what they would
+ * have seen parsing the same text:
+ *
+ *   yajl_tape_replay(tape, &callbacks, ctx);
+ *
+ * Strings are kept decoded and numbers converted, so replaying does no
+ * lexing, validation or decoding.
+ */
+
+#ifndef __YAJL_TAPE_H__
+#define __YAJL_TAPE_H__
+
+#include "yajl_common.h"
+#include "yajl_parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** a recording of parse events */
+typedef struct yajl_tape_s *yajl_tape;
+
+/** allocate an empty tape */
+YAJL_API yajl_tape yajl_tape_alloc(void);
+
+/** free a tape.  Passing NULL is a no-op. */
+YAJL_API void yajl_tape_free(yajl_tape tape);
+
+/** empty a tape, keeping its memory for the next recording */
+YAJL_API void yajl_tape_clear(yajl_tape tape);
+
+/** the callbacks which record onto a tape, which is their context.  Every
+ *  event is added to the end of the tape, so one tape can hold several
+ *  documents */
+YAJL_API const yajl_callbacks *yajl_tape_recorder(void);
+
+/** the bytes of a tape, which can be kept and replayed with
+ *  \em yajl_tape_replay_buffer.  They are only valid until the tape is
+ *  next changed, and can only be replayed on a machine of the same byte
+ *  order. */
+YAJL_API const unsigned char *yajl_tape_data(yajl_tape tape, size_t *len);
+
+/**
+ * Replay a tape into a set of callbacks.
+ *
+ * Numbers are handed to whichever of yajl_number, yajl_integer,
+ * yajl_unsigned_integer or yajl_double the parser would have used.
+ *
+ * \returns yajl_status_ok, yajl_status_client_canceled if a callback
+ * returned zero, or yajl_status_error where parsing the same text with
+ * these callbacks would have failed on a number too big to convert.
+ */
+YAJL_API yajl_status yajl_tape_replay(yajl_tape tape,
+                                      const yajl_callbacks *callbacks,
+                                      void *ctx);
+
+/** replay the bytes of a tape, from \em yajl_tape_data.  Returns
+ *  yajl_status_error if they are damaged, as well as in the cases of
+ *  \em yajl_tape_replay */
+YAJL_API yajl_status yajl_tape_replay_buffer(const unsigned char *data,
+                                             size_t len,
+                                             const yajl_callbacks *callbacks,
+                                             void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
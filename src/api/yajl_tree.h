@@ -54,6 +54,21 @@ typedef enum {
 
 #define YAJL_NUMBER_INT_VALID 0x01
 #define YAJL_NUMBER_DOUBLE_VALID 0x02
+/** The number hasn't been converted yet, which happens on first use of
+ *  one of the YAJL_IS_INTEGER, YAJL_IS_DOUBLE, YAJL_GET_INTEGER or
+ *  YAJL_GET_DOUBLE macros.  Only set with \c yajl_tree_lazy_numbers. */
+#define YAJL_NUMBER_LAZY 0x04
+/** The number's text is a view into the parsed input rather than a copy,
+ *  it is not null terminated.  See \c yajl_tree_exact_numbers.  A number
+ *  built by hand leaves this clear, and its text is freed with \em free
+ *  by \em yajl_tree_free. */
+#define YAJL_NUMBER_VIEW 0x08
+/** The object's keys are shared, interned by \em yajl_tree_parse and
+ *  counted by the objects using them.  Objects built by hand should leave
+ *  this clear; their keys and the array of them are freed with
+ *  \em free by \em yajl_tree_free.  The flag is only believed of keys the
+ *  parser shared, so one left uninitialized does no harm. */
+#define YAJL_OBJECT_SHARED_KEYS 0x01
 
 /** A pointer to a node in the parse tree */
 typedef struct yajl_val_s *yajl_val;
@@ -81,11 +96,20 @@ struct yajl_val_s {
              * valid. See \c YAJL_NUMBER_INT_VALID and
              * \c YAJL_NUMBER_DOUBLE_VALID. */
             unsigned int flags;
+            unsigned int len; /*< length of \em r in bytes. */
         } number;
         struct {
-            const char **keys; /*< Array of keys */
+            /** Array of keys.  Keys are shared: within one parse every
+             *  occurrence of the same key is the same pointer, so keys
+             *  may be compared by address, and objects with the same keys
+             *  in the same order share one array of them.  They must not
+             *  be changed or freed other than by \em yajl_tree_free. */
+            const char **keys;
             yajl_val *values;  /*< Array of values. */
             size_t len;        /*< Number of key-value-pairs. */
+            /** \c YAJL_OBJECT_SHARED_KEYS for an object from a parse,
+             *  whose other bits are the parser's own, or zero. */
+            unsigned int flags;
         } object;
         struct {
             yajl_val *values; /*< Array of elements. */
@@ -119,11 +143,64 @@ struct yajl_val_s {
 YAJL_API yajl_val yajl_tree_parse(const char *input, char *error_buffer,
                                   size_t error_buffer_size);
 
+/**
+ * Parse a string and report statistics.
+ *
+ * Works like \em yajl_tree_parse, and also fills \em stats with the
+ * parser's counters (see \em yajl_get_stats) plus the allocations making up
+ * the returned tree.  Temporary allocations made while building the tree
+ * are not counted.
+ *
+ * \param stats  Filled in on success and on failure, may be \c NULL.
+ */
+YAJL_API yajl_val yajl_tree_parse_stats(const char *input, char *error_buffer,
+                                        size_t error_buffer_size,
+                                        yajl_stats *stats);
+
+/** options for \em yajl_tree_parse_options, or'ed together */
+typedef enum {
+    /** Keep numbers exactly as they appear in the input, so those beyond
+     *  the precision of a double lose nothing, see
+     *  \em yajl_tree_get_decimal128.
+     *
+     *  The numbers' text is not copied but points into \em input (see
+     *  \c YAJL_NUMBER_VIEW), so the input must outlive the tree, and
+     *  \c YAJL_GET_NUMBER is not null terminated: use
+     *  \c YAJL_GET_NUMBER_LENGTH.
+     */
+    yajl_tree_exact_numbers = 0x01,
+    /** Leave numbers unconverted until they are first asked for (see
+     *  \c YAJL_NUMBER_LAZY), which saves converting those never read.
+     *  The \em i and \em d members are only valid once
+     *  \em yajl_tree_number_flags or one of the YAJL_IS_INTEGER,
+     *  YAJL_IS_DOUBLE, YAJL_GET_INTEGER or YAJL_GET_DOUBLE macros has been
+     *  used on the number.
+     *
+     *  Reading a number then writes to the tree, so unlike other trees,
+     *  which are only read once built, such a tree must not be read from
+     *  several threads at once.
+     */
+    yajl_tree_lazy_numbers = 0x02
+} yajl_tree_option;
+
+/**
+ * Parse a string with options.
+ *
+ * Works like \em yajl_tree_parse.
+ *
+ * \param options  \c yajl_tree_option values or'ed together, or 0.
+ */
+YAJL_API yajl_val yajl_tree_parse_options(const char *input,
+                                          unsigned int options,
+                                          char *error_buffer,
+                                          size_t error_buffer_size);
+
 /**
  * Free a parse tree returned by "yajl_tree_parse".
  *
  * \param v Pointer to a JSON value returned by "yajl_tree_parse". Passing NULL
- * is valid and results in a no-op.
+ * is valid and results in a no-op.  A tree built by hand may be passed if
+ * all of it was allocated with \em malloc.
  */
 YAJL_API void yajl_tree_free(yajl_val v);
 
@@ -145,13 +222,105 @@ YAJL_API void yajl_tree_free(yajl_val v);
 YAJL_API yajl_val yajl_tree_get(yajl_val parent, const char **path,
                                 yajl_type type);
 
+/** where \em yajl_tree_get_cached last found a key, for the next object
+ *  with the same keys.  Start it zeroed and keep one for each key looked
+ *  up; it is checked when used, so it may outlive the tree. */
+typedef struct {
+    const char **keys;
+    size_t slot;
+} yajl_tree_cache;
+
+/**
+ * Look up \em key in \em object, as a one element path would with
+ * \em yajl_tree_get.
+ *
+ * Objects with the same keys in the same order share their keys array, so
+ * for each of an array of records after the first the key is found at
+ * once in the slot \em cache remembers.
+ *
+ * \returns the value, or NULL if \em object isn't an object or hasn't
+ * the key.
+ */
+YAJL_API yajl_val yajl_tree_get_cached(yajl_val object, const char *key,
+                                       yajl_tree_cache *cache);
+
+/** the flags of a number, converting it first if that was left until now.
+ *  You should check type first, perhaps using YAJL_IS_NUMBER */
+YAJL_API unsigned int yajl_tree_number_flags(yajl_val v);
+
+/** the integer value of a number, converting it first if that was left
+ *  until now.  You should check type first, perhaps using YAJL_IS_INTEGER */
+YAJL_API long long yajl_tree_get_integer(yajl_val v);
+
+/** the double value of a number, converting it first if that was left
+ *  until now.  You should check type first, perhaps using YAJL_IS_DOUBLE */
+YAJL_API double yajl_tree_get_double(yajl_val v);
+
+/** an IEEE 754-2008 decimal128 in the binary integer decimal (BID)
+ *  encoding, as two 64 bit halves */
+typedef struct {
+    unsigned long long low;
+    unsigned long long high;
+} yajl_decimal128;
+
+/**
+ * Get the exact decimal128 representation of a number.
+ *
+ * \returns non-zero on success, zero if the number can't be represented
+ * exactly: it has more than 34 significant digits or its exponent is out
+ * of range.
+ */
+YAJL_API int yajl_tree_get_decimal128(yajl_val v, yajl_decimal128 *out);
+
+/** options for \em yajl_tree_serialize, or'ed together */
+typedef enum {
+    /** indent with four spaces and put each element on its own line, just
+     *  as the generator does with \c yajl_gen_beautify */
+    yajl_tree_serialize_beautify = 0x01,
+    /** escape '/' in strings, as \c yajl_gen_escape_solidus */
+    yajl_tree_serialize_escape_solidus = 0x02
+} yajl_tree_serialize_option;
+
+/**
+ * Turn a tree back into JSON text.
+ *
+ * The output is exactly what walking the tree through a generator would
+ * give, with numbers as they were parsed.  It is only written if it fits,
+ * so the exact size can be found first (with a NULL buffer) and reserved
+ * once, or a buffer kept from last time can be tried and only grown when
+ * it turns out too small.
+ *
+ * \param v        the tree, or any node of it
+ * \param options  \c yajl_tree_serialize_option values or'ed together
+ * \param buf      where to write the text, may be NULL if \em bufLen is 0
+ * \param bufLen   the size of \em buf
+ *
+ * \returns the length of the text.  If that is less than \em bufLen the
+ * text has been written to \em buf and null terminated, otherwise
+ * \em buf's contents are undefined.
+ */
+YAJL_API size_t yajl_tree_serialize(yajl_val v, unsigned int options,
+                                    char *buf, size_t bufLen);
+
+/**
+ * Turn a tree back into JSON text in a buffer of exactly the right size.
+ *
+ * \param length  set to the length of the text, may be NULL
+ *
+ * \returns the null terminated text, to be released with free(), or NULL
+ * if out of memory.
+ */
+YAJL_API char *yajl_tree_serialize_alloc(yajl_val v, unsigned int options,
+                                         size_t *length);
+
 /* Various convenience macros to check the type of a `yajl_val` */
 #define YAJL_IS_STRING(v) (((v) != NULL) && ((v)->type == yajl_t_string))
 #define YAJL_IS_NUMBER(v) (((v) != NULL) && ((v)->type == yajl_t_number))
 #define YAJL_IS_INTEGER(v)                                                     \
-    (YAJL_IS_NUMBER(v) && ((v)->u.number.flags & YAJL_NUMBER_INT_VALID))
+    (YAJL_IS_NUMBER(v) && (yajl_tree_number_flags(v) & YAJL_NUMBER_INT_VALID))
 #define YAJL_IS_DOUBLE(v)                                                      \
-    (YAJL_IS_NUMBER(v) && ((v)->u.number.flags & YAJL_NUMBER_DOUBLE_VALID))
+    (YAJL_IS_NUMBER(v) &&                                                      \
+     (yajl_tree_number_flags(v) & YAJL_NUMBER_DOUBLE_VALID))
 #define YAJL_IS_OBJECT(v) (((v) != NULL) && ((v)->type == yajl_t_object))
 #define YAJL_IS_ARRAY(v) (((v) != NULL) && ((v)->type == yajl_t_array))
 #define YAJL_IS_TRUE(v) (((v) != NULL) && ((v)->type == yajl_t_true))
@@ -166,13 +335,17 @@ YAJL_API yajl_val yajl_tree_get(yajl_val parent, const char **path,
  *  perhaps using YAJL_IS_NUMBER */
 #define YAJL_GET_NUMBER(v) ((v)->u.number.r)
 
+/** Get the length of the string representation of a number.  You should
+ *  check type first, perhaps using YAJL_IS_NUMBER */
+#define YAJL_GET_NUMBER_LENGTH(v) ((v)->u.number.len)
+
 /** Get the double representation of a number.  You should check type first,
  *  perhaps using YAJL_IS_DOUBLE */
-#define YAJL_GET_DOUBLE(v) ((v)->u.number.d)
+#define YAJL_GET_DOUBLE(v) yajl_tree_get_double(v)
 
 /** Get the 64bit (long long) integer representation of a number.  You should
  *  check type first, perhaps using YAJL_IS_INTEGER */
-#define YAJL_GET_INTEGER(v) ((v)->u.number.i)
+#define YAJL_GET_INTEGER(v) yajl_tree_get_integer(v)
 
 /** Get a pointer to a yajl_val_object or NULL if the value is not an object. */
 #define YAJL_GET_OBJECT(v) (YAJL_IS_OBJECT(v) ? &(v)->u.object : NULL)
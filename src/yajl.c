@@ -69,6 +69,14 @@ yajl_handle yajl_alloc(const yajl_callbacks *callbacks, yajl_alloc_funcs *afs,
     return hand;
 }
 
+/* the lexer need only work out numbers' values if they're wanted as
+ * integers or doubles rather than as text */
+static uint32_t yajl_wants_numbers(const yajl_callbacks *callbacks) {
+    return callbacks && !callbacks->yajl_number &&
+           (callbacks->yajl_integer || callbacks->yajl_double ||
+            callbacks->yajl_unsigned_integer);
+}
+
 int yajl_config(yajl_handle h, yajl_option opt, ...) {
     int rv = 1;
     va_list ap;
@@ -115,7 +123,8 @@ yajl_status yajl_parse(yajl_handle hand, const unsigned char *jsonText,
     if (hand->lexer == NULL) {
         hand->lexer =
             yajl_lex_alloc(hand->flags & yajl_allow_comments,
-                           !(hand->flags & yajl_dont_validate_strings));
+                           !(hand->flags & yajl_dont_validate_strings),
+                           yajl_wants_numbers(hand->callbacks));
     }
 
     status = yajl_do_parse(hand, jsonText, jsonTextLen);
@@ -132,7 +141,8 @@ yajl_status yajl_complete_parse(yajl_handle hand) {
     if (hand->lexer == NULL) {
         hand->lexer =
             yajl_lex_alloc(hand->flags & yajl_allow_comments,
-                           !(hand->flags & yajl_dont_validate_strings));
+                           !(hand->flags & yajl_dont_validate_strings),
+                           yajl_wants_numbers(hand->callbacks));
     }
 
     return yajl_do_finish(hand);
@@ -152,6 +162,28 @@ size_t yajl_get_bytes_consumed(yajl_handle hand) {
     }
 }
 
+void yajl_get_stats(yajl_handle hand, yajl_stats *stats) {
+    size_t size;
+
+    *stats = hand->stats;
+    stats->allocations++;
+    stats->peakBytes += sizeof(*hand);
+
+    /* the state stack doubles from YAJL_BS_INC and never shrinks */
+    if (hand->stateStack.stack) {
+        stats->allocations++;
+        stats->peakBytes += hand->stateStack.size;
+        for (size = YAJL_BS_INC; size < hand->stateStack.size; size <<= 1) {
+            stats->reallocs++;
+        }
+    }
+
+    yajl_buf_stats(&hand->decodeBuf, stats);
+    if (hand->lexer) {
+        yajl_lex_stats(hand->lexer, stats);
+    }
+}
+
 void yajl_free_error(yajl_handle hand, unsigned char *str) {
     /* use memory allocation functions if set */
     YA_FREE(str);
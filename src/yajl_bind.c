@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "api/yajl_bind.h"
+#include "dualBox.h"
+#include "yajl_alloc.h"
+#include "yajl_encode.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+typedef struct yajl_bind_slot {
+    const yajl_bind_field *field;
+    yajl_gen_prepared_key key;
+    struct yajl_bind_t *nested;
+} yajl_bind_slot;
+
+struct yajl_bind_t {
+    const yajl_bind_table *table;
+    /* non-zero if some key contains a '/', which means the prepared
+     * keys can't be used when the generator escapes solidi */
+    int hasSolidus;
+    /* the handle returned by yajl_bind_alloc() owns every table compiled
+     * for it, itself first, so a table nested in itself (a tree) or in
+     * several places is compiled once.  NULL in the others */
+    struct yajl_bind_t **compiled;
+    size_t compiledCount;
+    size_t count;
+    yajl_bind_slot slots[];
+};
+
+/* allocate a handle for 'table' and record it in root, or make it the
+ * root if there is none yet */
+static yajl_bind bind_new(const yajl_bind_table *table, yajl_bind root) {
+    yajl_bind b, *compiled;
+
+    b = YA_CALLOC(sizeof(*b) + table->count * sizeof(yajl_bind_slot));
+    if (!b) {
+        return NULL;
+    }
+
+    b->table = table;
+    b->count = table->count;
+    if (!root) {
+        root = b;
+    }
+
+    compiled = YA_REALLOC(root->compiled,
+                          (root->compiledCount + 1) * sizeof(*compiled));
+    if (!compiled) {
+        YA_FREE(b);
+        return NULL;
+    }
+
+    root->compiled = compiled;
+    root->compiled[root->compiledCount++] = b;
+    return b;
+}
+
+/* prepare the keys of 'b', compiling the tables nested in it unless root
+ * already has them.  returns zero on failure, leaving what was compiled
+ * for root to free */
+static int bind_compile(yajl_bind b, yajl_bind root) {
+    size_t i, j;
+
+    for (i = 0; i < b->count; i++) {
+        const yajl_bind_field *f = &b->table->fields[i];
+        yajl_bind_slot *slot = &b->slots[i];
+        const size_t nameLen = strlen(f->name);
+
+        slot->field = f;
+        if (f->type == yajl_bind_object || f->type == yajl_bind_object_array) {
+            if (!f->nested) {
+                return 0;
+            }
+
+            for (j = 0; j < root->compiledCount; j++) {
+                if (root->compiled[j]->table == f->nested) {
+                    slot->nested = root->compiled[j];
+                    break;
+                }
+            }
+
+            if (!slot->nested) {
+                slot->nested = bind_new(f->nested, root);
+                if (!slot->nested || !bind_compile(slot->nested, root)) {
+                    return 0;
+                }
+            }
+        }
+
+        if (memchr(f->name, '/', nameLen)) {
+            b->hasSolidus = 1;
+        }
+
+        slot->key = yajl_gen_key_prepare(NULL, f->name, nameLen);
+        if (!slot->key) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+yajl_bind yajl_bind_alloc(const yajl_bind_table *table) {
+    yajl_bind b;
+
+    assert(table);
+
+    b = bind_new(table, NULL);
+    if (b && !bind_compile(b, b)) {
+        yajl_bind_free(b);
+        return NULL;
+    }
+
+    return b;
+}
+
+void yajl_bind_free(yajl_bind b) {
+    yajl_bind *compiled;
+    size_t count, i, j;
+
+    if (!b) {
+        return;
+    }
+
+    /* b is the first of these */
+    compiled = b->compiled;
+    count = b->compiledCount;
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < compiled[i]->count; j++) {
+            yajl_gen_key_free(compiled[i]->slots[j].key);
+        }
+
+        YA_FREE(compiled[i]);
+    }
+
+    YA_FREE(compiled);
+}
+
+#define MEMBER(s, f, type) (*(const type *)((const uint8_t *)(s) + (f)->offset))
+
+/* generate a nested field's value, used by both the fast and generic paths
+ * since it always starts with a yajl_gen_XXX_open() call */
+static yajl_gen_status bind_gen_nested(yajl_gen g, const yajl_bind_slot *slot,
+                                       const void *s) {
+    const yajl_bind_field *f = slot->field;
+
+    if (f->type == yajl_bind_object) {
+        return yajl_gen_struct(g, slot->nested, (const uint8_t *)s + f->offset);
+    } else {
+        const void *items = MEMBER(s, f, void *);
+        const size_t count =
+            *(const size_t *)((const uint8_t *)s + f->countOffset);
+
+        if (!items && count) {
+            return yajl_gen_null(g);
+        }
+
+        return yajl_gen_struct_array(g, slot->nested, items, count);
+    }
+}
+
+/* generic path: the key and value go through the regular generator entry
+ * points, used when keys must be escaped differently than they were
+ * prepared */
+static yajl_gen_status bind_gen_field(yajl_gen g, const yajl_bind_slot *slot,
+                                      const void *s) {
+    const yajl_bind_field *f = slot->field;
+    yajl_gen_status stat = yajl_gen_string(g, f->name, strlen(f->name));
+
+    if (stat != yajl_gen_status_ok) {
+        return stat;
+    }
+
+    switch (f->type) {
+    case yajl_bind_int:
+        return yajl_gen_integer(g, MEMBER(s, f, int));
+    case yajl_bind_long_long:
+        return yajl_gen_integer(g, MEMBER(s, f, long long));
+    case yajl_bind_double: {
+        const double d = MEMBER(s, f, double);
+        if (isnan(d) || isinf(d)) {
+            return yajl_gen_null(g);
+        }
+
+        return yajl_gen_double(g, d);
+    }
+
+    case yajl_bind_bool:
+        return yajl_gen_bool(g, MEMBER(s, f, int));
+    case yajl_bind_cstring: {
+        const char *str = MEMBER(s, f, char *);
+        if (!str) {
+            return yajl_gen_null(g);
+        }
+
+        return yajl_gen_string(g, str, strlen(str));
+    }
+
+    case yajl_bind_object:
+    case yajl_bind_object_array:
+        return bind_gen_nested(g, slot, s);
+    }
+
+    return yajl_gen_in_error_state;
+}
+
+/* fast path: the prepared key (with its separator, indentation and ':')
+ * and the scalar value are appended straight to the output buffer, then
+ * the state at this depth is advanced by hand */
+static yajl_gen_status bind_append_field(yajl_gen g, const yajl_bind_slot *slot,
+                                         const void *s) {
+    const yajl_bind_field *f = slot->field;
+    char num[YAJL_NUMBER_BUF_SIZE];
+    yajl_gen_status stat;
+
+    if (f->type == yajl_bind_cstring && (g->flags & yajl_gen_validate_utf8)) {
+        const unsigned char *str = MEMBER(s, f, unsigned char *);
+        if (str && !yajl_string_validate_utf8(str, strlen((const char *)str))) {
+            return yajl_gen_invalid_string;
+        }
+    }
+
+    stat = yajl_gen_key(g, slot->key);
+    if (stat != yajl_gen_status_ok) {
+        return stat;
+    }
+
+    switch (f->type) {
+    case yajl_bind_int:
+        yajl_buf_append(&g->buf, num,
+                        yajl_format_integer(num, MEMBER(s, f, int)));
+        break;
+    case yajl_bind_long_long:
+        yajl_buf_append(&g->buf, num,
+                        yajl_format_integer(num, MEMBER(s, f, long long)));
+        break;
+    case yajl_bind_double: {
+        const double d = MEMBER(s, f, double);
+        if (isnan(d) || isinf(d)) {
+            yajl_buf_append(&g->buf, "null", 4);
+        } else {
+            yajl_buf_append(&g->buf, num, yajl_format_double(num, d));
+        }
+
+        break;
+    }
+
+    case yajl_bind_bool:
+        if (MEMBER(s, f, int)) {
+            yajl_buf_append(&g->buf, "true", 4);
+        } else {
+            yajl_buf_append(&g->buf, "false", 5);
+        }
+
+        break;
+    case yajl_bind_cstring: {
+        const unsigned char *str = MEMBER(s, f, unsigned char *);
+        if (!str) {
+            yajl_buf_append(&g->buf, "null", 4);
+            break;
+        }
+
+        yajl_buf_append(&g->buf, "\"", 1);
+        yajl_string_encode(&g->buf, str, strlen((const char *)str),
+                           g->flags & yajl_gen_escape_solidus);
+        yajl_buf_append(&g->buf, "\"", 1);
+        break;
+    }
+
+    case yajl_bind_object:
+    case yajl_bind_object_array:
+        /* nested values open with a yajl_gen_XXX_open(), which follows
+         * the prepared key's ':' without another separator */
+        return bind_gen_nested(g, slot, s);
+    }
+
+    *yajlDualStorageGetPtr(&g->statusAtDepth, g->depth) = yajl_gen_map_key;
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status yajl_gen_struct(yajl_gen g, yajl_bind b, const void *s) {
+    const int fast = !(b->hasSolidus && (g->flags & yajl_gen_escape_solidus));
+    yajl_gen_status stat;
+    size_t i;
+
+    stat = yajl_gen_map_open(g);
+    if (stat != yajl_gen_status_ok) {
+        return stat;
+    }
+
+    for (i = 0; i < b->count; i++) {
+        if (fast) {
+            stat = bind_append_field(g, &b->slots[i], s);
+        } else {
+            stat = bind_gen_field(g, &b->slots[i], s);
+        }
+
+        if (stat != yajl_gen_status_ok) {
+            return stat;
+        }
+    }
+
+    return yajl_gen_map_close(g);
+}
+
+yajl_gen_status yajl_gen_struct_array(yajl_gen g, yajl_bind b,
+                                      const void *array, size_t count) {
+    const uint8_t *elem = array;
+    yajl_gen_status stat;
+    size_t i;
+
+    stat = yajl_gen_array_open(g);
+    if (stat != yajl_gen_status_ok) {
+        return stat;
+    }
+
+    for (i = 0; i < count; i++) {
+        stat = yajl_gen_struct(g, b, elem);
+        if (stat != yajl_gen_status_ok) {
+            return stat;
+        }
+
+        elem += b->table->size;
+    }
+
+    return yajl_gen_array_close(g);
+}
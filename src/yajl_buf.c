@@ -44,6 +44,7 @@ static void yajl_buf_ensure_available(yajl_buf buf, size_t want) {
     if (need != buf->len) {
         buf->data = (unsigned char *)YA_REALLOC(buf->data, need);
         buf->len = need;
+        buf->grown++;
     }
 }
 
@@ -81,3 +82,14 @@ void yajl_buf_truncate(yajl_buf buf, size_t len) {
     assert(len <= buf->used);
     buf->used = len;
 }
+
+void yajl_buf_stats(yajl_buf buf, yajl_stats *stats) {
+    if (!buf->data) {
+        return;
+    }
+
+    stats->allocations++;
+    stats->peakBytes += buf->len;
+    stats->reallocs += buf->grown;
+    stats->bufferGrowths += buf->grown;
+}
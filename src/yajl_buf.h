@@ -39,6 +39,9 @@ typedef struct yajl_buf_t {
     uint8_t *data;
     size_t len;
     size_t used;
+    /* times 'data' was reallocated to grow, however many doublings each
+     * took */
+    size_t grown;
 } yajl_buf_t;
 
 typedef struct yajl_buf_t *yajl_buf;
@@ -61,4 +64,7 @@ size_t yajl_buf_len(yajl_buf buf);
 /* truncate the buffer */
 void yajl_buf_truncate(yajl_buf buf, size_t len);
 
+/* add the buffer's allocation, growth and size to 'stats' */
+void yajl_buf_stats(yajl_buf buf, yajl_stats *stats);
+
 #endif
@@ -24,6 +24,8 @@
 
 #include "api/yajl_common.h"
 
+#define YAJL_BS_INC 128
+
 typedef struct yajl_bytestack_t {
     uint8_t *stack;
     size_t size;
@@ -55,7 +57,7 @@ typedef struct yajl_bytestack_t {
 #define yajl_bs_push(obs, byte)                                                \
     {                                                                          \
         if ((obs).size == (obs).used) {                                        \
-            (obs).size *= 2;                                                   \
+            (obs).size = (obs).size ? (obs).size * 2 : YAJL_BS_INC;            \
             (obs).stack = YA_REALLOC((void *)(obs).stack, (obs).size);         \
         }                                                                      \
                                                                                \
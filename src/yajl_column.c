@@ -0,0 +1,563 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "api/yajl_column.h"
+#include "yajl_alloc.h"
+#include "yajl_buf.h"
+
+#include <limits.h>
+#include <string.h>
+
+/*
+ * Every column is a set of buffers which only ever grow at their end: the
+ * validity bitmap, the values (integers, doubles, the boolean bitmap or
+ * string offsets) and the bytes of strings.  A record appends to the
+ * columns it names as they come, and pads the rest with a null when it
+ * closes, so all columns are the same length between records.
+ *
+ * Records usually name their members in the same order, so the column
+ * after the last one matched is tried before the hash of the names.
+ */
+
+typedef struct {
+    char *name;
+    size_t nameLen;
+    yajl_column_type type;
+    /* the type was declared rather than inferred */
+    int declared;
+    /* rows so far, including one being added to */
+    size_t len;
+    size_t nulls;
+    yajl_buf_t validity;
+    yajl_buf_t values;
+    yajl_buf_t data;
+} column_t;
+
+struct yajl_columns_s {
+    column_t *columns;
+    size_t count;
+    size_t cap;
+    /* column numbers plus one by the hash of their name, zero for an
+     * empty slot */
+    size_t *index;
+    size_t indexCap;
+    /* columns were declared, anything else is skipped */
+    int fixed;
+    size_t rows;
+    /* where in the document the parse is */
+    int inArray;
+    int inRow;
+    /* the column the next value goes to, NULL if it is skipped */
+    column_t *current;
+    /* the column matched before it in this record, or count */
+    size_t last;
+    /* how deep the parse is in a value being skipped */
+    size_t skip;
+    const char *error;
+};
+
+yajl_columns yajl_columns_alloc(void) {
+    return YA_CALLOC(sizeof(struct yajl_columns_s));
+}
+
+void yajl_columns_free(yajl_columns c) {
+    size_t i;
+
+    if (c == NULL) {
+        return;
+    }
+
+    for (i = 0; i < c->count; i++) {
+        YA_FREE(c->columns[i].name);
+        yajl_buf_free(&c->columns[i].validity);
+        yajl_buf_free(&c->columns[i].values);
+        yajl_buf_free(&c->columns[i].data);
+    }
+
+    YA_FREE(c->columns);
+    YA_FREE(c->index);
+    YA_FREE(c);
+}
+
+static size_t name_hash(const unsigned char *s, size_t len) {
+    /* FNV-1a */
+    unsigned int h = 2166136261u;
+
+    while (len-- > 0) {
+        h = (h ^ *s++) * 16777619u;
+    }
+
+    return h;
+}
+
+static int name_is(const column_t *col, const unsigned char *s, size_t len) {
+    return col->nameLen == len && !memcmp(col->name, s, len);
+}
+
+static void index_put(yajl_columns c, size_t n) {
+    const column_t *col = c->columns + n;
+    const size_t mask = c->indexCap - 1;
+    size_t i = name_hash((const unsigned char *)col->name, col->nameLen) & mask;
+
+    while (c->index[i] != 0) {
+        i = (i + 1) & mask;
+    }
+
+    c->index[i] = n + 1;
+}
+
+static column_t *column_find(yajl_columns c, const unsigned char *s,
+                             size_t len) {
+    size_t i, n;
+
+    if (c->last + 1 < c->count && name_is(c->columns + c->last + 1, s, len)) {
+        c->last++;
+        return c->columns + c->last;
+    }
+
+    if (c->count == 0) {
+        return NULL;
+    }
+
+    for (i = name_hash(s, len) & (c->indexCap - 1); (n = c->index[i]) != 0;
+         i = (i + 1) & (c->indexCap - 1)) {
+        if (name_is(c->columns + n - 1, s, len)) {
+            c->last = n - 1;
+            return c->columns + c->last;
+        }
+    }
+
+    return NULL;
+}
+
+/* append bit 'i' of a bitmap */
+static void bit_push(yajl_buf_t *buf, size_t i, int set) {
+    if (i % 8 == 0) {
+        static const unsigned char zero = 0;
+        yajl_buf_append(buf, &zero, 1);
+    }
+
+    if (set) {
+        buf->data[i / 8] |= (unsigned char)(1u << (i % 8));
+    }
+}
+
+/* append the value a null has in the values of a 'type' column */
+static void values_null(column_t *col, size_t row) {
+    static const unsigned char zeros[8] = {0};
+    long long offset;
+
+    switch (col->type) {
+        case yajl_column_int64:
+        case yajl_column_double:
+            yajl_buf_append(&col->values, zeros, 8);
+            break;
+        case yajl_column_bool:
+            bit_push(&col->values, row, 0);
+            break;
+        case yajl_column_string:
+            offset = (long long)yajl_buf_len(&col->data);
+            yajl_buf_append(&col->values, &offset, sizeof(offset));
+            break;
+        case yajl_column_null:
+            break;
+    }
+}
+
+/* give a column its type, with the values of the nulls before it */
+static void column_set_type(column_t *col, yajl_column_type type) {
+    size_t i;
+
+    col->type = type;
+    if (type == yajl_column_string) {
+        static const long long zero = 0;
+        yajl_buf_append(&col->values, &zero, sizeof(zero));
+    }
+
+    for (i = 0; i < col->len; i++) {
+        values_null(col, i);
+    }
+}
+
+static column_t *column_add(yajl_columns c, const unsigned char *name,
+                            size_t len, yajl_column_type type) {
+    column_t *col;
+
+    if (c->count == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 16;
+        c->columns = YA_REALLOC(c->columns, c->cap * sizeof(column_t));
+    }
+
+    /* keep the index at most half full */
+    if (2 * (c->count + 1) > c->indexCap) {
+        size_t i;
+
+        YA_FREE(c->index);
+        c->indexCap = c->indexCap ? c->indexCap * 2 : 32;
+        c->index = YA_CALLOC(c->indexCap * sizeof(size_t));
+        for (i = 0; i < c->count; i++) {
+            index_put(c, i);
+        }
+    }
+
+    col = c->columns + c->count;
+    memset(col, 0, sizeof(*col));
+    col->name = YA_CALLOC(len + 1);
+    memcpy(col->name, name, len);
+    col->nameLen = len;
+    col->declared = type != yajl_column_null;
+    column_set_type(col, type);
+    index_put(c, c->count);
+    c->last = c->count;
+    return c->columns + c->count++;
+}
+
+/* pad a column with nulls up to 'rows' */
+static void column_pad(column_t *col, size_t rows) {
+    while (col->len < rows) {
+        bit_push(&col->validity, col->len, 0);
+        values_null(col, col->len);
+        col->len++;
+        col->nulls++;
+    }
+}
+
+int yajl_columns_declare(yajl_columns c, const char *name,
+                         yajl_column_type type) {
+    const size_t len = strlen(name);
+
+    if (c->rows > 0 || c->inRow) {
+        return 0;
+    }
+
+    c->last = c->count;
+    if (column_find(c, (const unsigned char *)name, len) != NULL) {
+        return 0;
+    }
+
+    column_add(c, (const unsigned char *)name, len, type);
+    c->fixed = 1;
+    return 1;
+}
+
+static int fail(yajl_columns c, const char *error) {
+    c->error = error;
+    return 0;
+}
+
+/* the column the current value goes to, of a type which can take 'type',
+ * with the value marked valid.  NULL with the error set if it can't, or
+ * with no error if the value is skipped. */
+static column_t *column_for(yajl_columns c, yajl_column_type type) {
+    column_t *col = c->current;
+
+    if (!c->inRow) {
+        fail(c, "record is not an object");
+        return NULL;
+    }
+
+    if (col == NULL) {
+        return NULL;
+    }
+
+    if (col->type != type) {
+        if (col->type == yajl_column_null) {
+            column_set_type(col, type);
+        } else if (col->type == yajl_column_int64 &&
+                   type == yajl_column_double && !col->declared) {
+            /* every value so far becomes a double, in place */
+            long long *v = (long long *)col->values.data;
+            size_t i;
+
+            for (i = 0; i < col->len; i++) {
+                double d = (double)v[i];
+                memcpy(v + i, &d, sizeof(d));
+            }
+
+            col->type = yajl_column_double;
+        } else if (!(col->type == yajl_column_double &&
+                     type == yajl_column_int64)) {
+            fail(c, "value does not match the type of its column");
+            return NULL;
+        }
+    }
+
+    bit_push(&col->validity, col->len, 1);
+    c->current = NULL;
+    return col;
+}
+
+#define VALUE_CHK(c)                                                           \
+    if (c->skip > 0) {                                                         \
+        return 1;                                                              \
+    }
+
+static int columns_null(void *ctx) {
+    yajl_columns c = ctx;
+
+    VALUE_CHK(c);
+    if (!c->inRow) {
+        return fail(c, "record is not an object");
+    }
+
+    c->current = NULL;
+    return 1;
+}
+
+static int columns_boolean(void *ctx, int boolean) {
+    yajl_columns c = ctx;
+    column_t *col;
+
+    VALUE_CHK(c);
+    if ((col = column_for(c, yajl_column_bool)) == NULL) {
+        return c->error == NULL;
+    }
+
+    bit_push(&col->values, col->len++, boolean);
+    return 1;
+}
+
+static int columns_double(void *ctx, double d) {
+    yajl_columns c = ctx;
+    column_t *col;
+
+    VALUE_CHK(c);
+    if ((col = column_for(c, yajl_column_double)) == NULL) {
+        return c->error == NULL;
+    }
+
+    yajl_buf_append(&col->values, &d, sizeof(d));
+    col->len++;
+    return 1;
+}
+
+static int columns_integer(void *ctx, long long i) {
+    yajl_columns c = ctx;
+    column_t *col;
+
+    VALUE_CHK(c);
+    if ((col = column_for(c, yajl_column_int64)) == NULL) {
+        return c->error == NULL;
+    }
+
+    if (col->type == yajl_column_double) {
+        double d = (double)i;
+        yajl_buf_append(&col->values, &d, sizeof(d));
+    } else {
+        yajl_buf_append(&col->values, &i, sizeof(i));
+    }
+
+    col->len++;
+    return 1;
+}
+
+/* only those above LLONG_MAX, which no integer column can hold */
+static int columns_unsigned(void *ctx, unsigned long long u) {
+    return columns_double(ctx, (double)u);
+}
+
+static int columns_string(void *ctx, const unsigned char *s, size_t len) {
+    yajl_columns c = ctx;
+    column_t *col;
+    long long offset;
+
+    VALUE_CHK(c);
+    if ((col = column_for(c, yajl_column_string)) == NULL) {
+        return c->error == NULL;
+    }
+
+    yajl_buf_append(&col->data, s, len);
+    offset = (long long)yajl_buf_len(&col->data);
+    yajl_buf_append(&col->values, &offset, sizeof(offset));
+    col->len++;
+    return 1;
+}
+
+static int columns_map_key(void *ctx, const unsigned char *s, size_t len) {
+    yajl_columns c = ctx;
+    column_t *col;
+
+    VALUE_CHK(c);
+    col = column_find(c, s, len);
+    if (col == NULL && !c->fixed) {
+        col = column_add(c, s, len, yajl_column_null);
+        column_pad(col, c->rows);
+    }
+
+    if (col != NULL && col->len > c->rows) {
+        return fail(c, "member given twice in one record");
+    }
+
+    c->current = col;
+    return 1;
+}
+
+/* a map or array opening where a value goes, which is only allowed when
+ * it is skipped */
+static int columns_nested(yajl_columns c) {
+    if (c->current != NULL) {
+        return fail(c, "nested value in a column");
+    }
+
+    c->skip = 1;
+    return 1;
+}
+
+static int columns_start_map(void *ctx) {
+    yajl_columns c = ctx;
+
+    if (c->skip > 0) {
+        c->skip++;
+        return 1;
+    } else if (c->inRow) {
+        return columns_nested(c);
+    }
+
+    c->inRow = 1;
+    c->current = NULL;
+    c->last = c->count;
+    return 1;
+}
+
+static int columns_end_map(void *ctx) {
+    yajl_columns c = ctx;
+    size_t i;
+
+    if (c->skip > 0) {
+        c->skip--;
+        return 1;
+    }
+
+    for (i = 0; i < c->count; i++) {
+        column_pad(c->columns + i, c->rows + 1);
+    }
+
+    c->rows++;
+    c->inRow = 0;
+    return 1;
+}
+
+static int columns_start_array(void *ctx) {
+    yajl_columns c = ctx;
+
+    if (c->skip > 0) {
+        c->skip++;
+        return 1;
+    } else if (c->inRow) {
+        return columns_nested(c);
+    } else if (c->inArray) {
+        return fail(c, "record is not an object");
+    }
+
+    c->inArray = 1;
+    return 1;
+}
+
+static int columns_end_array(void *ctx) {
+    yajl_columns c = ctx;
+
+    if (c->skip > 0) {
+        c->skip--;
+        return 1;
+    }
+
+    c->inArray = 0;
+    return 1;
+}
+
+static const yajl_callbacks columns_callbacks = {
+    /* null        = */ columns_null,
+    /* boolean     = */ columns_boolean,
+    /* integer     = */ columns_integer,
+    /* double      = */ columns_double,
+    /* number      = */ NULL,
+    /* string      = */ columns_string,
+    /* start map   = */ columns_start_map,
+    /* map key     = */ columns_map_key,
+    /* end map     = */ columns_end_map,
+    /* start array = */ columns_start_array,
+    /* end array   = */ columns_end_array,
+    /* unsigned    = */ columns_unsigned};
+
+const yajl_callbacks *yajl_columns_callbacks(yajl_columns c) {
+    (void)c;
+    return &columns_callbacks;
+}
+
+size_t yajl_columns_rows(yajl_columns c) {
+    return c->rows;
+}
+
+size_t yajl_columns_count(yajl_columns c) {
+    return c->count;
+}
+
+void yajl_columns_get(yajl_columns c, size_t i, yajl_column *column) {
+    const column_t *col = c->columns + i;
+    const void *values = col->values.data;
+
+    memset(column, 0, sizeof(*column));
+    column->name = col->name;
+    column->nameLen = col->nameLen;
+    column->type = col->type;
+    column->length = c->rows;
+    column->nulls = col->nulls;
+    column->validity = col->validity.data;
+
+    switch (col->type) {
+        case yajl_column_int64:
+            column->integers = values;
+            break;
+        case yajl_column_double:
+            column->doubles = values;
+            break;
+        case yajl_column_bool:
+            column->booleans = values;
+            break;
+        case yajl_column_string:
+            column->offsets = values;
+            column->data = (const char *)col->data.data;
+            break;
+        case yajl_column_null:
+            break;
+    }
+}
+
+void yajl_columns_clear(yajl_columns c) {
+    size_t i;
+
+    for (i = 0; i < c->count; i++) {
+        column_t *col = c->columns + i;
+
+        yajl_buf_clear(&col->validity);
+        yajl_buf_clear(&col->values);
+        yajl_buf_clear(&col->data);
+        col->len = 0;
+        col->nulls = 0;
+        column_set_type(col, col->type);
+    }
+
+    c->rows = 0;
+    c->inArray = 0;
+    c->inRow = 0;
+    c->current = NULL;
+    c->skip = 0;
+    c->error = NULL;
+}
+
+const char *yajl_columns_error(yajl_columns c) {
+    return c->error;
+}
@@ -15,8 +15,10 @@
  */
 
 #include "yajl_encode.h"
+#include "yajl_trace.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -93,6 +95,88 @@ void yajl_string_encode(void *ctx, const unsigned char *str, size_t len,
     yajl_buf_append(ctx, (const char *)(str + beg), end - beg);
 }
 
+/* a high bit set in each byte of the word 'x' that is less than 'n' (for
+ * n <= 128), or equal to 'b' */
+#define ONES (~(uint64_t)0 / 255)
+#define HAS_LESS(x, n) (((x) - ONES * (n)) & ~(x) & ONES * 128)
+#define HAS_BYTE(x, b) HAS_LESS((x) ^ (ONES * (b)), 1)
+
+size_t yajl_string_clean_prefix(const unsigned char *str, size_t len,
+                                int escape_solidus) {
+    size_t i = 0;
+
+    /* skip whole words which hold nothing to escape */
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, str + i, 8);
+        if (HAS_LESS(w, 0x20) || HAS_BYTE(w, '"') || HAS_BYTE(w, '\\') ||
+            (escape_solidus && HAS_BYTE(w, '/'))) {
+            break;
+        }
+    }
+
+    for (; i < len; i++) {
+        const unsigned char c = str[i];
+        if (c < 0x20 || c == '"' || c == '\\' || (escape_solidus && c == '/')) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+size_t yajl_format_integer(char *buf, long long number) {
+    /* digits are produced back to front, two at a time */
+    static const char digitPairs[201] = "00010203040506070809"
+                                        "10111213141516171819"
+                                        "20212223242526272829"
+                                        "30313233343536373839"
+                                        "40414243444546474849"
+                                        "50515253545556575859"
+                                        "60616263646566676869"
+                                        "70717273747576777879"
+                                        "80818283848586878889"
+                                        "90919293949596979899";
+    char tmp[YAJL_NUMBER_BUF_SIZE];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+    unsigned long long v = number < 0 ? -(unsigned long long)number
+                                      : (unsigned long long)number;
+
+    while (v >= 100) {
+        const unsigned int pair = (unsigned int)(v % 100) * 2;
+        v /= 100;
+        *--p = digitPairs[pair + 1];
+        *--p = digitPairs[pair];
+    }
+
+    if (v >= 10) {
+        *--p = digitPairs[v * 2 + 1];
+        *--p = digitPairs[v * 2];
+    } else {
+        *--p = (char)('0' + v);
+    }
+
+    if (number < 0) {
+        *--p = '-';
+    }
+
+    memcpy(buf, p, end - p);
+    return end - p;
+}
+
+size_t yajl_format_double(char *buf, double number) {
+    size_t len = snprintf(buf, YAJL_NUMBER_BUF_SIZE, "%.20g", number);
+
+    /* make sure a double always reads back as a double */
+    if (strspn(buf, "0123456789-") == len) {
+        memcpy(buf + len, ".0", 2);
+        len += 2;
+    }
+
+    return len;
+}
+
 static void hexToDigit(unsigned int *val, const unsigned char *hex) {
     unsigned int i;
     for (i = 0; i < 4; i++) {
@@ -136,6 +220,8 @@ void yajl_string_decode(yajl_buf buf, const unsigned char *str, size_t len) {
     size_t beg = 0;
     size_t end = 0;
 
+    YAJL_PROBE1(decode__entry, len);
+
     while (end < len) {
         if (str[end] == '\\') {
             char utf8Buf[5];
@@ -210,6 +296,7 @@ void yajl_string_decode(yajl_buf buf, const unsigned char *str, size_t len) {
     }
 
     yajl_buf_append(buf, str + beg, end - beg);
+    YAJL_PROBE1(decode__return, yajl_buf_len(buf));
 }
 
 #define ADV_PTR                                                                \
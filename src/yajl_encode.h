@@ -23,8 +23,20 @@
 void yajl_string_encode(void *ctx, const unsigned char *str, size_t length,
                         int escape_solidus);
 
+/* the length of the leading run of 'str' which yajl_string_encode() would
+ * copy through unchanged */
+size_t yajl_string_clean_prefix(const unsigned char *str, size_t length,
+                                int escape_solidus);
+
 void yajl_string_decode(yajl_buf buf, const unsigned char *str, size_t length);
 
 int yajl_string_validate_utf8(const unsigned char *s, size_t len);
 
+/* format numbers exactly as the generator emits them.  'buf' must have room
+ * for YAJL_NUMBER_BUF_SIZE bytes; the return value is the number of bytes
+ * written (no null terminator is counted). */
+#define YAJL_NUMBER_BUF_SIZE 32
+size_t yajl_format_integer(char *buf, long long number);
+size_t yajl_format_double(char *buf, double number);
+
 #endif
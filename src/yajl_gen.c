@@ -15,11 +15,14 @@
  */
 
 #include "api/yajl_gen.h"
+#include "api/yajl_parse.h"
 #include "dualBox.h"
 #include "yajl_buf.h"
 #include "yajl_encode.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -27,8 +30,71 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(_WIN32) || defined(WIN32)
+#include <io.h>
+#define GEN_NO_WRITEV 1
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#endif
+
 static const char *indentString = "    ";
 
+/* one piece of the output in zero-copy mode */
+typedef struct yajl_gen_segment {
+    /* caller memory referenced in place, or NULL for a run of the internal
+     * buffer starting at 'offset' (an offset survives the buffer moving) */
+    const uint8_t *external;
+    size_t offset;
+    size_t len;
+} yajl_gen_segment;
+
+struct yajl_gen_sink_t {
+    /* output goes to 'print' if set, else to 'fd' if it's not -1 */
+    yajl_print_t print;
+    void *ctx;
+    int fd;
+    size_t highWater;
+    /* clean string runs at least this long are referenced rather than
+     * copied, 0 when zero-copy mode is off */
+    size_t zeroCopy;
+    /* the output so far is 'segments' followed by the internal buffer
+     * from 'mark' on.  'iov' has room for one more entry than 'segments',
+     * and 'whole' stands in for it while there are no segments. */
+    yajl_gen_segment *segments;
+    yajl_gen_iovec *iov;
+    yajl_gen_iovec whole;
+    size_t segmentCount;
+    size_t segmentCap;
+    size_t mark;
+    /* number of bytes referenced in caller memory */
+    size_t external;
+};
+
+static struct yajl_gen_sink_t *yajl_gen_sink_get(yajl_gen g) {
+    if (!g->sink) {
+        g->sink = YA_CALLOC(sizeof(*g->sink));
+        if (g->sink) {
+            g->sink->fd = -1;
+            g->sink->highWater = YAJL_GEN_FLUSH_THRESHOLD;
+        }
+    }
+
+    return g->sink;
+}
+
+static void yajl_gen_sink_free(struct yajl_gen_sink_t *sink) {
+    if (sink) {
+        YA_FREE(sink->segments);
+        YA_FREE(sink->iov);
+        YA_FREE(sink);
+    }
+}
+
 void yajl_gen_pretty_enable(yajl_gen g) {
     g->flags |= yajl_gen_beautify;
 }
@@ -63,6 +129,59 @@ int yajl_gen_config(yajl_gen g, yajl_gen_option opt, ...) {
         break;
     }
 
+    /* output pending for the old sink goes to it before switching */
+    case yajl_gen_print_callback: {
+        struct yajl_gen_sink_t *sink = yajl_gen_sink_get(g);
+        yajl_print_t print = va_arg(ap, yajl_print_t);
+        void *ctx = va_arg(ap, void *);
+        if (sink && yajl_gen_flush(g) == yajl_gen_status_ok) {
+            sink->print = print;
+            sink->ctx = ctx;
+            sink->fd = -1;
+        } else {
+            rv = 0;
+        }
+
+        break;
+    }
+
+    case yajl_gen_output_fd: {
+        struct yajl_gen_sink_t *sink = yajl_gen_sink_get(g);
+        const int fd = va_arg(ap, int);
+        if (sink && yajl_gen_flush(g) == yajl_gen_status_ok) {
+            sink->print = NULL;
+            sink->fd = fd;
+        } else {
+            rv = 0;
+        }
+
+        break;
+    }
+
+    case yajl_gen_zero_copy_threshold: {
+        struct yajl_gen_sink_t *sink = yajl_gen_sink_get(g);
+        const size_t zeroCopy = va_arg(ap, size_t);
+        if (sink) {
+            sink->zeroCopy = zeroCopy;
+        } else {
+            rv = 0;
+        }
+
+        break;
+    }
+
+    case yajl_gen_flush_threshold: {
+        struct yajl_gen_sink_t *sink = yajl_gen_sink_get(g);
+        const size_t highWater = va_arg(ap, size_t);
+        if (sink) {
+            sink->highWater = highWater;
+        } else {
+            rv = 0;
+        }
+
+        break;
+    }
+
     default:
         rv = 0;
     }
@@ -74,6 +193,8 @@ int yajl_gen_config(yajl_gen g, yajl_gen_option opt, ...) {
 
 void yajl_gen_deinit(yajl_gen g) {
     yajlDualStorageReset(&g->statusAtDepth);
+    yajl_gen_sink_free(g->sink);
+    g->sink = NULL;
 }
 
 void yajl_gen_free_buffer(yajl_gen g) {
@@ -102,6 +223,7 @@ void yajl_gen_reset(yajl_gen g, const char *sep) {
 
 void yajl_gen_free(yajl_gen g) {
     yajl_buf_free(&g->buf);
+    yajl_gen_sink_free(g->sink);
     YA_FREE(g);
 }
 
@@ -124,8 +246,9 @@ void yajl_gen_free(yajl_gen g) {
 
 #define INSERT_WHITESPACE                                                      \
     if ((g->flags & yajl_gen_beautify)) {                                      \
-        if (yajlDualStorageGet(&g->statusAtDepth, g->depth) !=                 \
-            yajl_gen_map_val) {                                                \
+        const yajl_gen_state _current =                                        \
+            yajlDualStorageGet(&g->statusAtDepth, g->depth);                   \
+        if (_current != yajl_gen_map_val && _current != yajl_gen_map_colon) {  \
             unsigned int _i;                                                   \
             for (_i = 0; _i < g->depth; _i++)                                  \
                 yajl_buf_append(&g->buf, indentString,                         \
@@ -185,6 +308,7 @@ void yajl_gen_free(yajl_gen g) {
             *current = yajl_gen_in_array;                                      \
             break;                                                             \
         case yajl_gen_map_val:                                                 \
+        case yajl_gen_map_colon:                                               \
             *current = yajl_gen_map_key;                                       \
             break;                                                             \
         default:                                                               \
@@ -201,17 +325,142 @@ void yajl_gen_free(yajl_gen g) {
         }                                                                      \
     } while (0)
 
+static int yajl_gen_sink_active(const struct yajl_gen_sink_t *sink) {
+    return sink && (sink->print || sink->fd != -1);
+}
+
+/* in sink mode, pass the output on once the high-water mark is reached, a
+ * whole value has been generated, or caller memory was referenced (which
+ * then only has to stay valid for the duration of the call) */
+#define FLUSH_SINK                                                             \
+    do {                                                                       \
+        if (g->sink &&                                                         \
+            (yajl_buf_len(&g->buf) >= g->sink->highWater ||                    \
+             g->sink->external ||                                              \
+             yajlDualStorageGet(&g->statusAtDepth, g->depth) ==                \
+                 yajl_gen_complete)) {                                         \
+            return yajl_gen_flush(g);                                          \
+        }                                                                      \
+    } while (0)
+
+static int yajl_gen_chain_push(struct yajl_gen_sink_t *s, const uint8_t *ext,
+                               size_t offset, size_t len) {
+    if (s->segmentCount == s->segmentCap) {
+        const size_t cap = s->segmentCap ? s->segmentCap * 2 : 16;
+        yajl_gen_segment *segments =
+            YA_REALLOC(s->segments, cap * sizeof(*segments));
+        yajl_gen_iovec *iov;
+
+        if (!segments) {
+            return 0;
+        }
+
+        s->segments = segments;
+        iov = YA_REALLOC(s->iov, (cap + 1) * sizeof(*iov));
+        if (!iov) {
+            return 0;
+        }
+
+        s->iov = iov;
+        s->segmentCap = cap;
+    }
+
+    s->segments[s->segmentCount++] = (yajl_gen_segment){ext, offset, len};
+    return 1;
+}
+
+/* end the current run of the internal buffer */
+static int yajl_gen_chain_close(yajl_gen g) {
+    struct yajl_gen_sink_t *s = g->sink;
+    const size_t used = yajl_buf_len(&g->buf);
+
+    if (used > s->mark) {
+        if (!yajl_gen_chain_push(s, NULL, s->mark, used - s->mark)) {
+            return 0;
+        }
+
+        s->mark = used;
+    }
+
+    return 1;
+}
+
+/* append 'len' bytes of caller memory to the output without copying them,
+ * falling back to a copy if the chain can't grow */
+static void yajl_gen_reference(yajl_gen g, const uint8_t *p, size_t len) {
+    if (yajl_gen_chain_close(g) &&
+        yajl_gen_chain_push(g->sink, p, 0, len)) {
+        g->sink->external += len;
+    } else {
+        yajl_buf_append(&g->buf, p, len);
+    }
+}
+
+/* yajl_string_encode(), with long clean runs referenced in place */
+static void yajl_gen_encode_zero_copy(yajl_gen g, const uint8_t *str,
+                                      size_t len) {
+    const int escapeSolidus = g->flags & yajl_gen_escape_solidus;
+
+    while (len) {
+        const size_t run = yajl_string_clean_prefix(str, len, escapeSolidus);
+        if (run >= g->sink->zeroCopy) {
+            yajl_gen_reference(g, str, run);
+        } else {
+            yajl_buf_append(&g->buf, str, run);
+        }
+
+        str += run;
+        len -= run;
+        if (len) {
+            yajl_string_encode(&g->buf, str, 1, escapeSolidus);
+            str++;
+            len--;
+        }
+    }
+}
+
+/* the iovecs for everything generated since the last clear */
+static yajl_gen_iovec *yajl_gen_chain_iov(yajl_gen g, size_t *count) {
+    struct yajl_gen_sink_t *s = g->sink;
+    yajl_gen_iovec *iov = s->segmentCount ? s->iov : &s->whole;
+    const size_t used = yajl_buf_len(&g->buf);
+    size_t n;
+
+    for (n = 0; n < s->segmentCount; n++) {
+        const yajl_gen_segment *seg = &s->segments[n];
+        iov[n].base = (void *)(seg->external ? seg->external
+                                             : g->buf.data + seg->offset);
+        iov[n].len = seg->len;
+    }
+
+    if (used > s->mark) {
+        iov[n].base = g->buf.data + s->mark;
+        iov[n].len = used - s->mark;
+        n++;
+    }
+
+    *count = n;
+    return iov;
+}
+
+static void yajl_gen_chain_clear(yajl_gen g) {
+    if (g->sink) {
+        g->sink->segmentCount = 0;
+        g->sink->mark = 0;
+        g->sink->external = 0;
+    }
+}
+
 yajl_gen_status yajl_gen_integer(yajl_gen g, long long int number) {
-    char i[32];
+    char i[YAJL_NUMBER_BUF_SIZE];
     ENSURE_VALID_STATE;
     ENSURE_NOT_KEY;
     INSERT_SEP;
     INSERT_WHITESPACE;
-    /* TODO: replace snprintf with StrInt64ToBuf */
-    const size_t wroteLen = snprintf(i, sizeof(i), "%lld", number);
-    yajl_buf_append(&g->buf, i, wroteLen);
+    yajl_buf_append(&g->buf, i, yajl_format_integer(i, number));
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -222,7 +471,7 @@ yajl_gen_status yajl_gen_integer(yajl_gen g, long long int number) {
 #endif
 
 yajl_gen_status yajl_gen_double(yajl_gen g, double number) {
-    char i[32];
+    char i[YAJL_NUMBER_BUF_SIZE];
     ENSURE_VALID_STATE;
     ENSURE_NOT_KEY;
     if (isnan(number) || isinf(number)) {
@@ -231,14 +480,10 @@ yajl_gen_status yajl_gen_double(yajl_gen g, double number) {
 
     INSERT_SEP;
     INSERT_WHITESPACE;
-    const size_t wroteLen = snprintf(i, sizeof(i), "%.20g", number);
-    if (strspn(i, "0123456789-") == wroteLen) {
-        strcat(i, ".0");
-    }
-
-    yajl_buf_append(&g->buf, i, wroteLen);
+    yajl_buf_append(&g->buf, i, yajl_format_double(i, number));
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -251,6 +496,7 @@ yajl_gen_status yajl_gen_number(yajl_gen g, const void *s_, size_t l) {
     yajl_buf_append(&g->buf, s, l);
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -270,10 +516,17 @@ yajl_gen_status yajl_gen_string(yajl_gen g, const void *str_, size_t len) {
     INSERT_SEP;
     INSERT_WHITESPACE;
     yajl_buf_append(&g->buf, "\"", 1);
-    yajl_string_encode(&g->buf, str, len, g->flags & yajl_gen_escape_solidus);
+    if (g->sink && g->sink->zeroCopy && len >= g->sink->zeroCopy) {
+        yajl_gen_encode_zero_copy(g, str, len);
+    } else {
+        yajl_string_encode(&g->buf, str, len,
+                           g->flags & yajl_gen_escape_solidus);
+    }
+
     yajl_buf_append(&g->buf, "\"", 1);
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -285,6 +538,7 @@ yajl_gen_status yajl_gen_null(yajl_gen g) {
     yajl_buf_append(&g->buf, "null", strlen("null"));
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -298,6 +552,7 @@ yajl_gen_status yajl_gen_bool(yajl_gen g, int boolean) {
     yajl_buf_append(&g->buf, val, (unsigned int)strlen(val));
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -315,6 +570,7 @@ yajl_gen_status yajl_gen_map_open(yajl_gen g) {
     }
 
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -330,6 +586,7 @@ yajl_gen_status yajl_gen_map_close(yajl_gen g) {
     INSERT_WHITESPACE;
     yajl_buf_append(&g->buf, "}", 1);
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -346,6 +603,7 @@ yajl_gen_status yajl_gen_array_open(yajl_gen g) {
     }
 
     FINAL_NEWLINE;
+    FLUSH_SINK;
     return yajl_gen_status_ok;
 }
 
@@ -360,15 +618,271 @@ yajl_gen_status yajl_gen_array_close(yajl_gen g) {
     INSERT_WHITESPACE;
     yajl_buf_append(&g->buf, "]", 1);
     FINAL_NEWLINE;
+    FLUSH_SINK;
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status yajl_gen_raw_value(yajl_gen g, const void *json, size_t len) {
+    ENSURE_VALID_STATE;
+    ENSURE_NOT_KEY;
+    if (len == 0) {
+        return yajl_gen_invalid_value;
+    }
+
+    INSERT_SEP;
+    INSERT_WHITESPACE;
+    if (g->sink && g->sink->zeroCopy && len >= g->sink->zeroCopy) {
+        yajl_gen_reference(g, json, len);
+    } else {
+        yajl_buf_append(&g->buf, json, len);
+    }
+
+    APPENDED_ATOM;
+    FINAL_NEWLINE;
+    FLUSH_SINK;
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status yajl_gen_raw_value_validate(yajl_gen g, const void *json,
+                                            size_t len) {
+    if (yajl_validate(json, len, 0, NULL) != yajl_status_ok) {
+        return yajl_gen_invalid_value;
+    }
+
+    return yajl_gen_raw_value(g, json, len);
+}
+
+/* a prepared key is never written to after it is made, so one key can
+ * be used from any number of generators and threads */
+struct yajl_gen_key_t {
+    /* compact rendering: ,"key": */
+    size_t compactLen;
+    uint8_t compact[];
+};
+
+yajl_gen_prepared_key yajl_gen_key_prepare(yajl_gen g, const void *key,
+                                           size_t len) {
+    const uint8_t flags = g ? g->flags : 0;
+    yajl_buf_t quoted = {0};
+    yajl_gen_prepared_key k;
+
+    if ((flags & yajl_gen_validate_utf8) &&
+        !yajl_string_validate_utf8(key, len)) {
+        return NULL;
+    }
+
+    yajl_buf_append(&quoted, ",\"", 2);
+    yajl_string_encode(&quoted, key, len, flags & yajl_gen_escape_solidus);
+    yajl_buf_append(&quoted, "\":", 2);
+
+    k = YA_CALLOC(sizeof(*k) + yajl_buf_len(&quoted));
+    if (k) {
+        k->compactLen = yajl_buf_len(&quoted);
+        memcpy(k->compact, yajl_buf_data(&quoted), k->compactLen);
+    }
+
+    yajl_buf_free(&quoted);
+    return k;
+}
+
+void yajl_gen_key_free(yajl_gen_prepared_key k) {
+    if (k) {
+        YA_FREE(k);
+    }
+}
+
+/* ,\n<indent x depth>"key":<space>, without the ,\n for the first key */
+static void yajl_gen_key_beautify(yajl_gen g, yajl_gen_prepared_key k,
+                                  int first) {
+    const size_t indentLen = strlen(indentString);
+    unsigned int i;
+
+    if (!first) {
+        yajl_buf_append(&g->buf, ",\n", 2);
+    }
+
+    for (i = 0; i < g->depth; i++) {
+        yajl_buf_append(&g->buf, indentString, indentLen);
+    }
+
+    /* the quoted key plus ':' sits between the compact rendering's
+     * leading comma and the end */
+    yajl_buf_append(&g->buf, k->compact + 1, k->compactLen - 1);
+    yajl_buf_append(&g->buf, " ", 1);
+}
+
+yajl_gen_status yajl_gen_key(yajl_gen g, yajl_gen_prepared_key k) {
+    yajl_gen_state *current;
+
+    ENSURE_VALID_STATE;
+    current = yajlDualStorageGetPtr(&g->statusAtDepth, g->depth);
+    if (*current == yajl_gen_map_start || *current == yajl_gen_map_key) {
+        /* the first key of a map gets no ",\n" (or ",") */
+        if (g->flags & yajl_gen_beautify) {
+            yajl_gen_key_beautify(g, k, *current == yajl_gen_map_start);
+        } else {
+            const size_t skip = *current == yajl_gen_map_start ? 1 : 0;
+            yajl_buf_append(&g->buf, k->compact + skip, k->compactLen - skip);
+        }
+
+        *current = yajl_gen_map_colon;
+        return yajl_gen_status_ok;
+    }
+
+    /* not in key position, generate it as a string value */
+    INSERT_SEP;
+    INSERT_WHITESPACE;
+    yajl_buf_append(&g->buf, k->compact + 1, k->compactLen - 2);
+    APPENDED_ATOM;
+    FINAL_NEWLINE;
+    FLUSH_SINK;
+    return yajl_gen_status_ok;
+}
+
+/* write out all of 'iov', picking up after short writes */
+#ifndef GEN_NO_WRITEV
+
+/* the vector is handed to writev() as it is */
+_Static_assert(sizeof(yajl_gen_iovec) == sizeof(struct iovec) &&
+                   offsetof(yajl_gen_iovec, base) ==
+                       offsetof(struct iovec, iov_base) &&
+                   offsetof(yajl_gen_iovec, len) ==
+                       offsetof(struct iovec, iov_len),
+               "yajl_gen_iovec doesn't match struct iovec");
+
+static int yajl_gen_writev_all(int fd, yajl_gen_iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, (const struct iovec *)iov,
+                           count > IOV_MAX ? IOV_MAX : count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return 0;
+        }
+
+        for (; count > 0 && (size_t)n >= iov->len; iov++, count--) {
+            n -= iov->len;
+        }
+
+        if (count > 0) {
+            iov->base = (uint8_t *)iov->base + n;
+            iov->len -= n;
+        }
+    }
+
+    return 1;
+}
+
+#else
+
+/* no writev() here, so the pieces are written one at a time */
+static int yajl_gen_writev_all(int fd, yajl_gen_iovec *iov, int count) {
+    for (; count > 0; iov++, count--) {
+        const uint8_t *p = iov->base;
+        size_t left = iov->len;
+
+        while (left > 0) {
+            const int n =
+                _write(fd, p, left > INT_MAX ? INT_MAX : (unsigned int)left);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                return 0;
+            }
+
+            p += n;
+            left -= n;
+        }
+    }
+
+    return 1;
+}
+
+#endif
+
+yajl_gen_status yajl_gen_flush(yajl_gen g) {
+    struct yajl_gen_sink_t *sink = g->sink;
+    yajl_gen_iovec *iov;
+    size_t count;
+    size_t i;
+
+    if (!yajl_gen_sink_active(sink) ||
+        (!yajl_buf_len(&g->buf) && !sink->segmentCount)) {
+        return yajl_gen_status_ok;
+    }
+
+    iov = yajl_gen_chain_iov(g, &count);
+    if (sink->print) {
+        for (i = 0; i < count; i++) {
+            sink->print(sink->ctx, iov[i].base, iov[i].len);
+        }
+    } else if (!yajl_gen_writev_all(sink->fd, iov, count)) {
+        yajl_gen_chain_clear(g);
+        *yajlDualStorageGetPtr(&g->statusAtDepth, g->depth) = yajl_gen_error;
+        return yajl_gen_output_error;
+    }
+
+    yajl_buf_clear(&g->buf);
+    yajl_gen_chain_clear(g);
     return yajl_gen_status_ok;
 }
 
 yajl_gen_status yajl_gen_get_buf(yajl_gen g, void **buf, size_t *len) {
+    if (yajl_gen_sink_active(g->sink) || (g->sink && g->sink->zeroCopy)) {
+        *buf = NULL;
+        *len = 0;
+        return yajl_gen_no_buf;
+    }
+
     *buf = g->buf.data;
     *len = yajl_buf_len(&g->buf);
     return yajl_gen_status_ok;
 }
 
+yajl_gen_status yajl_gen_get_iov(yajl_gen g, const yajl_gen_iovec **iov,
+                                 size_t *count) {
+    *iov = NULL;
+    *count = 0;
+    if (yajl_gen_sink_active(g->sink) || !yajl_gen_sink_get(g)) {
+        return yajl_gen_no_buf;
+    }
+
+    *iov = yajl_gen_chain_iov(g, count);
+    return yajl_gen_status_ok;
+}
+
+void yajl_gen_get_stats(yajl_gen g, yajl_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    yajl_buf_stats(&g->buf, stats);
+    if (g->statusAtDepth.allocated) {
+        stats->allocations++;
+        stats->peakBytes += g->statusAtDepth.totalCountOfAllocated *
+                            sizeof(*g->statusAtDepth.allocated);
+    }
+
+    if (g->sink) {
+        stats->allocations++;
+        stats->peakBytes += sizeof(*g->sink);
+        if (g->sink->segmentCap) {
+            size_t cap;
+
+            /* 'segments' and 'iov' grow together, doubling from 16 */
+            stats->allocations += 2;
+            stats->peakBytes +=
+                g->sink->segmentCap * sizeof(*g->sink->segments) +
+                (g->sink->segmentCap + 1) * sizeof(*g->sink->iov);
+            for (cap = 16; cap < g->sink->segmentCap; cap <<= 1) {
+                stats->reallocs += 2;
+            }
+        }
+    }
+}
+
 void yajl_gen_clear(yajl_gen g) {
     yajl_buf_clear(&g->buf);
+    yajl_gen_chain_clear(g);
 }
@@ -16,6 +16,7 @@
 
 #include "yajl_lex.h"
 #include "yajl_buf.h"
+#include "yajl_trace.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -66,19 +67,47 @@ static const char *tokToStr(yajl_tok tok) {
  * bits of a chunk of JSON before the last bits are available (still on
  * the network or disk).  This makes the lexer more complex.  The
  * responsibility of the lexer is to handle transparently the case where
- * a chunk boundary falls in the middle of a token.  This is
- * accomplished is via a buffer and a character reading abstraction.
+ * a chunk boundary falls in the middle of a token.
  *
  * Overview of implementation
  *
- * When we lex to end of input string before end of token is hit, we
- * copy all of the input text composing the token into our lexBuf.
+ * The string, number, literal and comment lexers can stop anywhere and
+ * carry on later.  When one runs out of input it records where in the
+ * token it is (between characters of a string, after a backslash, at the
+ * third hex digit of a \u escape, in a number's exponent...) and returns
+ * yajl_tok_eof, and the bytes of the token so far are appended to lexBuf.
+ * The next chunk is lexed from that state starting at its first byte, and
+ * when the token completes the rest of it is appended and the whole token
+ * handed out from lexBuf.  So however small the chunks, no byte is
+ * scanned twice and each is copied at most once.
  *
- * Every time we read a character, we do so through the readChar function.
- * readChar's responsibility is to handle pulling all chars from the buffer
- * before pulling chars from input text
+ * Most tokens lie wholly inside one chunk though, so a token starting in
+ * the chunk is lexed by straight-line code which only works out its state
+ * and saves it if the chunk runs out.  The state machines are only used
+ * to carry on with a token from an earlier chunk.
  */
 
+/* what the lexer was in the middle of when the last chunk ran out */
+typedef enum {
+    yajl_lex_resume_none = 0,
+    yajl_lex_resume_string,
+    yajl_lex_resume_number,
+    yajl_lex_resume_literal,
+    yajl_lex_resume_comment
+} yajl_lex_resume;
+
+typedef struct {
+    yajl_lex_resume what;
+    /* how far into it we got: one of the STR_, NUM_ or COMMENT_ states,
+     * or the number of characters of a literal matched */
+    unsigned int state;
+    /* the string has had escapes so far */
+    unsigned int hasEscapes;
+    /* the literal being matched, and its token */
+    const char *word;
+    yajl_tok literal;
+} yajl_lex_pending;
+
 struct yajl_lexer_t {
     /* the overal line and char offset into the data */
     size_t lineOff;
@@ -91,35 +120,42 @@ struct yajl_lexer_t {
      * multiple chunks */
     yajl_buf_t buf;
 
-    /* in the case where we have data in the lexBuf, bufOff holds
-     * the current offset into the lexBuf. */
-    size_t bufOff;
-
-    /* are we using the lex buf? */
+    /* does the lexBuf hold the start of the token being lexed? */
     unsigned int bufInUse;
 
+    /* the token being lexed when the last chunk ran out */
+    yajl_lex_pending pending;
+
     /* shall we allow comments? */
     unsigned int allowComments;
 
     /* shall we validate utf8 inside strings? */
     unsigned int validateUTF8;
 
+    /* shall we work out the value of numbers as we go? */
+    unsigned int convertNumbers;
+
+    /* the number being lexed, and its explicit exponent so far */
+    yajl_lex_number_t number;
+    int expValue;
+    unsigned int expNegative;
+
+    /* tokens completed in 'buf' because they spanned two chunks */
+    size_t splicedTokens;
+
     yajl_alloc_funcs *alloc;
 };
 
-#define readChar(lxr, txt, off)                                                \
-    ((&(lxr)->bufInUse && yajl_buf_len(&(lxr)->buf) &&                         \
-      lxr->bufOff < yajl_buf_len(&(lxr)->buf))                                 \
-         ? (*((const unsigned char *)yajl_buf_data(&(lxr)->buf) +              \
-              ((lxr)->bufOff)++))                                              \
-         : ((txt)[(*(off))++]))
+#define readChar(txt, off) ((txt)[(*(off))++])
 
-#define unreadChar(lxr, off) ((*(off) > 0) ? (*(off))-- : ((lxr)->bufOff--))
+#define unreadChar(off) ((*(off))--)
 
-yajl_lexer yajl_lex_alloc(uint32_t allowComments, uint32_t validateUTF8) {
+yajl_lexer yajl_lex_alloc(uint32_t allowComments, uint32_t validateUTF8,
+                          uint32_t convertNumbers) {
     yajl_lexer lxr = (yajl_lexer)YA_CALLOC(sizeof(*lxr));
     lxr->allowComments = allowComments;
     lxr->validateUTF8 = validateUTF8;
+    lxr->convertNumbers = convertNumbers;
     return lxr;
 }
 
@@ -408,83 +444,6 @@ static const char charLookupTable[256] = {
     NUC,
     NUC};
 
-/** process a variable length utf8 encoded codepoint.
- *
- *  returns:
- *    yajl_tok_string - if valid utf8 char was parsed and offset was
- *                      advanced
- *    yajl_tok_eof - if end of input was hit before validation could
- *                   complete
- *    yajl_tok_error - if invalid utf8 was encountered
- *
- *  NOTE: on error the offset will point to the first char of the
- *  invalid utf8 */
-#define UTF8_CHECK_EOF                                                         \
-    if (*offset >= jsonTextLen) {                                              \
-        return yajl_tok_eof;                                                   \
-    }
-
-static yajl_tok yajl_lex_utf8_char(yajl_lexer lexer,
-                                   const unsigned char *jsonText,
-                                   size_t jsonTextLen, size_t *offset,
-                                   unsigned char curChar) {
-    if (curChar <= 0x7f) {
-        /* single byte */
-        return yajl_tok_string;
-    } else if ((curChar >> 5) == 0x6) {
-        /* two byte */
-        UTF8_CHECK_EOF;
-        curChar = readChar(lexer, jsonText, offset);
-        if ((curChar >> 6) == 0x2) {
-            return yajl_tok_string;
-        }
-    } else if ((curChar >> 4) == 0x0e) {
-        /* three byte */
-        UTF8_CHECK_EOF;
-        curChar = readChar(lexer, jsonText, offset);
-        if ((curChar >> 6) == 0x2) {
-            UTF8_CHECK_EOF;
-            curChar = readChar(lexer, jsonText, offset);
-            if ((curChar >> 6) == 0x2) {
-                return yajl_tok_string;
-            }
-        }
-    } else if ((curChar >> 3) == 0x1e) {
-        /* four byte */
-        UTF8_CHECK_EOF;
-        curChar = readChar(lexer, jsonText, offset);
-        if ((curChar >> 6) == 0x2) {
-            UTF8_CHECK_EOF;
-            curChar = readChar(lexer, jsonText, offset);
-            if ((curChar >> 6) == 0x2) {
-                UTF8_CHECK_EOF;
-                curChar = readChar(lexer, jsonText, offset);
-                if ((curChar >> 6) == 0x2) {
-                    return yajl_tok_string;
-                }
-            }
-        }
-    }
-
-    return yajl_tok_error;
-}
-
-/* lex a string.  input is the lexer, pointer to beginning of
- * json text, and start of string (offset).
- * a token is returned which has the following meanings:
- * yajl_tok_string: lex of string was successful.  offset points to
- *                  terminating '"'.
- * yajl_tok_eof: end of text was encountered before we could complete
- *               the lex.
- * yajl_tok_error: embedded in the string were unallowable chars.  offset
- *               points to the offending char
- */
-#define STR_CHECK_EOF                                                          \
-    if (*offset >= jsonTextLen) {                                              \
-        tok = yajl_tok_eof;                                                    \
-        goto finish_string_lex;                                                \
-    }
-
 /** scan a string for interesting characters that might need further
  *  review.  return the number of chars that are uninteresting and can
  *  be skipped.
@@ -501,345 +460,847 @@ static size_t yajl_string_scan(const unsigned char *buf, size_t len,
     return skip;
 }
 
-static yajl_tok yajl_lex_string(yajl_lexer lexer, const unsigned char *jsonText,
-                                size_t jsonTextLen, size_t *offset) {
-    yajl_tok tok = yajl_tok_error;
-    int hasEscapes = 0;
+/* states of a string being lexed */
+#define STR_CHARS 0  /* between characters */
+#define STR_ESCAPE 1 /* after a backslash */
+#define STR_HEX 2    /* in a \u escape, STR_HEX + n after n hex digits */
+#define STR_UTF8 6   /* in a multibyte character, STR_UTF8 + n with n + 1
+                      * continuation bytes to go */
 
+/* lex a string, or the rest of one, from 'state'.
+ * a token is returned which has the following meanings:
+ * yajl_tok_string: lex of string was successful.  offset points past the
+ *                  terminating '"'.
+ * yajl_tok_string_with_escapes: the same, and the string needs decoding.
+ * yajl_tok_eof: end of text was encountered before we could complete
+ *               the lex, the state is saved to carry on with next chunk.
+ * yajl_tok_error: embedded in the string were unallowable chars.  offset
+ *               points to the offending char
+ */
+static yajl_tok yajl_lex_string(yajl_lexer lexer, const unsigned char *jsonText,
+                                size_t jsonTextLen, size_t *offset,
+                                unsigned int state, unsigned int hasEscapes) {
     for (;;) {
         unsigned char curChar;
 
         /* now jump into a faster scanning routine to skip as much
          * of the buffers as possible */
-        {
-            const unsigned char *p;
-            size_t len;
-
-            if ((lexer->bufInUse && yajl_buf_len(&lexer->buf) &&
-                 lexer->bufOff < yajl_buf_len(&lexer->buf))) {
-                p = ((const unsigned char *)yajl_buf_data(&lexer->buf) +
-                     (lexer->bufOff));
-                len = yajl_buf_len(&lexer->buf) - lexer->bufOff;
-                lexer->bufOff += yajl_string_scan(p, len, lexer->validateUTF8);
-            } else if (*offset < jsonTextLen) {
-                p = jsonText + *offset;
-                len = jsonTextLen - *offset;
-                *offset += yajl_string_scan(p, len, lexer->validateUTF8);
-            }
+        if (state == STR_CHARS) {
+            *offset += yajl_string_scan(jsonText + *offset,
+                                        jsonTextLen - *offset,
+                                        lexer->validateUTF8);
         }
 
-        STR_CHECK_EOF;
+        if (*offset >= jsonTextLen) {
+            lexer->pending.what = yajl_lex_resume_string;
+            lexer->pending.state = state;
+            lexer->pending.hasEscapes = hasEscapes;
+            return yajl_tok_eof;
+        }
 
-        curChar = readChar(lexer, jsonText, offset);
+        curChar = readChar(jsonText, offset);
 
-        /* quote terminates */
-        if (curChar == '"') {
-            tok = yajl_tok_string;
-            break;
-        } else if (curChar == '\\') {
-            /* backslash escapes a set of control chars, */
-            hasEscapes = 1;
-            STR_CHECK_EOF;
+        if (state >= STR_UTF8) {
+            /* a continuation byte must be 10xxxxxx */
+            if ((curChar >> 6) != 0x2) {
+                lexer->error = yajl_lex_string_invalid_utf8;
+                return yajl_tok_error;
+            }
 
-            /* special case \u */
-            curChar = readChar(lexer, jsonText, offset);
+            state = (state == STR_UTF8) ? STR_CHARS : state - 1;
+        } else if (state >= STR_HEX) {
+            if (!(charLookupTable[curChar] & VHC)) {
+                /* back up to offending char */
+                unreadChar(offset);
+                lexer->error = yajl_lex_string_invalid_hex_char;
+                return yajl_tok_error;
+            }
+
+            state = (state == STR_HEX + 3) ? STR_CHARS : state + 1;
+        } else if (state == STR_ESCAPE) {
+            /* backslash escapes a set of control chars, special case \u */
             if (curChar == 'u') {
-                unsigned int i = 0;
-
-                for (i = 0; i < 4; i++) {
-                    STR_CHECK_EOF;
-                    curChar = readChar(lexer, jsonText, offset);
-                    if (!(charLookupTable[curChar] & VHC)) {
-                        /* back up to offending char */
-                        unreadChar(lexer, offset);
-                        lexer->error = yajl_lex_string_invalid_hex_char;
-                        goto finish_string_lex;
-                    }
-                }
-            } else if (!(charLookupTable[curChar] & VEC)) {
+                state = STR_HEX;
+            } else if (charLookupTable[curChar] & VEC) {
+                state = STR_CHARS;
+            } else {
                 /* back up to offending char */
-                unreadChar(lexer, offset);
+                unreadChar(offset);
                 lexer->error = yajl_lex_string_invalid_escaped_char;
-                goto finish_string_lex;
+                return yajl_tok_error;
             }
+        } else if (curChar == '"') {
+            /* quote terminates.  tell our buddy, the parser, wether he
+             * needs to process this string again */
+            return hasEscapes ? yajl_tok_string_with_escapes : yajl_tok_string;
+        } else if (curChar == '\\') {
+            hasEscapes = 1;
+            state = STR_ESCAPE;
         } else if (charLookupTable[curChar] & IJC) {
-            /* when not validating UTF8 it's a simple table lookup to determine
-             * if the present character is invalid */
             /* back up to offending char */
-            unreadChar(lexer, offset);
+            unreadChar(offset);
             lexer->error = yajl_lex_string_invalid_json_char;
-            goto finish_string_lex;
-        } else if (lexer->validateUTF8) {
-            /* when in validate UTF8 mode we need to do some extra work */
-            yajl_tok t = yajl_lex_utf8_char(lexer, jsonText, jsonTextLen,
-                                            offset, curChar);
-
-            if (t == yajl_tok_eof) {
-                tok = yajl_tok_eof;
-                goto finish_string_lex;
-            } else if (t == yajl_tok_error) {
+            return yajl_tok_error;
+        } else if (lexer->validateUTF8 && curChar > 0x7f) {
+            /* the lead byte says how many continuation bytes follow */
+            if ((curChar >> 5) == 0x6) {
+                state = STR_UTF8;
+            } else if ((curChar >> 4) == 0x0e) {
+                state = STR_UTF8 + 1;
+            } else if ((curChar >> 3) == 0x1e) {
+                state = STR_UTF8 + 2;
+            } else {
                 lexer->error = yajl_lex_string_invalid_utf8;
-                goto finish_string_lex;
+                return yajl_tok_error;
             }
         }
 
         /* accept it, and move on */
     }
+}
+
+/* lex a string from just after its opening quote.  this is
+ * yajl_lex_string() from STR_CHARS, without going round the state machine
+ * for each character: the state is only saved if the chunk runs out. */
+static yajl_tok yajl_lex_string_fast(yajl_lexer lexer,
+                                     const unsigned char *jsonText,
+                                     size_t jsonTextLen, size_t *offset) {
+    const int utf8check = lexer->validateUTF8;
+    unsigned int hasEscapes = 0;
+    unsigned int state = STR_CHARS;
+    size_t off = *offset;
+
+    for (;;) {
+        unsigned char c;
+
+        off += yajl_string_scan(jsonText + off, jsonTextLen - off, utf8check);
+        if (off >= jsonTextLen) {
+            goto eof;
+        }
+
+        c = jsonText[off++];
+        if (c == '"') {
+            *offset = off;
+            return hasEscapes ? yajl_tok_string_with_escapes : yajl_tok_string;
+        } else if (c == '\\') {
+            hasEscapes = 1;
+            state = STR_ESCAPE;
+            if (off >= jsonTextLen) {
+                goto eof;
+            }
+
+            c = jsonText[off++];
+            if (c == 'u') {
+                for (state = STR_HEX; state < STR_HEX + 4; state++) {
+                    if (off >= jsonTextLen) {
+                        goto eof;
+                    }
+
+                    if (!(charLookupTable[jsonText[off]] & VHC)) {
+                        lexer->error = yajl_lex_string_invalid_hex_char;
+                        goto error;
+                    }
+
+                    off++;
+                }
+            } else if (!(charLookupTable[c] & VEC)) {
+                off--;
+                lexer->error = yajl_lex_string_invalid_escaped_char;
+                goto error;
+            }
+        } else if (charLookupTable[c] & IJC) {
+            off--;
+            lexer->error = yajl_lex_string_invalid_json_char;
+            goto error;
+        } else if (utf8check && c > 0x7f) {
+            /* the lead byte says how many continuation bytes follow */
+            unsigned int more;
+
+            if ((c >> 5) == 0x6) {
+                more = 1;
+            } else if ((c >> 4) == 0x0e) {
+                more = 2;
+            } else if ((c >> 3) == 0x1e) {
+                more = 3;
+            } else {
+                lexer->error = yajl_lex_string_invalid_utf8;
+                goto error;
+            }
+
+            for (; more > 0; more--) {
+                if (off >= jsonTextLen) {
+                    state = STR_UTF8 + more - 1;
+                    goto eof;
+                }
+
+                if ((jsonText[off++] >> 6) != 0x2) {
+                    lexer->error = yajl_lex_string_invalid_utf8;
+                    goto error;
+                }
+            }
+        }
 
-finish_string_lex:
-    /* tell our buddy, the parser, wether he needs to process this string
-     * again */
-    if (hasEscapes && tok == yajl_tok_string) {
-        tok = yajl_tok_string_with_escapes;
+        state = STR_CHARS;
     }
 
-    return tok;
+eof:
+    lexer->pending.what = yajl_lex_resume_string;
+    lexer->pending.state = state;
+    lexer->pending.hasEscapes = hasEscapes;
+    *offset = off;
+    return yajl_tok_eof;
+
+error:
+    *offset = off;
+    return yajl_tok_error;
 }
 
-#define RETURN_IF_EOF                                                          \
-    if (*offset >= jsonTextLen)                                                \
-        return yajl_tok_eof;
+/* states of a number being lexed, named for what was read last */
+#define NUM_START 0    /* nothing yet */
+#define NUM_MINUS 1    /* a leading minus */
+#define NUM_ZERO 2     /* a leading zero */
+#define NUM_INT 3      /* integer digits */
+#define NUM_DOT 4      /* the decimal point */
+#define NUM_FRAC 5     /* fraction digits */
+#define NUM_E 6        /* the exponent's 'e' */
+#define NUM_EXP_SIGN 7 /* the exponent's sign */
+#define NUM_EXP 8      /* exponent digits */
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+/* the most significant digits kept, any 19 digit number fits in 64 bits */
+#define MAX_MANTISSA_DIGITS 19
+
+/* an exponent this big is out of range whatever the mantissa, stop
+ * counting so that it can't overflow */
+#define MAX_EXPONENT 100000
+
+/* add a digit read in 'state' to the value of the number being lexed */
+static void yajl_lex_add_digit(yajl_lexer lexer, unsigned int state,
+                               unsigned int digit) {
+    yajl_lex_number_t *n = &lexer->number;
+
+    if (state >= NUM_E) {
+        if (lexer->expValue < MAX_EXPONENT) {
+            lexer->expValue = lexer->expValue * 10 + digit;
+        }
+    } else if (n->digits == 0 && digit == 0) {
+        /* a leading zero is only significant for where the point is */
+        if (state >= NUM_DOT) {
+            n->exponent--;
+        }
+    } else if (n->digits < MAX_MANTISSA_DIGITS) {
+        n->mantissa = n->mantissa * 10 + digit;
+        n->digits++;
+        if (state >= NUM_DOT) {
+            n->exponent--;
+        }
+    } else {
+        n->truncated = 1;
+        if (state < NUM_DOT) {
+            n->exponent++;
+        }
+    }
+}
+
+/* skip a run of digits in 'state' (NUM_INT, NUM_FRAC or NUM_EXP), adding
+ * them to the value of the number being lexed.  returns the offset of the
+ * first byte which isn't a digit. */
+static size_t yajl_lex_digit_run(yajl_lexer lexer, unsigned int state,
+                                 const unsigned char *jsonText,
+                                 size_t jsonTextLen, size_t off) {
+    yajl_lex_number_t *n = &lexer->number;
+    const size_t start = off;
+    unsigned long long mantissa = n->mantissa;
+    unsigned int digits = n->digits;
+
+    if (state == NUM_EXP) {
+        while (off < jsonTextLen && IS_DIGIT(jsonText[off])) {
+            yajl_lex_add_digit(lexer, state, jsonText[off++] - '0');
+        }
+
+        return off;
+    }
+
+    /* zeros after the point and before any other digit only move it */
+    if (digits == 0) {
+        while (off < jsonTextLen && jsonText[off] == '0') {
+            off++;
+        }
+
+        n->exponent -= (int)(off - start);
+    }
+
+    /* the significant digits which fit */
+    while (off < jsonTextLen && digits < MAX_MANTISSA_DIGITS &&
+           IS_DIGIT(jsonText[off])) {
+        mantissa = mantissa * 10 + (jsonText[off++] - '0');
+        digits++;
+    }
+
+    if (state == NUM_FRAC) {
+        n->exponent -= (int)(digits - n->digits);
+    }
 
+    n->mantissa = mantissa;
+    n->digits = digits;
+
+    /* and those which don't */
+    while (off < jsonTextLen && IS_DIGIT(jsonText[off])) {
+        yajl_lex_add_digit(lexer, state, jsonText[off++] - '0');
+    }
+
+    return off;
+}
+
+/* lex the rest of a number from 'state'.  when converting numbers, the
+ * value is worked out along the way into lexer->number. */
 static yajl_tok yajl_lex_number(yajl_lexer lexer, const unsigned char *jsonText,
-                                size_t jsonTextLen, size_t *offset) {
+                                size_t jsonTextLen, size_t *offset,
+                                unsigned int state) {
     /** XXX: numbers are the only entities in json that we must lex
      *       _beyond_ in order to know that they are complete.  There
      *       is an ambiguous case for integers at EOF. */
+    const unsigned int convert = lexer->convertNumbers;
+    size_t off = *offset;
+    yajl_tok tok;
 
-    unsigned char c;
+    for (;;) {
+        unsigned char c;
+
+        /* skip runs of digits without going round the state machine */
+        if (state == NUM_INT || state == NUM_FRAC || state == NUM_EXP) {
+            if (convert) {
+                off = yajl_lex_digit_run(lexer, state, jsonText, jsonTextLen,
+                                         off);
+            } else {
+                while (off < jsonTextLen && IS_DIGIT(jsonText[off])) {
+                    off++;
+                }
+            }
+        }
+
+        if (off >= jsonTextLen) {
+            lexer->pending.what = yajl_lex_resume_number;
+            lexer->pending.state = state;
+            *offset = off;
+            return yajl_tok_eof;
+        }
+
+        c = readChar(jsonText, &off);
+
+        switch (state) {
+        case NUM_START:
+            /* optional leading minus */
+            if (c == '-') {
+                if (convert) {
+                    lexer->number.negative = 1;
+                }
+
+                state = NUM_MINUS;
+                break;
+            }
+
+            /* intentional fall-through */
+        case NUM_MINUS:
+            /* a single zero, or a series of integers */
+            if (c == '0') {
+                state = NUM_ZERO;
+            } else if (c >= '1' && c <= '9') {
+                state = NUM_INT;
+                if (convert) {
+                    yajl_lex_add_digit(lexer, state, c - '0');
+                }
+            } else {
+                unreadChar(&off);
+                *offset = off;
+                lexer->error = yajl_lex_missing_integer_after_minus;
+                return yajl_tok_error;
+            }
+
+            break;
+        case NUM_INT:
+            if (IS_DIGIT(c)) {
+                if (convert) {
+                    yajl_lex_add_digit(lexer, state, c - '0');
+                }
+
+                break;
+            }
+
+            /* intentional fall-through */
+        case NUM_ZERO:
+            /* optional fraction or exponent (indicates this is floating
+             * point) */
+            if (c == '.') {
+                state = NUM_DOT;
+                break;
+            } else if (c == 'e' || c == 'E') {
+                state = NUM_E;
+                break;
+            }
+
+            /* we always go "one too far" */
+            unreadChar(&off);
+            tok = yajl_tok_integer;
+            goto lexed;
+        case NUM_DOT:
+            if (!IS_DIGIT(c)) {
+                unreadChar(&off);
+                *offset = off;
+                lexer->error = yajl_lex_missing_integer_after_decimal;
+                return yajl_tok_error;
+            }
+
+            state = NUM_FRAC;
+            if (convert) {
+                yajl_lex_add_digit(lexer, state, c - '0');
+            }
+
+            break;
+        case NUM_FRAC:
+            if (IS_DIGIT(c)) {
+                if (convert) {
+                    yajl_lex_add_digit(lexer, state, c - '0');
+                }
 
+                break;
+            } else if (c == 'e' || c == 'E') {
+                state = NUM_E;
+                break;
+            }
+
+            unreadChar(&off);
+            tok = yajl_tok_double;
+            goto lexed;
+        case NUM_E:
+            /* optional sign */
+            if (c == '+' || c == '-') {
+                lexer->expNegative = (c == '-');
+                state = NUM_EXP_SIGN;
+                break;
+            }
+
+            /* intentional fall-through */
+        case NUM_EXP_SIGN:
+            if (!IS_DIGIT(c)) {
+                unreadChar(&off);
+                *offset = off;
+                lexer->error = yajl_lex_missing_integer_after_exponent;
+                return yajl_tok_error;
+            }
+
+            state = NUM_EXP;
+            if (convert) {
+                yajl_lex_add_digit(lexer, state, c - '0');
+            }
+
+            break;
+        default:
+            if (IS_DIGIT(c)) {
+                if (convert) {
+                    yajl_lex_add_digit(lexer, state, c - '0');
+                }
+
+                break;
+            }
+
+            unreadChar(&off);
+            tok = yajl_tok_double;
+            goto lexed;
+        }
+    }
+
+lexed:
+    if (convert) {
+        lexer->number.exponent +=
+            lexer->expNegative ? -lexer->expValue : lexer->expValue;
+    }
+
+    *offset = off;
+    return tok;
+}
+
+/* skip a run of digits in 'state', working out their value if converting */
+#define DIGIT_RUN(state)                                                       \
+    do {                                                                       \
+        if (convert) {                                                         \
+            off = yajl_lex_digit_run(lexer, (state), jsonText, jsonTextLen,   \
+                                     off);                                     \
+        } else {                                                               \
+            while (off < jsonTextLen && IS_DIGIT(jsonText[off])) {             \
+                off++;                                                         \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+/* lex a number from its first character, which is in the chunk.  this is
+ * yajl_lex_number() from NUM_START, in the order the parts of a number
+ * come: the state is only saved if the chunk runs out. */
+static yajl_tok yajl_lex_number_fast(yajl_lexer lexer,
+                                     const unsigned char *jsonText,
+                                     size_t jsonTextLen, size_t *offset) {
+    const unsigned int convert = lexer->convertNumbers;
     yajl_tok tok = yajl_tok_integer;
+    size_t off = *offset;
+    unsigned int state;
+    unsigned char c;
 
-    RETURN_IF_EOF;
-    c = readChar(lexer, jsonText, offset);
+    if (convert) {
+        memset(&lexer->number, 0, sizeof(lexer->number));
+        lexer->expValue = 0;
+        lexer->expNegative = 0;
+    }
 
     /* optional leading minus */
+    c = jsonText[off++];
     if (c == '-') {
-        RETURN_IF_EOF;
-        c = readChar(lexer, jsonText, offset);
+        if (convert) {
+            lexer->number.negative = 1;
+        }
+
+        state = NUM_MINUS;
+        if (off >= jsonTextLen) {
+            goto eof;
+        }
+
+        c = jsonText[off++];
     }
 
     /* a single zero, or a series of integers */
     if (c == '0') {
-        RETURN_IF_EOF;
-        c = readChar(lexer, jsonText, offset);
+        state = NUM_ZERO;
     } else if (c >= '1' && c <= '9') {
-        do {
-            RETURN_IF_EOF;
-            c = readChar(lexer, jsonText, offset);
-        } while (c >= '0' && c <= '9');
+        state = NUM_INT;
+        if (convert) {
+            yajl_lex_add_digit(lexer, state, c - '0');
+        }
+
+        DIGIT_RUN(NUM_INT);
     } else {
-        unreadChar(lexer, offset);
+        off--;
         lexer->error = yajl_lex_missing_integer_after_minus;
-        return yajl_tok_error;
+        goto error;
+    }
+
+    if (off >= jsonTextLen) {
+        goto eof;
     }
 
     /* optional fraction (indicates this is floating point) */
-    if (c == '.') {
-        int numRd = 0;
+    if (jsonText[off] == '.') {
+        off++;
+        state = NUM_DOT;
+        if (off >= jsonTextLen) {
+            goto eof;
+        }
 
-        RETURN_IF_EOF;
-        c = readChar(lexer, jsonText, offset);
+        c = jsonText[off++];
+        if (!IS_DIGIT(c)) {
+            off--;
+            lexer->error = yajl_lex_missing_integer_after_decimal;
+            goto error;
+        }
 
-        while (c >= '0' && c <= '9') {
-            numRd++;
-            RETURN_IF_EOF;
-            c = readChar(lexer, jsonText, offset);
+        state = NUM_FRAC;
+        if (convert) {
+            yajl_lex_add_digit(lexer, state, c - '0');
         }
 
-        if (!numRd) {
-            unreadChar(lexer, offset);
-            lexer->error = yajl_lex_missing_integer_after_decimal;
-            return yajl_tok_error;
+        DIGIT_RUN(NUM_FRAC);
+        if (off >= jsonTextLen) {
+            goto eof;
         }
 
         tok = yajl_tok_double;
     }
 
     /* optional exponent (indicates this is floating point) */
-    if (c == 'e' || c == 'E') {
-        RETURN_IF_EOF;
-        c = readChar(lexer, jsonText, offset);
+    if (jsonText[off] == 'e' || jsonText[off] == 'E') {
+        off++;
+        state = NUM_E;
+        if (off >= jsonTextLen) {
+            goto eof;
+        }
 
         /* optional sign */
+        c = jsonText[off++];
         if (c == '+' || c == '-') {
-            RETURN_IF_EOF;
-            c = readChar(lexer, jsonText, offset);
+            lexer->expNegative = (c == '-');
+            state = NUM_EXP_SIGN;
+            if (off >= jsonTextLen) {
+                goto eof;
+            }
+
+            c = jsonText[off++];
         }
 
-        if (c >= '0' && c <= '9') {
-            do {
-                RETURN_IF_EOF;
-                c = readChar(lexer, jsonText, offset);
-            } while (c >= '0' && c <= '9');
-        } else {
-            unreadChar(lexer, offset);
+        if (!IS_DIGIT(c)) {
+            off--;
             lexer->error = yajl_lex_missing_integer_after_exponent;
-            return yajl_tok_error;
+            goto error;
+        }
+
+        state = NUM_EXP;
+        if (convert) {
+            yajl_lex_add_digit(lexer, state, c - '0');
+        }
+
+        DIGIT_RUN(NUM_EXP);
+        if (off >= jsonTextLen) {
+            goto eof;
         }
 
         tok = yajl_tok_double;
+        if (convert) {
+            lexer->number.exponent +=
+                lexer->expNegative ? -lexer->expValue : lexer->expValue;
+        }
     }
 
-    /* we always go "one too far" */
-    unreadChar(lexer, offset);
-
+    *offset = off;
     return tok;
+
+eof:
+    lexer->pending.what = yajl_lex_resume_number;
+    lexer->pending.state = state;
+    *offset = off;
+    return yajl_tok_eof;
+
+error:
+    *offset = off;
+    return yajl_tok_error;
+}
+
+/* lex the rest of true, false or null, the first 'state' characters of
+ * which have been matched */
+static yajl_tok yajl_lex_literal(yajl_lexer lexer,
+                                 const unsigned char *jsonText,
+                                 size_t jsonTextLen, size_t *offset) {
+    yajl_lex_pending *p = &lexer->pending;
+
+    for (; p->word[p->state]; p->state++) {
+        if (*offset >= jsonTextLen) {
+            p->what = yajl_lex_resume_literal;
+            return yajl_tok_eof;
+        }
+
+        if (readChar(jsonText, offset) != (unsigned char)p->word[p->state]) {
+            unreadChar(offset);
+            lexer->error = yajl_lex_invalid_string;
+            return yajl_tok_error;
+        }
+    }
+
+    return p->literal;
+}
+
+/* lex true, false or null, the first character of which has been read.
+ * when the rest is in the chunk it is compared in one go, otherwise
+ * yajl_lex_literal() works out where it stops matching or runs out. */
+static yajl_tok yajl_lex_word(yajl_lexer lexer, const unsigned char *jsonText,
+                              size_t jsonTextLen, size_t *offset,
+                              const char *word, size_t wordLen,
+                              yajl_tok literal) {
+    if (jsonTextLen - *offset >= wordLen - 1 &&
+        !memcmp(jsonText + *offset, word + 1, wordLen - 1)) {
+        *offset += wordLen - 1;
+        return literal;
+    }
+
+    lexer->pending.word = word;
+    lexer->pending.literal = literal;
+    lexer->pending.state = 1;
+    return yajl_lex_literal(lexer, jsonText, jsonTextLen, offset);
 }
 
+#define LEX_WORD(word, literal)                                                \
+    yajl_lex_word(lexer, jsonText, jsonTextLen, offset, (word),               \
+                  sizeof(word) - 1, (literal))
+
+/* states of a comment being skipped */
+#define COMMENT_START 0 /* after the opening slash */
+#define COMMENT_LINE 1  /* in a // comment */
+#define COMMENT_BLOCK 2 /* in a slash-star comment */
+#define COMMENT_STAR 3  /* after a star in a slash-star comment */
+
 static yajl_tok yajl_lex_comment(yajl_lexer lexer,
                                  const unsigned char *jsonText,
                                  size_t jsonTextLen, size_t *offset) {
-    unsigned char c;
+    yajl_lex_pending *p = &lexer->pending;
 
-    yajl_tok tok = yajl_tok_comment;
+    for (;;) {
+        unsigned char c;
+
+        if (*offset >= jsonTextLen) {
+            p->what = yajl_lex_resume_comment;
+            return yajl_tok_eof;
+        }
+
+        c = readChar(jsonText, offset);
+
+        switch (p->state) {
+        case COMMENT_START:
+            /* either slash or star expected */
+            if (c == '/') {
+                p->state = COMMENT_LINE;
+            } else if (c == '*') {
+                p->state = COMMENT_BLOCK;
+            } else {
+                lexer->error = yajl_lex_invalid_char;
+                return yajl_tok_error;
+            }
+
+            break;
+        case COMMENT_LINE:
+            /* now we throw away until end of line */
+            if (c == '\n') {
+                return yajl_tok_comment;
+            }
 
-    RETURN_IF_EOF;
-    c = readChar(lexer, jsonText, offset);
-
-    /* either slash or star expected */
-    if (c == '/') {
-        /* now we throw away until end of line */
-        do {
-            RETURN_IF_EOF;
-            c = readChar(lexer, jsonText, offset);
-        } while (c != '\n');
-    } else if (c == '*') {
-        /* now we throw away until end of comment */
-        for (;;) {
-            RETURN_IF_EOF;
-            c = readChar(lexer, jsonText, offset);
+            break;
+        case COMMENT_BLOCK:
+            /* now we throw away until end of comment */
             if (c == '*') {
-                RETURN_IF_EOF;
-                c = readChar(lexer, jsonText, offset);
-                if (c == '/') {
-                    break;
-                } else {
-                    unreadChar(lexer, offset);
-                }
+                p->state = COMMENT_STAR;
+            }
+
+            break;
+        default:
+            if (c == '/') {
+                return yajl_tok_comment;
+            } else if (c != '*') {
+                p->state = COMMENT_BLOCK;
             }
+
+            break;
         }
-    } else {
-        lexer->error = yajl_lex_invalid_char;
-        tok = yajl_tok_error;
+    }
+}
+
+/* keep what there is of a string or number the chunk ended inside of for
+ * the next chunk.  comments are skipped, and literals needn't be kept as
+ * their text is known. */
+static void yajl_lex_carry(yajl_lexer lexer, const unsigned char *text,
+                           size_t len) {
+    if (lexer->pending.what == yajl_lex_resume_string ||
+        lexer->pending.what == yajl_lex_resume_number) {
+        if (!lexer->bufInUse) {
+            yajl_buf_clear(&lexer->buf);
+            lexer->bufInUse = 1;
+        }
+
+        yajl_buf_append(&lexer->buf, text, len);
+        YAJL_PROBE1(lex__carry, len);
+    }
+}
+
+/* finish the token the last chunk ended in the middle of, handing it out
+ * whole through outBuf.  yajl_tok_comment means a comment ended, and the
+ * next token is to be lexed as usual. */
+static yajl_tok yajl_lex_resume_token(yajl_lexer lexer,
+                                      const unsigned char *jsonText,
+                                      size_t jsonTextLen, size_t *offset,
+                                      const unsigned char **outBuf,
+                                      size_t *outLen) {
+    const yajl_lex_resume what = lexer->pending.what;
+    const size_t startOffset = *offset;
+    yajl_tok tok;
+
+    lexer->pending.what = yajl_lex_resume_none;
+    switch (what) {
+    case yajl_lex_resume_string:
+        tok = yajl_lex_string(lexer, jsonText, jsonTextLen, offset,
+                              lexer->pending.state, lexer->pending.hasEscapes);
+        break;
+    case yajl_lex_resume_number:
+        tok = yajl_lex_number(lexer, jsonText, jsonTextLen, offset,
+                              lexer->pending.state);
+        break;
+    case yajl_lex_resume_literal:
+        tok = yajl_lex_literal(lexer, jsonText, jsonTextLen, offset);
+        if (tok != yajl_tok_eof && tok != yajl_tok_error) {
+            *outBuf = (const unsigned char *)lexer->pending.word;
+            *outLen = strlen(lexer->pending.word);
+            lexer->splicedTokens++;
+            YAJL_PROBE1(lex__splice, *outLen);
+        }
+
+        return tok;
+    default:
+        return yajl_lex_comment(lexer, jsonText, jsonTextLen, offset);
+    }
+
+    /* the string or number began in an earlier chunk and is pieced
+     * together in lexBuf */
+    if (tok == yajl_tok_eof) {
+        yajl_lex_carry(lexer, jsonText + startOffset, *offset - startOffset);
+        return tok;
+    }
+
+    lexer->bufInUse = 0;
+    if (tok != yajl_tok_error) {
+        yajl_buf_append(&lexer->buf, jsonText + startOffset,
+                        *offset - startOffset);
+        *outBuf = yajl_buf_data(&lexer->buf);
+        *outLen = yajl_buf_len(&lexer->buf);
+        lexer->splicedTokens++;
+        YAJL_PROBE1(lex__splice, *outLen);
     }
 
     return tok;
 }
 
-yajl_tok yajl_lex_lex(yajl_lexer lexer, const unsigned char *jsonText,
-                      size_t jsonTextLen, size_t *offset,
-                      const unsigned char **outBuf, size_t *outLen) {
-    yajl_tok tok = yajl_tok_error;
+/* find the next token starting in this chunk, leaving *offset just past it
+ * and *startOffset at its first byte.  only lexer->pending and
+ * lexer->error are changed.  this has the one caller, so that it is
+ * inlined. */
+static yajl_tok yajl_lex_token(yajl_lexer lexer, const unsigned char *jsonText,
+                               size_t jsonTextLen, size_t *offset,
+                               size_t *startOffset) {
     unsigned char c;
-    size_t startOffset = *offset;
+    yajl_tok tok;
 
-    *outBuf = NULL;
-    *outLen = 0;
+    *startOffset = *offset;
 
     for (;;) {
         assert(*offset <= jsonTextLen);
 
         if (*offset >= jsonTextLen) {
-            tok = yajl_tok_eof;
-            goto lexed;
+            return yajl_tok_eof;
         }
 
-        c = readChar(lexer, jsonText, offset);
+        c = readChar(jsonText, offset);
 
         switch (c) {
         case '{':
-            tok = yajl_tok_left_bracket;
-            goto lexed;
+            return yajl_tok_left_bracket;
         case '}':
-            tok = yajl_tok_right_bracket;
-            goto lexed;
+            return yajl_tok_right_bracket;
         case '[':
-            tok = yajl_tok_left_brace;
-            goto lexed;
+            return yajl_tok_left_brace;
         case ']':
-            tok = yajl_tok_right_brace;
-            goto lexed;
+            return yajl_tok_right_brace;
         case ',':
-            tok = yajl_tok_comma;
-            goto lexed;
+            return yajl_tok_comma;
         case ':':
-            tok = yajl_tok_colon;
-            goto lexed;
+            return yajl_tok_colon;
         case '\t':
         case '\n':
         case '\v':
         case '\f':
         case '\r':
         case ' ':
-            startOffset++;
+            (*startOffset)++;
             break;
-        case 't': {
-            const char *want = "rue";
-            do {
-                if (*offset >= jsonTextLen) {
-                    tok = yajl_tok_eof;
-                    goto lexed;
-                }
-
-                c = readChar(lexer, jsonText, offset);
-                if (c != *want) {
-                    unreadChar(lexer, offset);
-                    lexer->error = yajl_lex_invalid_string;
-                    tok = yajl_tok_error;
-                    goto lexed;
-                }
-            } while (*(++want));
-            tok = yajl_tok_bool;
-            goto lexed;
-        }
-
-        case 'f': {
-            const char *want = "alse";
-            do {
-                if (*offset >= jsonTextLen) {
-                    tok = yajl_tok_eof;
-                    goto lexed;
-                }
-
-                c = readChar(lexer, jsonText, offset);
-                if (c != *want) {
-                    unreadChar(lexer, offset);
-                    lexer->error = yajl_lex_invalid_string;
-                    tok = yajl_tok_error;
-                    goto lexed;
-                }
-            } while (*(++want));
-            tok = yajl_tok_bool;
-            goto lexed;
-        }
-
-        case 'n': {
-            const char *want = "ull";
-            do {
-                if (*offset >= jsonTextLen) {
-                    tok = yajl_tok_eof;
-                    goto lexed;
-                }
-
-                c = readChar(lexer, jsonText, offset);
-                if (c != *want) {
-                    unreadChar(lexer, offset);
-                    lexer->error = yajl_lex_invalid_string;
-                    tok = yajl_tok_error;
-                    goto lexed;
-                }
-            } while (*(++want));
-            tok = yajl_tok_null;
-            goto lexed;
-        }
-
-        case '"': {
-            tok = yajl_lex_string(lexer, (const unsigned char *)jsonText,
-                                  jsonTextLen, offset);
-            goto lexed;
-        }
-
+        case 't':
+            return LEX_WORD("true", yajl_tok_bool);
+        case 'f':
+            return LEX_WORD("false", yajl_tok_bool);
+        case 'n':
+            return LEX_WORD("null", yajl_tok_null);
+        case '"':
+            return yajl_lex_string_fast(lexer, jsonText, jsonTextLen, offset);
         case '-':
         case '0':
         case '1':
@@ -850,22 +1311,17 @@ yajl_tok yajl_lex_lex(yajl_lexer lexer, const unsigned char *jsonText,
         case '6':
         case '7':
         case '8':
-        case '9': {
+        case '9':
             /* integer parsing wants to start from the beginning */
-            unreadChar(lexer, offset);
-            tok = yajl_lex_number(lexer, (const unsigned char *)jsonText,
-                                  jsonTextLen, offset);
-            goto lexed;
-        }
-
+            unreadChar(offset);
+            return yajl_lex_number_fast(lexer, jsonText, jsonTextLen, offset);
         case '/':
             /* hey, look, a probable comment!  If comments are disabled
              * it's an error. */
             if (!lexer->allowComments) {
-                unreadChar(lexer, offset);
+                unreadChar(offset);
                 lexer->error = yajl_lex_unallowed_comment;
-                tok = yajl_tok_error;
-                goto lexed;
+                return yajl_tok_error;
             }
 
             /* if comments are enabled, then we should try to lex
@@ -874,48 +1330,48 @@ yajl_tok yajl_lex_lex(yajl_lexer lexer, const unsigned char *jsonText,
              * - malformed comment opening (slash not followed by
              *   '*' or '/') (tok_error)
              * - eof hit. (tok_eof) */
-            tok = yajl_lex_comment(lexer, (const unsigned char *)jsonText,
-                                   jsonTextLen, offset);
-            if (tok == yajl_tok_comment) {
-                /* "error" is silly, but that's the initial
-                 * state of tok.  guilty until proven innocent. */
-                tok = yajl_tok_error;
-                yajl_buf_clear(&lexer->buf);
-                lexer->bufInUse = 0;
-                startOffset = *offset;
-                break;
+            lexer->pending.state = COMMENT_START;
+            tok = yajl_lex_comment(lexer, jsonText, jsonTextLen, offset);
+            if (tok != yajl_tok_comment) {
+                /* hit error or eof, bail */
+                return tok;
             }
 
-            /* hit error or eof, bail */
-            goto lexed;
+            *startOffset = *offset;
+            break;
         default:
             lexer->error = yajl_lex_invalid_char;
-            tok = yajl_tok_error;
-            goto lexed;
+            return yajl_tok_error;
         }
     }
+}
 
-lexed:
-    /* need to append to buffer if the buffer is in use or
-     * if it's an EOF token */
-    if (tok == yajl_tok_eof || lexer->bufInUse) {
-        if (!lexer->bufInUse) {
-            yajl_buf_clear(&lexer->buf);
-        }
+yajl_tok yajl_lex_lex(yajl_lexer lexer, const unsigned char *jsonText,
+                      size_t jsonTextLen, size_t *offset,
+                      const unsigned char **outBuf, size_t *outLen) {
+    yajl_tok tok = yajl_tok_comment;
 
-        lexer->bufInUse = 1;
-        yajl_buf_append(&lexer->buf, jsonText + startOffset,
-                        *offset - startOffset);
-        lexer->bufOff = 0;
+    *outBuf = NULL;
+    *outLen = 0;
 
-        if (tok != yajl_tok_eof) {
-            *outBuf = yajl_buf_data(&lexer->buf);
-            *outLen = yajl_buf_len(&lexer->buf);
-            lexer->bufInUse = 0;
+    if (lexer->pending.what != yajl_lex_resume_none) {
+        tok = yajl_lex_resume_token(lexer, jsonText, jsonTextLen, offset,
+                                    outBuf, outLen);
+    }
+
+    /* the common case, a token starting in this chunk */
+    if (tok == yajl_tok_comment) {
+        size_t startOffset;
+
+        tok = yajl_lex_token(lexer, jsonText, jsonTextLen, offset,
+                             &startOffset);
+        if (tok == yajl_tok_eof) {
+            yajl_lex_carry(lexer, jsonText + startOffset,
+                           *offset - startOffset);
+        } else if (tok != yajl_tok_error) {
+            *outBuf = jsonText + startOffset;
+            *outLen = *offset - startOffset;
         }
-    } else if (tok != yajl_tok_error) {
-        *outBuf = jsonText + startOffset;
-        *outLen = *offset - startOffset;
     }
 
     /* special case for strings. skip the quotes. */
@@ -925,6 +1381,8 @@ lexed:
         *outLen -= 2;
     }
 
+    YAJL_PROBE2(lex__token, tok, *outLen);
+
 #ifdef YAJL_LEXER_DEBUG
     if (tok == yajl_tok_error) {
         printf("lexical error: %s\n",
@@ -986,6 +1444,10 @@ yajl_lex_error yajl_lex_get_error(yajl_lexer lexer) {
     return lexer->error;
 }
 
+const yajl_lex_number_t *yajl_lex_number_value(yajl_lexer lexer) {
+    return lexer->convertNumbers ? &lexer->number : NULL;
+}
+
 size_t yajl_lex_current_line(yajl_lexer lexer) {
     return lexer->lineOff;
 }
@@ -994,20 +1456,9 @@ size_t yajl_lex_current_char(yajl_lexer lexer) {
     return lexer->charOff;
 }
 
-yajl_tok yajl_lex_peek(yajl_lexer lexer, const unsigned char *jsonText,
-                       size_t jsonTextLen, size_t offset) {
-    const unsigned char *outBuf;
-    size_t outLen;
-    size_t bufLen = yajl_buf_len(&lexer->buf);
-    size_t bufOff = lexer->bufOff;
-    unsigned int bufInUse = lexer->bufInUse;
-    yajl_tok tok;
-
-    tok = yajl_lex_lex(lexer, jsonText, jsonTextLen, &offset, &outBuf, &outLen);
-
-    lexer->bufOff = bufOff;
-    lexer->bufInUse = bufInUse;
-    yajl_buf_truncate(&lexer->buf, bufLen);
-
-    return tok;
+void yajl_lex_stats(yajl_lexer lexer, yajl_stats *stats) {
+    stats->allocations++;
+    stats->peakBytes += sizeof(*lexer);
+    stats->splicedTokens += lexer->splicedTokens;
+    yajl_buf_stats(&lexer->buf, stats);
 }
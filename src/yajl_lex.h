@@ -47,7 +47,21 @@ typedef enum {
 
 typedef struct yajl_lexer_t *yajl_lexer;
 
-yajl_lexer yajl_lex_alloc(uint32_t allowComments, uint32_t validateUTF8);
+/* a number as it was lexed, its value is mantissa * 10^exponent.  only
+ * the first 19 significant digits are kept, if there were more then
+ * 'truncated' is set and the value is approximate. */
+typedef struct {
+    unsigned long long mantissa;
+    int exponent;
+    unsigned int digits;
+    unsigned int truncated;
+    unsigned int negative;
+} yajl_lex_number_t;
+
+/* with convertNumbers set the lexer works out each number's value as it
+ * scans it, see yajl_lex_number_value() */
+yajl_lexer yajl_lex_alloc(uint32_t allowComments, uint32_t validateUTF8,
+                          uint32_t convertNumbers);
 
 void yajl_lex_free(yajl_lexer lexer);
 
@@ -77,9 +91,9 @@ yajl_tok yajl_lex_lex(yajl_lexer lexer, const unsigned char *jsonText,
                       size_t jsonTextLen, size_t *offset,
                       const unsigned char **outBuf, size_t *outLen);
 
-/** have a peek at the next token, but don't move the lexer forward */
-yajl_tok yajl_lex_peek(yajl_lexer lexer, const unsigned char *jsonText,
-                       size_t jsonTextLen, size_t offset);
+/** the value of the integer or double token just returned by yajl_lex_lex,
+ *  NULL unless the lexer was allocated with convertNumbers */
+const yajl_lex_number_t *yajl_lex_number_value(yajl_lexer lexer);
 
 typedef enum {
     yajl_lex_e_ok = 0,
@@ -111,4 +125,7 @@ size_t yajl_lex_current_line(yajl_lexer lexer);
  *  \n or \r */
 size_t yajl_lex_current_char(yajl_lexer lexer);
 
+/* add the lexer's memory use and spliced token count to 'stats' */
+void yajl_lex_stats(yajl_lexer lexer, yajl_stats *stats);
+
 #endif
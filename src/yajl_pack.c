@@ -0,0 +1,874 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "api/yajl_pack.h"
+#include "yajl_alloc.h"
+#include "yajl_buf.h"
+#include "yajl_encode.h"
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+/*
+ * MessagePack wants the number of entries before a map or array, which the
+ * callbacks only give at its end.  Each container is given one byte for
+ * its header, which is filled in when it closes if it has fewer than 16
+ * entries, as most do.  Those with more need a longer header: once the
+ * top-level value is complete one pass from its end moves everything up to
+ * make room for them, so the cost is at most a single copy of the value no
+ * matter how deeply it nests.
+ */
+
+typedef struct {
+    /* where the header byte is */
+    size_t pos;
+    size_t count;
+    int isMap;
+} pack_container;
+
+struct yajl_pack_s {
+    yajl_pack_format format;
+    yajl_buf_t buf;
+    /* every container of the value being packed, in the order they were
+     * opened, which is also the order of their headers */
+    pack_container *containers;
+    size_t used;
+    size_t cap;
+    /* indexes into containers of the open ones, innermost last */
+    size_t *open;
+    size_t depth;
+    size_t openCap;
+    /* the header bytes which the containers closed so far need beyond the
+     * one they were given */
+    size_t extra;
+};
+
+yajl_pack yajl_pack_alloc(yajl_pack_format format) {
+    yajl_pack p = YA_CALLOC(sizeof(struct yajl_pack_s));
+
+    if (p == NULL) {
+        return NULL;
+    }
+
+    p->format = format;
+    if (format == yajl_pack_msgpack) {
+        /* enough for most documents, so packing them allocates nothing
+         * but output */
+        p->cap = p->openCap = 16;
+        p->containers = YA_CALLOC(p->cap * sizeof(pack_container));
+        p->open = YA_CALLOC(p->openCap * sizeof(size_t));
+    }
+
+    return p;
+}
+
+void yajl_pack_free(yajl_pack p) {
+    if (p == NULL) {
+        return;
+    }
+
+    yajl_buf_free(&p->buf);
+    YA_FREE(p->containers);
+    YA_FREE(p->open);
+    YA_FREE(p);
+}
+
+void yajl_pack_get_buf(yajl_pack p, const unsigned char **buf, size_t *len) {
+    *buf = yajl_buf_data(&p->buf);
+    *len = yajl_buf_len(&p->buf);
+}
+
+void yajl_pack_clear(yajl_pack p) {
+    yajl_buf_clear(&p->buf);
+    p->used = 0;
+    p->depth = 0;
+    p->extra = 0;
+}
+
+static void put(yajl_pack p, const void *data, size_t len) {
+    yajl_buf_append(&p->buf, data, len);
+}
+
+/* big endian, as both formats want */
+static void store_be(unsigned char *out, unsigned long long v, size_t n) {
+    while (n-- > 0) {
+        out[n] = (unsigned char)v;
+        v >>= 8;
+    }
+}
+
+static unsigned long long load_be(const unsigned char *in, size_t n) {
+    unsigned long long v = 0;
+
+    while (n-- > 0) {
+        v = (v << 8) | *in++;
+    }
+
+    return v;
+}
+
+/** MessagePack **/
+
+static size_t msgpack_uint(unsigned char *out, unsigned long long v) {
+    if (v < 0x80) {
+        out[0] = (unsigned char)v;
+        return 1;
+    } else if (v <= 0xff) {
+        out[0] = 0xcc;
+        out[1] = (unsigned char)v;
+        return 2;
+    } else if (v <= 0xffff) {
+        out[0] = 0xcd;
+        store_be(out + 1, v, 2);
+        return 3;
+    } else if (v <= 0xffffffffULL) {
+        out[0] = 0xce;
+        store_be(out + 1, v, 4);
+        return 5;
+    }
+
+    out[0] = 0xcf;
+    store_be(out + 1, v, 8);
+    return 9;
+}
+
+static size_t msgpack_str_head(unsigned char *out, size_t len) {
+    if (len < 32) {
+        out[0] = (unsigned char)(0xa0 | len);
+        return 1;
+    } else if (len <= 0xff) {
+        out[0] = 0xd9;
+        out[1] = (unsigned char)len;
+        return 2;
+    } else if (len <= 0xffff) {
+        out[0] = 0xda;
+        store_be(out + 1, len, 2);
+        return 3;
+    }
+
+    out[0] = 0xdb;
+    store_be(out + 1, len, 4);
+    return 5;
+}
+
+static size_t msgpack_container_head(unsigned char *out, int isMap,
+                                     size_t count) {
+    if (count < 16) {
+        out[0] = (unsigned char)((isMap ? 0x80 : 0x90) | count);
+        return 1;
+    } else if (count <= 0xffff) {
+        out[0] = isMap ? 0xde : 0xdc;
+        store_be(out + 1, count, 2);
+        return 3;
+    }
+
+    out[0] = isMap ? 0xdf : 0xdd;
+    store_be(out + 1, count, 4);
+    return 5;
+}
+
+/* the value about to be packed counts towards the open array */
+static void msgpack_count(yajl_pack p) {
+    if (p->depth > 0) {
+        pack_container *c = p->containers + p->open[p->depth - 1];
+        if (!c->isMap) {
+            c->count++;
+        }
+    }
+}
+
+/* the top-level value is complete, make room for the long headers */
+static void msgpack_finish(yajl_pack p) {
+    static const unsigned char zeros[64] = {0};
+    size_t i = p->used, src, dst, extra = p->extra;
+    unsigned char *data;
+
+    p->used = 0;
+    p->extra = 0;
+    if (extra == 0) {
+        return;
+    }
+
+    src = yajl_buf_len(&p->buf);
+    dst = src + extra;
+    while (extra > 0) {
+        const size_t n = extra < sizeof(zeros) ? extra : sizeof(zeros);
+        put(p, zeros, n);
+        extra -= n;
+    }
+
+    /* from the last container to the first, what follows a long header
+     * moves up by the room still to be made at and before it */
+    data = p->buf.data;
+    while (dst != src) {
+        const pack_container *c = p->containers + --i;
+        unsigned char head[5];
+        size_t n = msgpack_container_head(head, c->isMap, c->count);
+
+        if (n == 1) {
+            continue;
+        }
+
+        dst -= src - (c->pos + 1);
+        memmove(data + dst, data + c->pos + 1, src - (c->pos + 1));
+        dst -= n;
+        memcpy(data + dst, head, n);
+        src = c->pos;
+    }
+}
+
+static int msgpack_scalar(yajl_pack p, const unsigned char *data,
+                          size_t len) {
+    msgpack_count(p);
+    put(p, data, len);
+    if (p->depth == 0) {
+        msgpack_finish(p);
+    }
+
+    return 1;
+}
+
+static int msgpack_null(void *ctx) {
+    static const unsigned char nil = 0xc0;
+    return msgpack_scalar(ctx, &nil, 1);
+}
+
+static int msgpack_boolean(void *ctx, int boolean) {
+    const unsigned char b = boolean ? 0xc3 : 0xc2;
+    return msgpack_scalar(ctx, &b, 1);
+}
+
+static int msgpack_integer(void *ctx, long long i) {
+    unsigned char out[9];
+
+    if (i >= 0) {
+        return msgpack_scalar(ctx, out,
+                              msgpack_uint(out, (unsigned long long)i));
+    } else if (i >= -32) {
+        out[0] = (unsigned char)(signed char)i;
+        return msgpack_scalar(ctx, out, 1);
+    } else if (i >= -128) {
+        out[0] = 0xd0;
+        out[1] = (unsigned char)(signed char)i;
+        return msgpack_scalar(ctx, out, 2);
+    } else if (i >= -32768) {
+        out[0] = 0xd1;
+        store_be(out + 1, (unsigned long long)i, 2);
+        return msgpack_scalar(ctx, out, 3);
+    } else if (i >= -2147483647LL - 1) {
+        out[0] = 0xd2;
+        store_be(out + 1, (unsigned long long)i, 4);
+        return msgpack_scalar(ctx, out, 5);
+    }
+
+    out[0] = 0xd3;
+    store_be(out + 1, (unsigned long long)i, 8);
+    return msgpack_scalar(ctx, out, 9);
+}
+
+static int msgpack_unsigned(void *ctx, unsigned long long u) {
+    unsigned char out[9];
+    return msgpack_scalar(ctx, out, msgpack_uint(out, u));
+}
+
+static int msgpack_double(void *ctx, double d) {
+    unsigned char out[9];
+    unsigned long long bits;
+
+    memcpy(&bits, &d, sizeof(bits));
+    out[0] = 0xcb;
+    store_be(out + 1, bits, 8);
+    return msgpack_scalar(ctx, out, 9);
+}
+
+static int msgpack_put_string(yajl_pack p, const unsigned char *s,
+                              size_t len) {
+    unsigned char head[5];
+
+    if (len > 0xffffffffULL) {
+        return 0;
+    }
+
+    put(p, head, msgpack_str_head(head, len));
+    put(p, s, len);
+    return 1;
+}
+
+static int msgpack_string(void *ctx, const unsigned char *s, size_t len) {
+    yajl_pack p = ctx;
+
+    msgpack_count(p);
+    if (!msgpack_put_string(p, s, len)) {
+        return 0;
+    }
+
+    if (p->depth == 0) {
+        msgpack_finish(p);
+    }
+
+    return 1;
+}
+
+static int msgpack_map_key(void *ctx, const unsigned char *s, size_t len) {
+    yajl_pack p = ctx;
+
+    p->containers[p->open[p->depth - 1]].count++;
+    return msgpack_put_string(p, s, len);
+}
+
+static int msgpack_open(yajl_pack p, int isMap) {
+    static const unsigned char header = 0;
+    pack_container *c;
+
+    msgpack_count(p);
+
+    if (p->used == p->cap) {
+        p->cap = p->cap ? p->cap * 2 : 16;
+        p->containers =
+            YA_REALLOC(p->containers, p->cap * sizeof(pack_container));
+    }
+
+    if (p->depth == p->openCap) {
+        p->openCap = p->openCap ? p->openCap * 2 : 16;
+        p->open = YA_REALLOC(p->open, p->openCap * sizeof(size_t));
+    }
+
+    c = p->containers + p->used;
+    c->pos = yajl_buf_len(&p->buf);
+    c->count = 0;
+    c->isMap = isMap;
+    p->open[p->depth++] = p->used++;
+    put(p, &header, 1);
+    return 1;
+}
+
+static int msgpack_close(yajl_pack p) {
+    const pack_container *c = p->containers + p->open[--p->depth];
+    unsigned char head[5];
+    size_t n;
+
+    if (c->count > 0xffffffffULL) {
+        return 0;
+    }
+
+    n = msgpack_container_head(head, c->isMap, c->count);
+    if (n == 1) {
+        p->buf.data[c->pos] = head[0];
+    } else {
+        p->extra += n - 1;
+    }
+
+    if (p->depth == 0) {
+        msgpack_finish(p);
+    }
+
+    return 1;
+}
+
+static int msgpack_start_map(void *ctx) { return msgpack_open(ctx, 1); }
+
+static int msgpack_end_map(void *ctx) { return msgpack_close(ctx); }
+
+static int msgpack_start_array(void *ctx) { return msgpack_open(ctx, 0); }
+
+static int msgpack_end_array(void *ctx) { return msgpack_close(ctx); }
+
+static const yajl_callbacks msgpack_callbacks = {
+    /* null        = */ msgpack_null,
+    /* boolean     = */ msgpack_boolean,
+    /* integer     = */ msgpack_integer,
+    /* double      = */ msgpack_double,
+    /* number      = */ NULL,
+    /* string      = */ msgpack_string,
+    /* start map   = */ msgpack_start_map,
+    /* map key     = */ msgpack_map_key,
+    /* end map     = */ msgpack_end_map,
+    /* start array = */ msgpack_start_array,
+    /* end array   = */ msgpack_end_array,
+    /* unsigned    = */ msgpack_unsigned};
+
+/** CBOR **/
+
+/* the initial byte of a data item and the argument following it */
+static size_t cbor_head(unsigned char *out, unsigned int major,
+                        unsigned long long v) {
+    major <<= 5;
+    if (v < 24) {
+        out[0] = (unsigned char)(major | v);
+        return 1;
+    } else if (v <= 0xff) {
+        out[0] = (unsigned char)(major | 24);
+        out[1] = (unsigned char)v;
+        return 2;
+    } else if (v <= 0xffff) {
+        out[0] = (unsigned char)(major | 25);
+        store_be(out + 1, v, 2);
+        return 3;
+    } else if (v <= 0xffffffffULL) {
+        out[0] = (unsigned char)(major | 26);
+        store_be(out + 1, v, 4);
+        return 5;
+    }
+
+    out[0] = (unsigned char)(major | 27);
+    store_be(out + 1, v, 8);
+    return 9;
+}
+
+static int cbor_byte(void *ctx, unsigned char b) {
+    put(ctx, &b, 1);
+    return 1;
+}
+
+static int cbor_null(void *ctx) { return cbor_byte(ctx, 0xf6); }
+
+static int cbor_boolean(void *ctx, int boolean) {
+    return cbor_byte(ctx, boolean ? 0xf5 : 0xf4);
+}
+
+static int cbor_integer(void *ctx, long long i) {
+    unsigned char out[9];
+
+    /* negative integers are stored as -1 - n */
+    put(ctx, out,
+        i >= 0 ? cbor_head(out, 0, (unsigned long long)i)
+               : cbor_head(out, 1, (unsigned long long)(-(i + 1))));
+    return 1;
+}
+
+static int cbor_unsigned(void *ctx, unsigned long long u) {
+    unsigned char out[9];
+    put(ctx, out, cbor_head(out, 0, u));
+    return 1;
+}
+
+static int cbor_double(void *ctx, double d) {
+    unsigned char out[9];
+    unsigned long long bits;
+
+    memcpy(&bits, &d, sizeof(bits));
+    out[0] = 0xfb;
+    store_be(out + 1, bits, 8);
+    put(ctx, out, 9);
+    return 1;
+}
+
+static int cbor_string(void *ctx, const unsigned char *s, size_t len) {
+    unsigned char head[9];
+
+    put(ctx, head, cbor_head(head, 3, len));
+    put(ctx, s, len);
+    return 1;
+}
+
+/* indefinite length maps and arrays, closed with a "break" */
+static int cbor_start_map(void *ctx) { return cbor_byte(ctx, 0xbf); }
+
+static int cbor_start_array(void *ctx) { return cbor_byte(ctx, 0x9f); }
+
+static int cbor_end(void *ctx) { return cbor_byte(ctx, 0xff); }
+
+static const yajl_callbacks cbor_callbacks = {
+    /* null        = */ cbor_null,
+    /* boolean     = */ cbor_boolean,
+    /* integer     = */ cbor_integer,
+    /* double      = */ cbor_double,
+    /* number      = */ NULL,
+    /* string      = */ cbor_string,
+    /* start map   = */ cbor_start_map,
+    /* map key     = */ cbor_string,
+    /* end map     = */ cbor_end,
+    /* start array = */ cbor_start_array,
+    /* end array   = */ cbor_end,
+    /* unsigned    = */ cbor_unsigned};
+
+const yajl_callbacks *yajl_pack_callbacks(yajl_pack p) {
+    return p->format == yajl_pack_cbor ? &cbor_callbacks : &msgpack_callbacks;
+}
+
+/** reading MessagePack **/
+
+typedef struct {
+    /* values still to come, keys and values both counting for maps */
+    unsigned long long left;
+    int isMap;
+} unpack_frame;
+
+struct yajl_unpack_s {
+    const yajl_callbacks *callbacks;
+    void *ctx;
+    /* the open maps and arrays, innermost last */
+    unpack_frame *frames;
+    size_t depth;
+    size_t framesCap;
+    /* the start of a value which the last chunk ended part way through */
+    yajl_buf_t partial;
+    const char *error;
+};
+
+yajl_unpack yajl_unpack_alloc(const yajl_callbacks *callbacks, void *ctx) {
+    yajl_unpack u = YA_CALLOC(sizeof(struct yajl_unpack_s));
+
+    if (u != NULL) {
+        u->callbacks = callbacks;
+        u->ctx = ctx;
+    }
+
+    return u;
+}
+
+void yajl_unpack_free(yajl_unpack u) {
+    if (u == NULL) {
+        return;
+    }
+
+    yajl_buf_free(&u->partial);
+    YA_FREE(u->frames);
+    YA_FREE(u);
+}
+
+const char *yajl_unpack_error(yajl_unpack u) { return u->error; }
+
+/* the size of the item starting at p: its whole encoding for scalars and
+ * strings, just the header for maps and arrays, or 0 if more than the
+ * avail bytes there are needed to tell.  Bytes which are not read as
+ * anything are one byte long, for unpack_item to reject. */
+static unsigned long long unpack_size(const unsigned char *p, size_t avail) {
+    switch (p[0]) {
+    case 0xca:
+    case 0xce:
+    case 0xd2:
+    case 0xdd:
+    case 0xdf:
+        return 5;
+    case 0xcb:
+    case 0xcf:
+    case 0xd3:
+        return 9;
+    case 0xcc:
+    case 0xd0:
+        return 2;
+    case 0xcd:
+    case 0xd1:
+    case 0xdc:
+    case 0xde:
+        return 3;
+    case 0xd9:
+        return avail < 2 ? 0 : 2 + load_be(p + 1, 1);
+    case 0xda:
+        return avail < 3 ? 0 : 3 + load_be(p + 1, 2);
+    case 0xdb:
+        return avail < 5 ? 0 : 5 + load_be(p + 1, 4);
+    default:
+        if (p[0] >= 0xa0 && p[0] <= 0xbf) {
+            return 1 + (p[0] & 0x1f);
+        }
+
+        return 1;
+    }
+}
+
+#define UNPACK_CHK(x)                                                          \
+    if (!(x)) {                                                                \
+        u->error = "client canceled parse via callback return value";          \
+        return yajl_status_client_canceled;                                    \
+    }
+
+static yajl_status unpack_fail(yajl_unpack u, const char *error) {
+    u->error = error;
+    return yajl_status_error;
+}
+
+/* a value is complete, and with it any containers it was the last of */
+static yajl_status unpack_done(yajl_unpack u) {
+    const yajl_callbacks *cb = u->callbacks;
+
+    while (u->depth > 0) {
+        unpack_frame *f = u->frames + u->depth - 1;
+
+        if (--f->left > 0) {
+            break;
+        }
+
+        u->depth--;
+        if (f->isMap) {
+            if (cb && cb->yajl_end_map) {
+                UNPACK_CHK(cb->yajl_end_map(u->ctx));
+            }
+        } else if (cb && cb->yajl_end_array) {
+            UNPACK_CHK(cb->yajl_end_array(u->ctx));
+        }
+    }
+
+    return yajl_status_ok;
+}
+
+static yajl_status unpack_open(yajl_unpack u, int isMap,
+                               unsigned long long count) {
+    const yajl_callbacks *cb = u->callbacks;
+
+    if (isMap) {
+        if (cb && cb->yajl_start_map) {
+            UNPACK_CHK(cb->yajl_start_map(u->ctx));
+        }
+    } else if (cb && cb->yajl_start_array) {
+        UNPACK_CHK(cb->yajl_start_array(u->ctx));
+    }
+
+    /* empty ones close at once */
+    if (count == 0) {
+        if (isMap) {
+            if (cb && cb->yajl_end_map) {
+                UNPACK_CHK(cb->yajl_end_map(u->ctx));
+            }
+        } else if (cb && cb->yajl_end_array) {
+            UNPACK_CHK(cb->yajl_end_array(u->ctx));
+        }
+
+        return unpack_done(u);
+    }
+
+    if (u->depth == u->framesCap) {
+        u->framesCap = u->framesCap ? u->framesCap * 2 : 16;
+        u->frames = YA_REALLOC(u->frames, u->framesCap * sizeof(unpack_frame));
+    }
+
+    u->frames[u->depth].left = isMap ? count * 2 : count;
+    u->frames[u->depth].isMap = isMap;
+    u->depth++;
+    return yajl_status_ok;
+}
+
+/* as the parser, integers are only converted for yajl_integer and
+ * yajl_unsigned_integer, and go to yajl_number as text if it is set */
+static yajl_status unpack_integer(yajl_unpack u, long long i) {
+    const yajl_callbacks *cb = u->callbacks;
+
+    if (cb && cb->yajl_number) {
+        char text[YAJL_NUMBER_BUF_SIZE];
+        UNPACK_CHK(
+            cb->yajl_number(u->ctx, text, yajl_format_integer(text, i)));
+    } else if (cb && cb->yajl_integer) {
+        UNPACK_CHK(cb->yajl_integer(u->ctx, i));
+    }
+
+    return unpack_done(u);
+}
+
+static yajl_status unpack_unsigned(yajl_unpack u, unsigned long long v) {
+    const yajl_callbacks *cb = u->callbacks;
+
+    if (v <= LLONG_MAX) {
+        return unpack_integer(u, (long long)v);
+    }
+
+    if (cb && cb->yajl_number) {
+        char text[YAJL_NUMBER_BUF_SIZE];
+        char *t = text + sizeof(text);
+        do {
+            *--t = (char)('0' + v % 10);
+            v /= 10;
+        } while (v > 0);
+        UNPACK_CHK(cb->yajl_number(u->ctx, t, text + sizeof(text) - t));
+    } else if (cb && cb->yajl_unsigned_integer) {
+        UNPACK_CHK(cb->yajl_unsigned_integer(u->ctx, v));
+    } else if (cb && cb->yajl_integer) {
+        return unpack_fail(u, "integer overflow");
+    }
+
+    return unpack_done(u);
+}
+
+static yajl_status unpack_double(yajl_unpack u, double d) {
+    const yajl_callbacks *cb = u->callbacks;
+
+    if (cb && cb->yajl_number) {
+        char text[YAJL_NUMBER_BUF_SIZE];
+        if (isnan(d) || isinf(d)) {
+            return unpack_fail(u, "NaN or infinity has no JSON equivalent");
+        }
+
+        UNPACK_CHK(cb->yajl_number(u->ctx, text, yajl_format_double(text, d)));
+    } else if (cb && cb->yajl_double) {
+        UNPACK_CHK(cb->yajl_double(u->ctx, d));
+    }
+
+    return unpack_done(u);
+}
+
+/* hand on the complete item at p, size bytes long */
+static yajl_status unpack_item(yajl_unpack u, const unsigned char *p,
+                               size_t size) {
+    const yajl_callbacks *cb = u->callbacks;
+    const unsigned char b = p[0];
+    const unsigned char *s = NULL;
+    size_t len = 0;
+    unsigned long long bits;
+    unsigned int bits32;
+    float f;
+    double d;
+
+    /* strings have their bytes at the end of the item */
+    if ((b >= 0xa0 && b <= 0xbf) || (b >= 0xd9 && b <= 0xdb)) {
+        len = size - (b <= 0xbf ? 1 : b == 0xd9 ? 2 : b == 0xda ? 3 : 5);
+        s = p + size - len;
+    }
+
+    if (u->depth > 0 && u->frames[u->depth - 1].isMap &&
+        u->frames[u->depth - 1].left % 2 == 0) {
+        if (s == NULL) {
+            return unpack_fail(u, "map key is not a string");
+        }
+
+        if (cb && cb->yajl_map_key) {
+            UNPACK_CHK(cb->yajl_map_key(u->ctx, s, len));
+        }
+
+        return unpack_done(u);
+    }
+
+    if (s != NULL) {
+        if (cb && cb->yajl_string) {
+            UNPACK_CHK(cb->yajl_string(u->ctx, s, len));
+        }
+
+        return unpack_done(u);
+    }
+
+    if (b <= 0x7f) {
+        return unpack_integer(u, b);
+    } else if (b >= 0xe0) {
+        return unpack_integer(u, (signed char)b);
+    } else if (b <= 0x8f) {
+        return unpack_open(u, 1, b & 0x0f);
+    } else if (b <= 0x9f) {
+        return unpack_open(u, 0, b & 0x0f);
+    }
+
+    switch (b) {
+    case 0xc0:
+        if (cb && cb->yajl_null) {
+            UNPACK_CHK(cb->yajl_null(u->ctx));
+        }
+        return unpack_done(u);
+    case 0xc2:
+    case 0xc3:
+        if (cb && cb->yajl_boolean) {
+            UNPACK_CHK(cb->yajl_boolean(u->ctx, b == 0xc3));
+        }
+        return unpack_done(u);
+    case 0xca:
+        bits32 = (unsigned int)load_be(p + 1, 4);
+        memcpy(&f, &bits32, sizeof(f));
+        return unpack_double(u, f);
+    case 0xcb:
+        bits = load_be(p + 1, 8);
+        memcpy(&d, &bits, sizeof(d));
+        return unpack_double(u, d);
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+        return unpack_unsigned(u, load_be(p + 1, size - 1));
+    case 0xd0:
+        return unpack_integer(u, (signed char)p[1]);
+    case 0xd1:
+        return unpack_integer(u, (short)load_be(p + 1, 2));
+    case 0xd2:
+        return unpack_integer(u, (int)load_be(p + 1, 4));
+    case 0xd3:
+        return unpack_integer(u, (long long)load_be(p + 1, 8));
+    case 0xdc:
+    case 0xdd:
+        return unpack_open(u, 0, load_be(p + 1, size - 1));
+    case 0xde:
+    case 0xdf:
+        return unpack_open(u, 1, load_be(p + 1, size - 1));
+    case 0xc1:
+        return unpack_fail(u, "invalid MessagePack byte");
+    default:
+        return unpack_fail(u, "binary and extension types have no JSON "
+                              "equivalent");
+    }
+}
+
+yajl_status yajl_unpack_parse(yajl_unpack u, const unsigned char *data,
+                              size_t len) {
+    yajl_status s;
+
+    if (u->error != NULL) {
+        return yajl_status_error;
+    }
+
+    /* first finish the value the last chunk ended in.  Until its header is
+     * complete its size isn't known, so that is taken a byte at a time. */
+    while (yajl_buf_len(&u->partial) > 0) {
+        const size_t have = yajl_buf_len(&u->partial);
+        const unsigned long long size = unpack_size(u->partial.data, have);
+        unsigned long long take = size == 0 ? 1 : size - have;
+
+        if (take > len) {
+            take = len;
+        }
+
+        if (take == 0) {
+            return yajl_status_ok;
+        }
+
+        yajl_buf_append(&u->partial, data, (size_t)take);
+        data += take;
+        len -= (size_t)take;
+        if (size != 0 && have + take == size) {
+            s = unpack_item(u, u->partial.data, (size_t)size);
+            yajl_buf_clear(&u->partial);
+            if (s != yajl_status_ok) {
+                return s;
+            }
+        }
+    }
+
+    while (len > 0) {
+        const unsigned long long size = unpack_size(data, len);
+
+        if (size == 0 || size > len) {
+            yajl_buf_append(&u->partial, data, len);
+            return yajl_status_ok;
+        }
+
+        s = unpack_item(u, data, (size_t)size);
+        if (s != yajl_status_ok) {
+            return s;
+        }
+
+        data += size;
+        len -= (size_t)size;
+    }
+
+    return yajl_status_ok;
+}
+
+yajl_status yajl_unpack_complete(yajl_unpack u) {
+    if (u->error != NULL) {
+        return yajl_status_error;
+    }
+
+    if (yajl_buf_len(&u->partial) > 0 || u->depth > 0) {
+        return unpack_fail(u, "premature end of input");
+    }
+
+    return yajl_status_ok;
+}
@@ -19,53 +19,152 @@
 #include "yajl_bytestack.h"
 #include "yajl_encode.h"
 #include "yajl_lex.h"
+#include "yajl_trace.h"
 
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
 #include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_VALUE_TO_MULTIPLY ((LLONG_MAX / 10) + (LLONG_MAX % 10))
+/* eight ascii characters as a word, the first in the low byte whatever the
+ * byte order of the machine */
+static unsigned long long yajl_load8(const unsigned char *p) {
+    return (unsigned long long)p[0] | ((unsigned long long)p[1] << 8) |
+           ((unsigned long long)p[2] << 16) |
+           ((unsigned long long)p[3] << 24) |
+           ((unsigned long long)p[4] << 32) |
+           ((unsigned long long)p[5] << 40) |
+           ((unsigned long long)p[6] << 48) | ((unsigned long long)p[7] << 56);
+}
+
+/* non-zero if every byte of the word is in '0'..'9' */
+#define SWAR_ALL_DIGITS(w)                                                     \
+    ((((w)&0xF0F0F0F0F0F0F0F0ULL) |                                            \
+      ((((w) + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==       \
+     0x3333333333333333ULL)
+
+/* the value of eight digits loaded by yajl_load8(), by combining pairs of
+ * digits, then pairs of those, then the two halves */
+static unsigned long long yajl_swar8(unsigned long long w) {
+    w -= 0x3030303030303030ULL;
+    w = (w * 10 + (w >> 8)) & 0x00FF00FF00FF00FFULL;
+    w = (w * 100 + (w >> 16)) & 0x0000FFFF0000FFFFULL;
+    return (w * 10000 + (w >> 32)) & 0xFFFFFFFFULL;
+}
+
+/* up to 19 digits always fit in 64 bits */
+#define MAX_SAFE_DIGITS 19
+
+/* convert 'length' ascii digits to their unsigned 64 bit value, eight at a
+ * time.  returns zero if the value doesn't fit, or if 'validate' is set and
+ * there's anything but digits.  tokens from the lexer are known to be
+ * digits, and their length says whether overflow is possible at all. */
+static int yajl_parse_digits(const unsigned char *pos, size_t length,
+                             int validate, unsigned long long *value) {
+    const int checked = length > MAX_SAFE_DIGITS;
+    unsigned long long ret = 0;
+
+    for (; length >= 8; length -= 8, pos += 8) {
+        const unsigned long long w = yajl_load8(pos);
+        unsigned long long block;
+
+        if (validate && !SWAR_ALL_DIGITS(w)) {
+            return 0;
+        }
+
+        block = yajl_swar8(w);
+        if (checked && ret > (ULLONG_MAX - block) / 100000000) {
+            return 0;
+        }
+
+        ret = ret * 100000000 + block;
+    }
+
+    for (; length > 0; length--, pos++) {
+        const unsigned int digit = *pos - '0';
+
+        if (validate && digit > 9) {
+            return 0;
+        }
+
+        if (checked && ret > (ULLONG_MAX - digit) / 10) {
+            return 0;
+        }
+
+        ret = ret * 10 + digit;
+    }
+
+    *value = ret;
+    return 1;
+}
+
+/* the powers of ten which are exact in a double */
+static const double yajl_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#define MAX_EXACT_POW10 22
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+
+/* the double for a number the lexer has worked out, when that can be done
+ * with a single correctly rounded multiply or divide: the mantissa and the
+ * power of ten are both exact in a double (Clinger's fast path).  returns
+ * zero when strtod is needed instead.  where intermediate results may be
+ * kept in greater precision the rounding can't be relied on, and strtod is
+ * always used. */
+static int yajl_fast_double(const yajl_lex_number_t *n, double *d) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    double v;
+
+    if (!n || n->truncated || n->mantissa > MAX_EXACT_MANTISSA) {
+        return 0;
+    }
+
+    if (n->mantissa == 0) {
+        v = 0.0;
+    } else if (n->exponent < 0 && n->exponent >= -MAX_EXACT_POW10) {
+        v = (double)n->mantissa / yajl_pow10[-n->exponent];
+    } else if (n->exponent >= 0 && n->exponent <= MAX_EXACT_POW10) {
+        v = (double)n->mantissa * yajl_pow10[n->exponent];
+    } else {
+        return 0;
+    }
+
+    *d = n->negative ? -v : v;
+    return 1;
+#else
+    (void)n;
+    (void)d;
+    return 0;
+#endif
+}
 
 /* same semantics as strtol */
 long long yajl_parse_integer(const unsigned char *number, unsigned int length) {
-    long long ret = 0;
-    long sign = 1;
+    unsigned long long magnitude;
+    int negative = 0;
     const unsigned char *pos = number;
     if (*pos == '-') {
         pos++;
-        sign = -1;
+        negative = 1;
     }
 
     if (*pos == '+') {
         pos++;
     }
 
-    while (pos < number + length) {
-        if (ret > MAX_VALUE_TO_MULTIPLY) {
-            errno = ERANGE;
-            return sign == 1 ? LLONG_MAX : LLONG_MIN;
-        }
-
-        ret *= 10;
-        if (LLONG_MAX - ret < (*pos - '0')) {
-            errno = ERANGE;
-            return sign == 1 ? LLONG_MAX : LLONG_MIN;
-        }
-
-        if (*pos < '0' || *pos > '9') {
-            errno = ERANGE;
-            return sign == 1 ? LLONG_MAX : LLONG_MIN;
-        }
-
-        ret += (*pos++ - '0');
+    if (!yajl_parse_digits(pos, length - (pos - number), 1, &magnitude) ||
+        magnitude > LLONG_MAX) {
+        errno = ERANGE;
+        return negative ? LLONG_MIN : LLONG_MAX;
     }
 
-    return sign * ret;
+    return negative ? -(long long)magnitude : (long long)magnitude;
 }
 
 unsigned char *yajl_render_error_string(yajl_handle hand,
@@ -159,10 +258,17 @@ unsigned char *yajl_render_error_string(yajl_handle hand,
 
 /* check for client cancelation */
 #define _CC_CHK(x)                                                             \
-    if (!(x)) {                                                                \
-        yajl_bs_set(hand->stateStack, yajl_state_parse_error);                 \
-        hand->parseError = "client cancelled parse via callback return value"; \
-        return yajl_status_client_canceled;                                    \
+    {                                                                          \
+        int _cc_rv;                                                            \
+        YAJL_PROBE1(callback__entry, tok);                                     \
+        _cc_rv = (x);                                                          \
+        YAJL_PROBE2(callback__return, tok, _cc_rv);                            \
+        if (!_cc_rv) {                                                         \
+            yajl_bs_set(hand->stateStack, yajl_state_parse_error);             \
+            hand->parseError =                                                 \
+                "client cancelled parse via callback return value";            \
+            return yajl_status_client_canceled;                                \
+        }                                                                      \
     }
 
 yajl_status yajl_do_finish(yajl_handle hand) {
@@ -249,12 +355,15 @@ around_again:
             yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
             goto around_again;
         case yajl_tok_string:
+            hand->stats.strings++;
             if (hand->callbacks && hand->callbacks->yajl_string) {
                 _CC_CHK(hand->callbacks->yajl_string(hand->ctx, buf, bufLen));
             }
 
             break;
         case yajl_tok_string_with_escapes:
+            hand->stats.strings++;
+            hand->stats.escapedStrings++;
             if (hand->callbacks && hand->callbacks->yajl_string) {
                 yajl_buf_clear(&hand->decodeBuf);
                 yajl_string_decode(&hand->decodeBuf, buf, bufLen);
@@ -265,18 +374,21 @@ around_again:
 
             break;
         case yajl_tok_bool:
+            hand->stats.booleans++;
             if (hand->callbacks && hand->callbacks->yajl_boolean) {
                 _CC_CHK(hand->callbacks->yajl_boolean(hand->ctx, *buf == 't'));
             }
 
             break;
         case yajl_tok_null:
+            hand->stats.nulls++;
             if (hand->callbacks && hand->callbacks->yajl_null) {
                 _CC_CHK(hand->callbacks->yajl_null(hand->ctx));
             }
 
             break;
         case yajl_tok_left_bracket:
+            hand->stats.maps++;
             if (hand->callbacks && hand->callbacks->yajl_start_map) {
                 _CC_CHK(hand->callbacks->yajl_start_map(hand->ctx));
             }
@@ -284,6 +396,7 @@ around_again:
             stateToPush = yajl_state_map_start;
             break;
         case yajl_tok_left_brace:
+            hand->stats.arrays++;
             if (hand->callbacks && hand->callbacks->yajl_start_array) {
                 _CC_CHK(hand->callbacks->yajl_start_array(hand->ctx));
             }
@@ -291,15 +404,40 @@ around_again:
             stateToPush = yajl_state_array_start;
             break;
         case yajl_tok_integer:
+            hand->stats.integers++;
             if (hand->callbacks) {
                 if (hand->callbacks->yajl_number) {
                     _CC_CHK(hand->callbacks->yajl_number(
                         hand->ctx, (const char *)buf, bufLen));
-                } else if (hand->callbacks->yajl_integer) {
-                    long long int i = 0;
-                    errno = 0;
-                    i = yajl_parse_integer(buf, bufLen);
-                    if ((i == LLONG_MIN || i == LLONG_MAX) && errno == ERANGE) {
+                } else if (hand->callbacks->yajl_integer ||
+                           hand->callbacks->yajl_unsigned_integer) {
+                    /* the lexer has usually worked out the value.  if
+                     * there were more digits than it keeps the number is
+                     * too big for a long long, but might fit unsigned. */
+                    const yajl_lex_number_t *n =
+                        yajl_lex_number_value(hand->lexer);
+                    const int negative = buf[0] == '-';
+                    unsigned long long magnitude = n ? n->mantissa : 0;
+                    int ok = 1;
+                    if (!n || n->truncated) {
+                        YAJL_PROBE2(number__entry, tok, bufLen);
+                        ok = yajl_parse_digits(buf + negative,
+                                               bufLen - negative, 0,
+                                               &magnitude);
+                        YAJL_PROBE1(number__return, tok);
+                    }
+
+                    if (ok && magnitude <= LLONG_MAX) {
+                        if (hand->callbacks->yajl_integer) {
+                            _CC_CHK(hand->callbacks->yajl_integer(
+                                hand->ctx, negative ? -(long long)magnitude
+                                                    : (long long)magnitude));
+                        }
+                    } else if (ok && !negative &&
+                               hand->callbacks->yajl_unsigned_integer) {
+                        _CC_CHK(hand->callbacks->yajl_unsigned_integer(
+                            hand->ctx, magnitude));
+                    } else {
                         yajl_bs_set(hand->stateStack, yajl_state_parse_error);
                         hand->parseError = "integer overflow";
                         /* try to restore error offset */
@@ -311,24 +449,31 @@ around_again:
 
                         goto around_again;
                     }
-
-                    _CC_CHK(hand->callbacks->yajl_integer(hand->ctx, i));
                 }
             }
 
             break;
         case yajl_tok_double:
+            hand->stats.doubles++;
             if (hand->callbacks) {
                 if (hand->callbacks->yajl_number) {
                     _CC_CHK(hand->callbacks->yajl_number(
                         hand->ctx, (const char *)buf, bufLen));
                 } else if (hand->callbacks->yajl_double) {
                     double d = 0.0;
+                    if (yajl_fast_double(yajl_lex_number_value(hand->lexer),
+                                         &d)) {
+                        _CC_CHK(hand->callbacks->yajl_double(hand->ctx, d));
+                        break;
+                    }
+
+                    YAJL_PROBE2(number__entry, tok, bufLen);
                     yajl_buf_clear(&hand->decodeBuf);
                     yajl_buf_append(&hand->decodeBuf, buf, bufLen);
                     buf = yajl_buf_data(&hand->decodeBuf);
                     errno = 0;
                     d = strtod((char *)buf, NULL);
+                    YAJL_PROBE1(number__return, tok);
                     if ((d == HUGE_VAL || d == -HUGE_VAL) && errno == ERANGE) {
                         yajl_bs_set(hand->stateStack, yajl_state_parse_error);
                         hand->parseError = "numeric (floating point) "
@@ -387,6 +532,10 @@ around_again:
 
         if (stateToPush != yajl_state_start) {
             yajl_bs_push(hand->stateStack, stateToPush);
+            /* the bottom of the stack is the top level value's state */
+            if (hand->stateStack.used - 1 > hand->stats.maxDepth) {
+                hand->stats.maxDepth = hand->stateStack.used - 1;
+            }
         }
 
         goto around_again;
@@ -406,6 +555,7 @@ around_again:
             yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
             goto around_again;
         case yajl_tok_string_with_escapes:
+            hand->stats.escapedStrings++;
             if (hand->callbacks && hand->callbacks->yajl_map_key) {
                 yajl_buf_clear(&hand->decodeBuf);
                 yajl_string_decode(&hand->decodeBuf, buf, bufLen);
@@ -415,6 +565,7 @@ around_again:
 
             /* intentional fall-through */
         case yajl_tok_string:
+            hand->stats.keys++;
             if (hand->callbacks && hand->callbacks->yajl_map_key) {
                 _CC_CHK(hand->callbacks->yajl_map_key(hand->ctx, buf, bufLen));
             }
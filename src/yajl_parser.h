@@ -53,6 +53,8 @@ struct yajl_handle_t {
     yajl_bytestack stateStack;
     /* bitfield */
     unsigned int flags;
+    /* value counts and depth, memory use is added by yajl_get_stats() */
+    yajl_stats stats;
 };
 
 yajl_status yajl_do_parse(yajl_handle handle, const unsigned char *jsonText,
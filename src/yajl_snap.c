@@ -0,0 +1,531 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "api/yajl_snap.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(WIN32)
+#define SNAP_NO_MMAP 1
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * A snapshot is a header holding the root node, then the children and text
+ * of every node, depth first.  A container's children are laid out
+ * together right after it so an element is found by indexing, and
+ * everything is padded to 8 bytes so nodes stay aligned.  A node only ever
+ * refers forward, which is what lets yajl_snap_verify() walk a snapshot
+ * without being led around in circles.
+ */
+
+#define SNAP_MAGIC "yajlsnap"
+#define SNAP_VERSION 1
+#define SNAP_BYTE_ORDER 0x01020304
+#define SNAP_ALIGN 8
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    /* SNAP_BYTE_ORDER as written by the machine which saved it */
+    uint32_t byteOrder;
+    uint64_t size;
+    struct yajl_snap_node_s root;
+} snap_header;
+
+struct yajl_snap_s {
+    const char *base;
+    size_t len;
+    /* non-zero if base was mapped by yajl_snap_open, otherwise it was
+     * read into memory by it (owned) or belongs to the caller */
+    int mapped;
+    int owned;
+};
+
+#define NODE_SIZE sizeof(struct yajl_snap_node_s)
+
+static size_t pad(size_t n) {
+    return (n + SNAP_ALIGN - 1) & ~(size_t)(SNAP_ALIGN - 1);
+}
+
+static void format_error(char *buf, size_t bufLen, const char *fmt,
+                         const char *arg) {
+    if (buf != NULL && bufLen > 0) {
+        snprintf(buf, bufLen, fmt, arg);
+    }
+}
+
+/* the bytes below a node, or (size_t)-1 if it can't be stored */
+static size_t measure(yajl_val v) {
+    size_t i, n, size = 0, count;
+
+    switch (v->type) {
+    case yajl_t_string:
+        n = strlen(v->u.string);
+        return n > UINT32_MAX ? (size_t)-1 : pad(n + 1);
+    case yajl_t_number:
+        return pad(v->u.number.len + 1);
+    case yajl_t_object:
+        count = v->u.object.len;
+        if (count > UINT32_MAX) {
+            return (size_t)-1;
+        }
+
+        size = 2 * count * NODE_SIZE;
+        for (i = 0; i < count; i++) {
+            const size_t key = strlen(v->u.object.keys[i]);
+            if (key > UINT32_MAX ||
+                (n = measure(v->u.object.values[i])) == (size_t)-1) {
+                return (size_t)-1;
+            }
+
+            size += pad(key + 1) + n;
+        }
+        return size;
+    case yajl_t_array:
+        count = v->u.array.len;
+        if (count > UINT32_MAX) {
+            return (size_t)-1;
+        }
+
+        size = count * NODE_SIZE;
+        for (i = 0; i < count; i++) {
+            if ((n = measure(v->u.array.values[i])) == (size_t)-1) {
+                return (size_t)-1;
+            }
+
+            size += n;
+        }
+        return size;
+    default:
+        return 0;
+    }
+}
+
+/* copy text to the end of the snapshot and point node at it */
+static void fill_text(char *base, size_t *pos, struct yajl_snap_node_s *node,
+                      const char *text, size_t len) {
+    node->len = (uint32_t)len;
+    node->off = (int64_t)((base + *pos) - (char *)node);
+    memcpy(base + *pos, text, len);
+    /* the terminator and padding are already zero */
+    *pos += pad(len + 1);
+}
+
+static void fill(char *base, size_t *pos, struct yajl_snap_node_s *node,
+                 yajl_val v) {
+    struct yajl_snap_node_s *children;
+    size_t i, count;
+
+    node->type = (uint8_t)v->type;
+
+    switch (v->type) {
+    case yajl_t_string:
+        fill_text(base, pos, node, v->u.string, strlen(v->u.string));
+        break;
+    case yajl_t_number:
+        /* converted now, so that reading never writes to the snapshot */
+        node->flags = (uint8_t)(yajl_tree_number_flags(v) &
+                                (YAJL_NUMBER_INT_VALID |
+                                 YAJL_NUMBER_DOUBLE_VALID));
+        if (node->flags & YAJL_NUMBER_INT_VALID) {
+            node->value.i = yajl_tree_get_integer(v);
+        } else if (node->flags & YAJL_NUMBER_DOUBLE_VALID) {
+            node->value.d = yajl_tree_get_double(v);
+        }
+
+        fill_text(base, pos, node, v->u.number.r, v->u.number.len);
+        break;
+    case yajl_t_object:
+        count = v->u.object.len;
+        children = (struct yajl_snap_node_s *)(base + *pos);
+        node->len = (uint32_t)count;
+        node->off = (int64_t)((char *)children - (char *)node);
+        *pos += 2 * count * NODE_SIZE;
+        for (i = 0; i < count; i++) {
+            const char *key = v->u.object.keys[i];
+            children[i].type = yajl_t_string;
+            fill_text(base, pos, children + i, key, strlen(key));
+            fill(base, pos, children + count + i, v->u.object.values[i]);
+        }
+        break;
+    case yajl_t_array:
+        count = v->u.array.len;
+        children = (struct yajl_snap_node_s *)(base + *pos);
+        node->len = (uint32_t)count;
+        node->off = (int64_t)((char *)children - (char *)node);
+        *pos += count * NODE_SIZE;
+        for (i = 0; i < count; i++) {
+            fill(base, pos, children + i, v->u.array.values[i]);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+size_t yajl_snap_serialize(yajl_val v, void *buf, size_t bufLen) {
+    const size_t below = measure(v);
+    snap_header *header = buf;
+    size_t size, pos;
+
+    if (below == (size_t)-1) {
+        return 0;
+    }
+
+    size = sizeof(snap_header) + below;
+    if (buf == NULL || size > bufLen) {
+        return size;
+    }
+
+    memset(buf, 0, size);
+    memcpy(header->magic, SNAP_MAGIC, sizeof(header->magic));
+    header->version = SNAP_VERSION;
+    header->byteOrder = SNAP_BYTE_ORDER;
+    header->size = size;
+
+    pos = sizeof(snap_header);
+    fill(buf, &pos, &header->root, v);
+
+    return size;
+}
+
+int yajl_snap_save(yajl_val v, const char *filename, char *error_buffer,
+                   size_t error_buffer_size) {
+    const size_t size = yajl_snap_serialize(v, NULL, 0);
+    void *buf;
+    FILE *f;
+    int ok;
+
+    if (size == 0) {
+        format_error(error_buffer, error_buffer_size, "%s",
+                     "tree too big for a snapshot");
+        return 0;
+    }
+
+    buf = malloc(size);
+    if (buf == NULL) {
+        format_error(error_buffer, error_buffer_size, "%s", "out of memory");
+        return 0;
+    }
+
+    yajl_snap_serialize(v, buf, size);
+
+    f = fopen(filename, "wb");
+    if (f == NULL) {
+        format_error(error_buffer, error_buffer_size, "%s", strerror(errno));
+        free(buf);
+        return 0;
+    }
+
+    ok = fwrite(buf, 1, size, f) == size;
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        format_error(error_buffer, error_buffer_size, "%s", strerror(errno));
+    }
+
+    free(buf);
+    return ok;
+}
+
+/* check the header of a snapshot in memory, and make a handle for it */
+static yajl_snap snap_alloc(const void *buf, size_t len, char *error_buffer,
+                            size_t error_buffer_size) {
+    const snap_header *header = buf;
+    yajl_snap s;
+
+    if (((uintptr_t)buf & (SNAP_ALIGN - 1)) != 0) {
+        format_error(error_buffer, error_buffer_size, "%s",
+                     "snapshot is not aligned");
+        return NULL;
+    }
+
+    if (len < sizeof(snap_header) ||
+        memcmp(header->magic, SNAP_MAGIC, sizeof(header->magic)) != 0) {
+        format_error(error_buffer, error_buffer_size, "%s", "not a snapshot");
+        return NULL;
+    }
+
+    if (header->byteOrder != SNAP_BYTE_ORDER ||
+        header->version != SNAP_VERSION) {
+        format_error(error_buffer, error_buffer_size, "%s",
+                     "snapshot is from an incompatible version or machine");
+        return NULL;
+    }
+
+    if (header->size != len) {
+        format_error(error_buffer, error_buffer_size, "%s",
+                     "snapshot is truncated");
+        return NULL;
+    }
+
+    s = malloc(sizeof(*s));
+    if (s == NULL) {
+        format_error(error_buffer, error_buffer_size, "%s", "out of memory");
+        return NULL;
+    }
+
+    s->base = buf;
+    s->len = len;
+    s->mapped = 0;
+    s->owned = 0;
+    return s;
+}
+
+yajl_snap yajl_snap_from_buffer(const void *buf, size_t len,
+                                char *error_buffer,
+                                size_t error_buffer_size) {
+    return snap_alloc(buf, len, error_buffer, error_buffer_size);
+}
+
+#ifndef SNAP_NO_MMAP
+
+yajl_snap yajl_snap_open(const char *filename, char *error_buffer,
+                         size_t error_buffer_size) {
+    struct stat st;
+    void *base;
+    yajl_snap s;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        format_error(error_buffer, error_buffer_size, "%s", strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        format_error(error_buffer, error_buffer_size, "%s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    if ((size_t)st.st_size < sizeof(snap_header)) {
+        format_error(error_buffer, error_buffer_size, "%s", "not a snapshot");
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        format_error(error_buffer, error_buffer_size, "%s", strerror(errno));
+        return NULL;
+    }
+
+    s = snap_alloc(base, (size_t)st.st_size, error_buffer, error_buffer_size);
+    if (s == NULL) {
+        munmap(base, (size_t)st.st_size);
+        return NULL;
+    }
+
+    s->mapped = 1;
+    return s;
+}
+
+#else
+
+/* without mmap the file is read into memory */
+yajl_snap yajl_snap_open(const char *filename, char *error_buffer,
+                         size_t error_buffer_size) {
+    FILE *f = fopen(filename, "rb");
+    char *buf = NULL;
+    size_t len = 0, cap = 0, n;
+    yajl_snap s;
+
+    if (f == NULL) {
+        format_error(error_buffer, error_buffer_size, "%s", strerror(errno));
+        return NULL;
+    }
+
+    do {
+        if (len == cap) {
+            char *grown;
+            cap = cap ? cap * 2 : 65536;
+            grown = realloc(buf, cap);
+            if (grown == NULL) {
+                format_error(error_buffer, error_buffer_size, "%s",
+                             "out of memory");
+                free(buf);
+                fclose(f);
+                return NULL;
+            }
+            buf = grown;
+        }
+
+        n = fread(buf + len, 1, cap - len, f);
+        len += n;
+    } while (n > 0);
+
+    fclose(f);
+
+    s = snap_alloc(buf, len, error_buffer, error_buffer_size);
+    if (s == NULL) {
+        free(buf);
+        return NULL;
+    }
+
+    s->owned = 1;
+    return s;
+}
+
+#endif
+
+void yajl_snap_close(yajl_snap s) {
+    if (s == NULL) {
+        return;
+    }
+
+#ifndef SNAP_NO_MMAP
+    if (s->mapped) {
+        munmap((void *)s->base, s->len);
+    }
+#endif
+
+    if (s->owned) {
+        free((void *)s->base);
+    }
+
+    free(s);
+}
+
+yajl_snap_val yajl_snap_root(yajl_snap s) {
+    return &((const snap_header *)s->base)->root;
+}
+
+/* the data of a node, if it lies after the node and size bytes of it fit
+ * before end */
+static const char *checked_data(yajl_snap_val v, const char *end,
+                                size_t size) {
+    const char *data;
+
+    if (v->off < (int64_t)NODE_SIZE || v->off > end - (const char *)v ||
+        (v->off & (SNAP_ALIGN - 1)) != 0) {
+        return NULL;
+    }
+
+    data = YAJL_SNAP_DATA(v);
+    return size <= (size_t)(end - data) ? data : NULL;
+}
+
+int yajl_snap_verify(yajl_snap s) {
+    const char *end = s->base + s->len;
+    /* as no two nodes share children in a snapshot we wrote, the nodes
+     * waiting to be checked can never outnumber those that fit */
+    const size_t maxNodes = s->len / NODE_SIZE;
+    yajl_snap_val *stack = malloc(maxNodes * sizeof(yajl_snap_val));
+    size_t used = 0, visited = 0, i;
+    int ok = stack != NULL;
+
+    if (ok) {
+        stack[used++] = yajl_snap_root(s);
+    }
+
+    while (ok && used > 0) {
+        yajl_snap_val v = stack[--used];
+        yajl_snap_val children;
+        const char *data;
+        size_t count;
+
+        if (++visited > maxNodes) {
+            ok = 0;
+            break;
+        }
+
+        switch (v->type) {
+        case yajl_t_string:
+        case yajl_t_number:
+            data = checked_data(v, end, (size_t)v->len + 1);
+            ok = data != NULL && data[v->len] == 0;
+            break;
+        case yajl_t_object:
+        case yajl_t_array:
+            count = v->len;
+            if (v->type == yajl_t_object) {
+                count *= 2;
+            }
+
+            children = (yajl_snap_val)checked_data(v, end, count * NODE_SIZE);
+            if (children == NULL || used + count > maxNodes) {
+                ok = 0;
+                break;
+            }
+
+            for (i = 0; i < count; i++) {
+                /* keys must be strings */
+                if (v->type == yajl_t_object && i < v->len &&
+                    children[i].type != yajl_t_string) {
+                    ok = 0;
+                    break;
+                }
+
+                stack[used++] = children + i;
+            }
+            break;
+        case yajl_t_true:
+        case yajl_t_false:
+        case yajl_t_null:
+            break;
+        default:
+            ok = 0;
+            break;
+        }
+    }
+
+    free(stack);
+    return ok;
+}
+
+yajl_snap_val yajl_snap_get(yajl_snap_val n, const char **path,
+                            yajl_type type) {
+    if (!path) {
+        return NULL;
+    }
+
+    while (n && *path) {
+        size_t i, len;
+
+        if (n->type != yajl_t_object) {
+            return NULL;
+        }
+
+        len = n->len;
+        for (i = 0; i < len; i++) {
+            if (!strcmp(*path, YAJL_SNAP_GET_KEY(n, i))) {
+                n = YAJL_SNAP_GET_VALUE(n, i);
+                break;
+            }
+        }
+
+        if (i == len) {
+            return NULL;
+        }
+
+        path++;
+    }
+
+    if (n && type != yajl_t_any && type != n->type) {
+        n = NULL;
+    }
+
+    return n;
+}
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "api/yajl_tape.h"
+#include "yajl_alloc.h"
+#include "yajl_buf.h"
+#include "yajl_encode.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A tape is a run of records, each a tag byte and what follows it:
+ *
+ *   integer          the value, zigzag varint
+ *   unsigned         the value (above LLONG_MAX), varint
+ *   double           the value, 8 bytes, then the text: varint length, bytes
+ *   bad_integer,
+ *   bad_double       the text of a number too big to convert
+ *   string, key      varint length, the decoded bytes
+ *
+ * and nothing for the rest.  An integer's text is written out again when
+ * replayed to yajl_number, which gives back the original for any integer
+ * but -0, so that has its own tag.
+ */
+
+typedef enum {
+    tape_null,
+    tape_false,
+    tape_true,
+    tape_integer,
+    tape_negative_zero,
+    tape_unsigned,
+    tape_double,
+    tape_bad_integer,
+    tape_bad_double,
+    tape_string,
+    tape_key,
+    tape_map_open,
+    tape_map_close,
+    tape_array_open,
+    tape_array_close
+} tape_tag;
+
+/* the most bytes a tag and a varint can take */
+#define TAPE_HEADER_MAX 11
+
+struct yajl_tape_s {
+    yajl_buf_t buf;
+};
+
+yajl_tape yajl_tape_alloc(void) {
+    return YA_CALLOC(sizeof(struct yajl_tape_s));
+}
+
+void yajl_tape_free(yajl_tape tape) {
+    if (tape == NULL) {
+        return;
+    }
+
+    yajl_buf_free(&tape->buf);
+    YA_FREE(tape);
+}
+
+void yajl_tape_clear(yajl_tape tape) {
+    yajl_buf_clear(&tape->buf);
+}
+
+const unsigned char *yajl_tape_data(yajl_tape tape, size_t *len) {
+    *len = yajl_buf_len(&tape->buf);
+    return yajl_buf_data(&tape->buf);
+}
+
+/** recording **/
+
+static size_t put_varint(unsigned char *out, unsigned long long v) {
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+static void record_tag(yajl_tape tape, tape_tag tag) {
+    const unsigned char t = (unsigned char)tag;
+    yajl_buf_append(&tape->buf, &t, 1);
+}
+
+/* a tag, then text with its length */
+static void record_text(yajl_tape tape, tape_tag tag, const void *text,
+                        size_t len) {
+    unsigned char header[TAPE_HEADER_MAX];
+
+    header[0] = (unsigned char)tag;
+    yajl_buf_append(&tape->buf, header, 1 + put_varint(header + 1, len));
+    yajl_buf_append(&tape->buf, text, len);
+}
+
+static int rec_null(void *ctx) {
+    record_tag(ctx, tape_null);
+    return 1;
+}
+
+static int rec_boolean(void *ctx, int boolean) {
+    record_tag(ctx, boolean ? tape_true : tape_false);
+    return 1;
+}
+
+/* integers; any that would overflow in the parser are kept as text */
+static void record_integer(yajl_tape tape, const char *s, size_t len) {
+    const int negative = s[0] == '-';
+    unsigned char record[TAPE_HEADER_MAX];
+    unsigned long long magnitude = 0;
+    size_t i;
+
+    for (i = negative; i < len; i++) {
+        const unsigned int digit = (unsigned int)(s[i] - '0');
+        if (magnitude > (ULLONG_MAX - digit) / 10) {
+            record_text(tape, tape_bad_integer, s, len);
+            return;
+        }
+
+        magnitude = magnitude * 10 + digit;
+    }
+
+    if (magnitude <= LLONG_MAX) {
+        if (negative && magnitude == 0) {
+            record_tag(tape, tape_negative_zero);
+            return;
+        }
+
+        /* zigzag, so that small negative numbers are short too */
+        record[0] = tape_integer;
+        magnitude = negative ? ((magnitude - 1) << 1) | 1 : magnitude << 1;
+        yajl_buf_append(&tape->buf, record,
+                        1 + put_varint(record + 1, magnitude));
+    } else if (!negative) {
+        record[0] = tape_unsigned;
+        yajl_buf_append(&tape->buf, record,
+                        1 + put_varint(record + 1, magnitude));
+    } else {
+        record_text(tape, tape_bad_integer, s, len);
+    }
+}
+
+/* returns zero if out of memory */
+static int record_double(yajl_tape tape, const char *s, size_t len) {
+    unsigned char record[TAPE_HEADER_MAX + sizeof(double)];
+    char local[64];
+    char *text = local;
+    double d;
+
+    if (len >= sizeof(local)) {
+        text = YA_REALLOC(NULL, len + 1);
+        if (text == NULL) {
+            return 0;
+        }
+    }
+
+    memcpy(text, s, len);
+    text[len] = 0;
+    errno = 0;
+    d = strtod(text, NULL);
+    if (text != local) {
+        YA_FREE(text);
+    }
+
+    /* as the parser, only overflow is an error */
+    if ((d == HUGE_VAL || d == -HUGE_VAL) && errno == ERANGE) {
+        record_text(tape, tape_bad_double, s, len);
+        return 1;
+    }
+
+    record[0] = tape_double;
+    memcpy(record + 1, &d, sizeof(d));
+    yajl_buf_append(&tape->buf, record,
+                    1 + sizeof(d) + put_varint(record + 1 + sizeof(d), len));
+    yajl_buf_append(&tape->buf, s, len);
+    return 1;
+}
+
+static int rec_number(void *ctx, const char *s, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (s[i] == '.' || s[i] == 'e' || s[i] == 'E') {
+            return record_double(ctx, s, len);
+        }
+    }
+
+    record_integer(ctx, s, len);
+    return 1;
+}
+
+static int rec_string(void *ctx, const unsigned char *s, size_t len) {
+    record_text(ctx, tape_string, s, len);
+    return 1;
+}
+
+static int rec_map_key(void *ctx, const unsigned char *s, size_t len) {
+    record_text(ctx, tape_key, s, len);
+    return 1;
+}
+
+static int rec_start_map(void *ctx) {
+    record_tag(ctx, tape_map_open);
+    return 1;
+}
+
+static int rec_end_map(void *ctx) {
+    record_tag(ctx, tape_map_close);
+    return 1;
+}
+
+static int rec_start_array(void *ctx) {
+    record_tag(ctx, tape_array_open);
+    return 1;
+}
+
+static int rec_end_array(void *ctx) {
+    record_tag(ctx, tape_array_close);
+    return 1;
+}
+
+/* numbers are taken as text, so that a replay to yajl_number can hand back
+ * what was parsed */
+static const yajl_callbacks recorder = {
+    /* null        = */ rec_null,
+    /* boolean     = */ rec_boolean,
+    /* integer     = */ NULL,
+    /* double      = */ NULL,
+    /* number      = */ rec_number,
+    /* string      = */ rec_string,
+    /* start map   = */ rec_start_map,
+    /* map key     = */ rec_map_key,
+    /* end map     = */ rec_end_map,
+    /* start array = */ rec_start_array,
+    /* end array   = */ rec_end_array,
+    /* unsigned    = */ NULL};
+
+const yajl_callbacks *yajl_tape_recorder(void) {
+    return &recorder;
+}
+
+/** replay **/
+
+#define REPLAY_CHK(x)                                                          \
+    if (!(x)) {                                                                \
+        return yajl_status_client_canceled;                                    \
+    }
+
+yajl_status yajl_tape_replay(yajl_tape tape, const yajl_callbacks *callbacks,
+                             void *ctx) {
+    size_t len;
+    const unsigned char *data = yajl_tape_data(tape, &len);
+
+    return yajl_tape_replay_buffer(data, len, callbacks, ctx);
+}
+
+yajl_status yajl_tape_replay_buffer(const unsigned char *data, size_t len,
+                                    const yajl_callbacks *cb, void *ctx) {
+    const unsigned char *p = data;
+    const unsigned char *end = data + len;
+    /* as the parser, integers are only converted for these callbacks */
+    const int wantIntegers =
+        cb && (cb->yajl_integer || cb->yajl_unsigned_integer);
+    char text[YAJL_NUMBER_BUF_SIZE];
+
+    while (p < end) {
+        const tape_tag tag = (tape_tag)*p++;
+        unsigned long long v = 0;
+        unsigned int shift = 0;
+        double d = 0;
+        size_t n;
+
+        /* every record but the bare tags has a varint next, or a double
+         * and then a varint */
+        if (tag == tape_double) {
+            if ((size_t)(end - p) < sizeof(d)) {
+                return yajl_status_error;
+            }
+
+            memcpy(&d, p, sizeof(d));
+            p += sizeof(d);
+        }
+
+        switch (tag) {
+        case tape_integer:
+        case tape_unsigned:
+        case tape_double:
+        case tape_bad_integer:
+        case tape_bad_double:
+        case tape_string:
+        case tape_key:
+            for (;;) {
+                if (p == end || shift > 63) {
+                    return yajl_status_error;
+                }
+
+                v |= (unsigned long long)(*p & 0x7F) << shift;
+                shift += 7;
+                if (!(*p++ & 0x80)) {
+                    break;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+
+        switch (tag) {
+        case tape_null:
+            if (cb && cb->yajl_null) {
+                REPLAY_CHK(cb->yajl_null(ctx));
+            }
+            break;
+        case tape_false:
+        case tape_true:
+            if (cb && cb->yajl_boolean) {
+                REPLAY_CHK(cb->yajl_boolean(ctx, tag == tape_true));
+            }
+            break;
+        case tape_integer: {
+            /* undo the zigzag */
+            const long long i = (v & 1) ? -(long long)(v >> 1) - 1
+                                        : (long long)(v >> 1);
+            if (cb && cb->yajl_number) {
+                n = yajl_format_integer(text, i);
+                REPLAY_CHK(cb->yajl_number(ctx, text, n));
+            } else if (wantIntegers && cb->yajl_integer) {
+                REPLAY_CHK(cb->yajl_integer(ctx, i));
+            }
+            break;
+        }
+        case tape_negative_zero:
+            if (cb && cb->yajl_number) {
+                REPLAY_CHK(cb->yajl_number(ctx, "-0", 2));
+            } else if (wantIntegers && cb->yajl_integer) {
+                REPLAY_CHK(cb->yajl_integer(ctx, 0));
+            }
+            break;
+        case tape_unsigned:
+            if (cb && cb->yajl_number) {
+                char *t = text + sizeof(text);
+                do {
+                    *--t = (char)('0' + v % 10);
+                    v /= 10;
+                } while (v > 0);
+                REPLAY_CHK(cb->yajl_number(ctx, t, text + sizeof(text) - t));
+            } else if (wantIntegers) {
+                if (!cb->yajl_unsigned_integer) {
+                    return yajl_status_error;
+                }
+
+                REPLAY_CHK(cb->yajl_unsigned_integer(ctx, v));
+            }
+            break;
+        case tape_string:
+        case tape_key:
+        case tape_double:
+        case tape_bad_integer:
+        case tape_bad_double:
+            if ((size_t)(end - p) < v) {
+                return yajl_status_error;
+            }
+
+            n = (size_t)v;
+            if (tag == tape_string) {
+                if (cb && cb->yajl_string) {
+                    REPLAY_CHK(cb->yajl_string(ctx, p, n));
+                }
+            } else if (tag == tape_key) {
+                if (cb && cb->yajl_map_key) {
+                    REPLAY_CHK(cb->yajl_map_key(ctx, p, n));
+                }
+            } else if (cb && cb->yajl_number) {
+                REPLAY_CHK(cb->yajl_number(ctx, (const char *)p, n));
+            } else if (tag == tape_double) {
+                if (cb && cb->yajl_double) {
+                    REPLAY_CHK(cb->yajl_double(ctx, d));
+                }
+            } else if (tag == tape_bad_double ? cb && cb->yajl_double
+                                              : wantIntegers) {
+                return yajl_status_error;
+            }
+
+            p += n;
+            break;
+        case tape_map_open:
+            if (cb && cb->yajl_start_map) {
+                REPLAY_CHK(cb->yajl_start_map(ctx));
+            }
+            break;
+        case tape_map_close:
+            if (cb && cb->yajl_end_map) {
+                REPLAY_CHK(cb->yajl_end_map(ctx));
+            }
+            break;
+        case tape_array_open:
+            if (cb && cb->yajl_start_array) {
+                REPLAY_CHK(cb->yajl_start_array(ctx));
+            }
+            break;
+        case tape_array_close:
+            if (cb && cb->yajl_end_array) {
+                REPLAY_CHK(cb->yajl_end_array(ctx));
+            }
+            break;
+        default:
+            return yajl_status_error;
+        }
+    }
+
+    return yajl_status_ok;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __YAJL_TRACE_H__
+#define __YAJL_TRACE_H__
+
+/*
+ * Static trace points on the parser's hot paths, for finding out where the
+ * time goes in a slow parse without rebuilding the application.  They are
+ * compiled in only when the library is configured with -DYAJL_TRACE=ON, in
+ * which case each one is a USDT probe (a single nop until a tracer such as
+ * bpftrace or perf attaches).  Otherwise they expand to nothing.
+ *
+ * Probes in the "yajl" provider:
+ *   lex__token(tok, len)          a token was lexed, tok is a yajl_tok
+ *   lex__splice(len)              a token split across yajl_parse() calls
+ *                                 was completed from the lexer's buffer
+ *   lex__carry(len)               a chunk ended mid-token, len bytes were
+ *                                 copied aside
+ *   decode__entry(len)            yajl_string_decode() is about to unescape
+ *   decode__return(len)           ... and produced len bytes
+ *   number__entry(tok, len)       an integer or double is being converted
+ *   number__return(tok)
+ *   callback__entry(tok)          a user callback is being called for tok
+ *   callback__return(tok, rv)     ... and returned rv
+ *
+ * perf/yajl.bt is a sample bpftrace script built on these.
+ */
+
+#ifdef YAJL_TRACE_PROBES
+#include <sys/sdt.h>
+
+#define YAJL_PROBE1(name, a) DTRACE_PROBE1(yajl, name, a)
+#define YAJL_PROBE2(name, a, b) DTRACE_PROBE2(yajl, name, a, b)
+#else
+#define YAJL_PROBE1(name, a)
+#define YAJL_PROBE2(name, a, b)
+#endif
+
+#endif
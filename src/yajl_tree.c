@@ -16,6 +16,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +24,7 @@
 #include "api/yajl_parse.h"
 #include "api/yajl_tree.h"
 
+#include "yajl_encode.h"
 #include "yajl_parser.h"
 
 #if defined(_WIN32) || defined(WIN32)
@@ -40,11 +42,96 @@ struct stack_elem_s {
     stack_elem_t *next;
 };
 
+/*
+ * Object keys are interned: while parsing, a table of the keys seen so far
+ * gives each repeated key the copy made the first time it was seen, so an
+ * array of records holds one copy of each field name rather than one per
+ * record.  A key's copy is preceded by the number of objects using it, and
+ * is freed with the last of them.
+ */
+typedef struct {
+    size_t refs;
+} key_head_t;
+
+typedef struct {
+    char *key;
+    size_t len;
+    unsigned int hash;
+} intern_slot_t;
+
+typedef struct {
+    /* open addressing, a power of two in size and at most half full */
+    intern_slot_t *slots;
+    size_t count;
+    size_t cap;
+    /* what the interned keys take up, for yajl_tree_parse_stats */
+    size_t bytes;
+} intern_table_t;
+
+/*
+ * Objects share their keys array too.  Until an object is complete its
+ * keys are kept on a stack in the context; then it is given the array of
+ * the first object with the same keys in the same order, its shape.  A
+ * shape is a header followed by the keys.  Once a second object has it, a
+ * shape with enough keys that scanning them would be slow is given an
+ * index from key to slot.  Like a key, it counts the objects using it.
+ */
+#define SHAPE_INDEX_MIN 8
+
+/* an object's flags when the parser gave it a shape, and the mark of a
+ * live shape, see object_shape() */
+#define SHAPE_OBJECT_FLAGS (YAJL_OBJECT_SHARED_KEYS | 0x5a4e3c00u)
+#define SHAPE_MAGIC 0x73686170u
+
+typedef struct {
+    unsigned int magic;
+    size_t refs;
+    size_t len;
+    /* slot + 1 of each key by its hash, 0 for empty, or NULL */
+    unsigned int *index;
+} shape_head_t;
+
+/* the size of the index of a shape of 'len' keys, a power of two */
+static size_t shape_index_cap(size_t len) {
+    size_t cap = 16;
+
+    while (cap < len + len / 2) {
+        cap *= 2;
+    }
+
+    return cap;
+}
+
+typedef struct {
+    shape_head_t *shape;
+    unsigned int hash;
+} shape_slot_t;
+
+typedef struct {
+    shape_slot_t *slots;
+    size_t count;
+    size_t cap;
+    /* what the shapes and their indexes take up */
+    size_t indexes;
+    size_t bytes;
+} shape_table_t;
+
 struct context_s {
     stack_elem_t *stack;
     yajl_val root;
     char *errbuf;
     size_t errbuf_size;
+    /* yajl_tree_option flags, and the text being parsed */
+    unsigned int options;
+    const char *input;
+    size_t input_length;
+    intern_table_t keys;
+    /* the keys of the objects being built, outermost first.  those of
+     * the innermost are on top, as many as it has values */
+    const char **keyStack;
+    size_t keysUsed;
+    size_t keysCap;
+    shape_table_t shapes;
 };
 typedef struct context_s context_t;
 
@@ -55,10 +142,11 @@ typedef struct context_s context_t;
         return (retval);                                                       \
     }
 
-static yajl_val value_alloc(yajl_type type) {
+/* allocate a node, with 'extra' bytes after it for a number's text */
+static yajl_val value_alloc_extra(yajl_type type, size_t extra) {
     yajl_val v;
 
-    v = malloc(sizeof(*v));
+    v = malloc(sizeof(*v) + extra);
     if (v == NULL) {
         return (NULL);
     }
@@ -69,7 +157,286 @@ static yajl_val value_alloc(yajl_type type) {
     return (v);
 }
 
+static yajl_val value_alloc(yajl_type type) {
+    return value_alloc_extra(type, 0);
+}
+
+static unsigned int key_hash(const unsigned char *s, size_t len) {
+    /* FNV-1a */
+    unsigned int h = 2166136261u;
+
+    while (len-- > 0) {
+        h = (h ^ *s++) * 16777619u;
+    }
+
+    return h;
+}
+
+/* the shared copy of a key, with a reference taken for its new user, or
+ * NULL if out of memory */
+static char *key_intern(context_t *ctx, const unsigned char *s, size_t len) {
+    intern_table_t *t = &ctx->keys;
+    const unsigned int hash = key_hash(s, len);
+    intern_slot_t *slot;
+    key_head_t *head;
+    size_t i;
+
+    if (t->count >= t->cap / 2) {
+        const size_t cap = t->cap ? t->cap * 2 : 64;
+        intern_slot_t *slots = calloc(cap, sizeof(*slots));
+
+        if (slots == NULL) {
+            return NULL;
+        }
+
+        for (i = 0; i < t->cap; i++) {
+            if (t->slots[i].key != NULL) {
+                size_t j = t->slots[i].hash & (cap - 1);
+                while (slots[j].key != NULL) {
+                    j = (j + 1) & (cap - 1);
+                }
+                slots[j] = t->slots[i];
+            }
+        }
+
+        free(t->slots);
+        t->slots = slots;
+        t->cap = cap;
+    }
+
+    for (i = hash & (t->cap - 1);; i = (i + 1) & (t->cap - 1)) {
+        slot = t->slots + i;
+        if (slot->key == NULL) {
+            break;
+        }
+
+        if (slot->hash == hash && slot->len == len &&
+            !memcmp(slot->key, s, len)) {
+            ((key_head_t *)slot->key - 1)->refs++;
+            return slot->key;
+        }
+    }
+
+    head = malloc(sizeof(*head) + len + 1);
+    if (head == NULL) {
+        return NULL;
+    }
+
+    head->refs = 1;
+    slot->key = (char *)(head + 1);
+    slot->len = len;
+    slot->hash = hash;
+    memcpy(slot->key, s, len);
+    slot->key[len] = 0;
+    t->count++;
+    t->bytes += sizeof(*head) + len + 1;
+    return slot->key;
+}
+
+static void key_release(const char *key) {
+    key_head_t *head = (key_head_t *)key - 1;
+
+    if (--head->refs == 0) {
+        free(head);
+    }
+}
+
+/* keys are interned, so a run of them is told apart by their addresses */
+static unsigned int shape_hash(const char **keys, size_t len) {
+    unsigned long long h = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (unsigned long long)(uintptr_t)keys[i]) * 1099511628211ULL;
+    }
+
+    /* addresses differ mostly in their middle bits, which the multiplies
+     * only carry upwards, so mix the high bits back down */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (unsigned int)h;
+}
+
+/* index a shape.  Without one, which is only slower, if out of memory */
+static void shape_index(shape_table_t *t, shape_head_t *head) {
+    const char **keys = (const char **)(head + 1);
+    const size_t cap = shape_index_cap(head->len);
+    size_t i;
+
+    head->index = calloc(cap, sizeof(*head->index));
+    if (head->index == NULL) {
+        return;
+    }
+
+    for (i = 0; i < head->len; i++) {
+        size_t j =
+            key_hash((const unsigned char *)keys[i], strlen(keys[i])) &
+            (cap - 1);
+
+        /* a repeated key is found at its first slot */
+        while (head->index[j] != 0 && keys[head->index[j] - 1] != keys[i]) {
+            j = (j + 1) & (cap - 1);
+        }
+
+        if (head->index[j] == 0) {
+            head->index[j] = (unsigned int)i + 1;
+        }
+    }
+
+    t->indexes++;
+    t->bytes += cap * sizeof(*head->index);
+}
+
+/* the shared keys array for the 'len' keys, whose references it takes
+ * over, or NULL if out of memory */
+static const char **shape_intern(context_t *ctx, const char **keys,
+                                 size_t len) {
+    shape_table_t *t = &ctx->shapes;
+    const unsigned int hash = shape_hash(keys, len);
+    shape_slot_t *slot;
+    shape_head_t *head;
+    const char **shapeKeys;
+    size_t i, bytes;
+
+    if (t->count >= t->cap / 2) {
+        const size_t cap = t->cap ? t->cap * 2 : 64;
+        shape_slot_t *slots = calloc(cap, sizeof(*slots));
+
+        if (slots == NULL) {
+            return NULL;
+        }
+
+        for (i = 0; i < t->cap; i++) {
+            if (t->slots[i].shape != NULL) {
+                size_t j = t->slots[i].hash & (cap - 1);
+                while (slots[j].shape != NULL) {
+                    j = (j + 1) & (cap - 1);
+                }
+                slots[j] = t->slots[i];
+            }
+        }
+
+        free(t->slots);
+        t->slots = slots;
+        t->cap = cap;
+    }
+
+    for (i = hash & (t->cap - 1);; i = (i + 1) & (t->cap - 1)) {
+        slot = t->slots + i;
+        if (slot->shape == NULL) {
+            break;
+        }
+
+        shapeKeys = (const char **)(slot->shape + 1);
+        if (slot->hash == hash && slot->shape->len == len &&
+            !memcmp(shapeKeys, keys, len * sizeof(*keys))) {
+            /* the shape holds the keys already */
+            for (i = 0; i < len; i++) {
+                key_release(keys[i]);
+            }
+
+            if (++slot->shape->refs == 2 && len >= SHAPE_INDEX_MIN) {
+                shape_index(t, slot->shape);
+            }
+
+            return shapeKeys;
+        }
+    }
+
+    bytes = sizeof(*head) + len * sizeof(*keys);
+    head = malloc(bytes);
+    if (head == NULL) {
+        return NULL;
+    }
+
+    head->magic = SHAPE_MAGIC;
+    head->refs = 1;
+    head->len = len;
+    head->index = NULL;
+    shapeKeys = (const char **)(head + 1);
+    memcpy(shapeKeys, keys, len * sizeof(*keys));
+
+    slot->shape = head;
+    slot->hash = hash;
+    t->count++;
+    t->bytes += bytes;
+    return shapeKeys;
+}
+
+static void shape_release(shape_head_t *head) {
+    const char **keys = (const char **)(head + 1);
+    size_t i;
+
+    if (--head->refs == 0) {
+        for (i = 0; i < head->len; i++) {
+            key_release(keys[i]);
+        }
+
+        head->magic = 0;
+        free(head->index);
+        free(head);
+    }
+}
+
+/* the shape of an object from a parse, or NULL for one built by hand.
+ * code older than the flags may leave them uninitialized, so the flag
+ * alone isn't trusted: only with the parser's whole word of flags is the
+ * header looked at, and it must be a live shape of as many keys */
+static shape_head_t *object_shape(yajl_val obj) {
+    shape_head_t *head;
+
+    if (obj->u.object.flags != SHAPE_OBJECT_FLAGS ||
+        obj->u.object.len == 0 || obj->u.object.keys == NULL) {
+        return NULL;
+    }
+
+    head = (shape_head_t *)obj->u.object.keys - 1;
+    if (head->magic != SHAPE_MAGIC || head->len != obj->u.object.len) {
+        return NULL;
+    }
+
+    return head;
+}
+
+/* the slot of 'key' in an object, or its length if it hasn't the key.
+ * only objects from a parse have a shape, and maybe an index */
+static size_t object_find(yajl_val obj, const char *key) {
+    const char **keys = obj->u.object.keys;
+    const size_t len = obj->u.object.len;
+    const shape_head_t *head;
+    size_t i;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    head = object_shape(obj);
+    if (head != NULL && head->index != NULL) {
+        const unsigned int *index = head->index;
+        const size_t mask = shape_index_cap(len) - 1;
+        for (i = key_hash((const unsigned char *)key, strlen(key)) & mask;
+             index[i] != 0; i = (i + 1) & mask) {
+            const size_t slot = index[i] - 1;
+            if (keys[slot] == key || !strcmp(key, keys[slot])) {
+                return slot;
+            }
+        }
+
+        return len;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (keys[i] == key || !strcmp(key, keys[i])) {
+            break;
+        }
+    }
+
+    return i;
+}
+
 static void yajl_object_free(yajl_val v) {
+    shape_head_t *head;
     size_t i;
 
     if (!YAJL_IS_OBJECT(v)) {
@@ -77,13 +444,38 @@ static void yajl_object_free(yajl_val v) {
     }
 
     for (i = 0; i < v->u.object.len; i++) {
-        free((char *)v->u.object.keys[i]);
-        v->u.object.keys[i] = NULL;
         yajl_tree_free(v->u.object.values[i]);
         v->u.object.values[i] = NULL;
     }
 
-    free((void *)v->u.object.keys);
+    head = object_shape(v);
+    if (head != NULL) {
+        shape_release(head);
+        /* so that a node built by hand in this memory isn't taken for
+         * one from a parse */
+        v->u.object.flags = 0;
+    } else {
+        for (i = 0; i < v->u.object.len; i++) {
+            free((char *)v->u.object.keys[i]);
+        }
+
+        free((void *)v->u.object.keys);
+    }
+
+    free(v->u.object.values);
+    free(v);
+}
+
+/* free an unfinished object, whose keys are still in 'keys' rather than
+ * in a shape */
+static void object_discard(yajl_val v, const char **keys) {
+    size_t i;
+
+    for (i = 0; i < v->u.object.len; i++) {
+        key_release(keys[i]);
+        yajl_tree_free(v->u.object.values[i]);
+    }
+
     free(v->u.object.values);
     free(v);
 }
@@ -149,7 +541,6 @@ static yajl_val context_pop(context_t *ctx) {
 
 static int object_add_keyval(context_t *ctx, yajl_val obj, char *key,
                              yajl_val value) {
-    const char **tmpk;
     yajl_val *tmpv;
 
     /* We're checking for NULL in "context_add_value" or its callers. */
@@ -161,19 +552,28 @@ static int object_add_keyval(context_t *ctx, yajl_val obj, char *key,
     /* We're assuring that "obj" is an object in "context_add_value". */
     assert(YAJL_IS_OBJECT(obj));
 
-    tmpk = realloc((void *)obj->u.object.keys,
-                   sizeof(*(obj->u.object.keys)) * (obj->u.object.len + 1));
-    if (tmpk == NULL)
-        RETURN_ERROR(ctx, ENOMEM, "Out of memory");
-    obj->u.object.keys = tmpk;
+    /* the keys wait on the key stack until the object is complete */
+    if (ctx->keysUsed == ctx->keysCap) {
+        const size_t cap = ctx->keysCap ? ctx->keysCap * 2 : 64;
+        const char **tmpk = realloc((void *)ctx->keyStack,
+                                    cap * sizeof(*ctx->keyStack));
+        if (tmpk == NULL) {
+            key_release(key);
+            RETURN_ERROR(ctx, ENOMEM, "Out of memory");
+        }
+        ctx->keyStack = tmpk;
+        ctx->keysCap = cap;
+    }
 
     tmpv = realloc(obj->u.object.values,
                    sizeof(*obj->u.object.values) * (obj->u.object.len + 1));
-    if (tmpv == NULL)
+    if (tmpv == NULL) {
+        key_release(key);
         RETURN_ERROR(ctx, ENOMEM, "Out of memory");
+    }
     obj->u.object.values = tmpv;
 
-    obj->u.object.keys[obj->u.object.len] = key;
+    ctx->keyStack[ctx->keysUsed++] = key;
     obj->u.object.values[obj->u.object.len] = value;
     obj->u.object.len++;
 
@@ -237,9 +637,12 @@ static int context_add_value(context_t *ctx, yajl_val v) {
                              "Object key is not a string (%#04x)",
                              v->type);
 
-            ctx->stack->key = v->u.string;
-            v->u.string = NULL;
+            ctx->stack->key = key_intern(ctx, (unsigned char *)v->u.string,
+                                         strlen(v->u.string));
+            free(v->u.string);
             free(v);
+            if (ctx->stack->key == NULL)
+                RETURN_ERROR(ctx, ENOMEM, "Out of memory");
             return (0);
         }
 
@@ -285,37 +688,86 @@ static int handle_string(void *ctx, const unsigned char *string,
     return ((context_add_value(ctx, v) == 0) ? STATUS_CONTINUE : STATUS_ABORT);
 }
 
-static int handle_number(void *ctx, const char *string, size_t string_length) {
-    yajl_val v;
-    char *endptr;
+static int handle_map_key(void *ctx, const unsigned char *string,
+                          size_t string_length) {
+    context_t *c = ctx;
 
-    v = value_alloc(yajl_t_number);
-    if (v == NULL)
-        RETURN_ERROR((context_t *)ctx, STATUS_ABORT, "Out of memory");
+    assert(c->stack != NULL && YAJL_IS_OBJECT(c->stack->value));
 
-    v->u.number.r = malloc(string_length + 1);
-    if (v->u.number.r == NULL) {
-        free(v);
-        RETURN_ERROR((context_t *)ctx, STATUS_ABORT, "Out of memory");
-    }
+    c->stack->key = key_intern(c, string, string_length);
+    if (c->stack->key == NULL)
+        RETURN_ERROR(c, STATUS_ABORT, "Out of memory");
 
-    memcpy(v->u.number.r, string, string_length);
-    v->u.number.r[string_length] = 0;
+    return STATUS_CONTINUE;
+}
 
-    v->u.number.flags = 0;
+/* work out the value of a number, if that was left until it was wanted.
+ * the flags are written after the values, so the number is never marked
+ * converted while its values are missing. */
+static void number_convert(yajl_val v) {
+    unsigned int flags = v->u.number.flags;
+    char *endptr;
+    long long i;
+    double d;
+
+    if (!(flags & YAJL_NUMBER_LAZY)) {
+        return;
+    }
+
+    flags &= ~YAJL_NUMBER_LAZY;
 
     errno = 0;
-    v->u.number.i = yajl_parse_integer((const unsigned char *)v->u.number.r,
-                                       strlen(v->u.number.r));
+    i = yajl_parse_integer((const unsigned char *)v->u.number.r,
+                           v->u.number.len);
     if (errno == 0) {
-        v->u.number.flags |= YAJL_NUMBER_INT_VALID;
+        /* converting the integer rounds just as strtod would */
+        d = (double)i;
+        flags |= YAJL_NUMBER_INT_VALID | YAJL_NUMBER_DOUBLE_VALID;
+    } else {
+        /* a view isn't null terminated, but it is followed by something
+         * which can't be part of a number */
+        endptr = NULL;
+        errno = 0;
+        d = strtod(v->u.number.r, &endptr);
+        if ((errno == 0) && (endptr == v->u.number.r + v->u.number.len)) {
+            flags |= YAJL_NUMBER_DOUBLE_VALID;
+        }
     }
 
-    endptr = NULL;
-    errno = 0;
-    v->u.number.d = strtod(v->u.number.r, &endptr);
-    if ((errno == 0) && (endptr != NULL) && (*endptr == 0)) {
-        v->u.number.flags |= YAJL_NUMBER_DOUBLE_VALID;
+    v->u.number.i = i;
+    v->u.number.d = d;
+    v->u.number.flags = flags;
+}
+
+static int handle_number(void *ctx, const char *string, size_t string_length) {
+    context_t *c = ctx;
+    yajl_val v;
+
+    /* numbers are handed over from the input unless they were split and
+     * pieced together by the lexer, which only happens to a number at the
+     * very end.  otherwise the text is kept after the node. */
+    if ((c->options & yajl_tree_exact_numbers) && string >= c->input &&
+        string < c->input + c->input_length) {
+        v = value_alloc(yajl_t_number);
+        if (v == NULL)
+            RETURN_ERROR(c, STATUS_ABORT, "Out of memory");
+
+        v->u.number.r = (char *)string;
+        v->u.number.flags = YAJL_NUMBER_LAZY | YAJL_NUMBER_VIEW;
+    } else {
+        v = value_alloc_extra(yajl_t_number, string_length + 1);
+        if (v == NULL)
+            RETURN_ERROR(c, STATUS_ABORT, "Out of memory");
+
+        v->u.number.r = (char *)(v + 1);
+        memcpy(v->u.number.r, string, string_length);
+        v->u.number.r[string_length] = 0;
+        v->u.number.flags = YAJL_NUMBER_LAZY;
+    }
+
+    v->u.number.len = (unsigned int)string_length;
+    if (!(c->options & yajl_tree_lazy_numbers)) {
+        number_convert(v);
     }
 
     return ((context_add_value(ctx, v) == 0) ? STATUS_CONTINUE : STATUS_ABORT);
@@ -331,11 +783,13 @@ static int handle_start_map(void *ctx) {
     v->u.object.keys = NULL;
     v->u.object.values = NULL;
     v->u.object.len = 0;
+    v->u.object.flags = 0;
 
     return ((context_push(ctx, v) == 0) ? STATUS_CONTINUE : STATUS_ABORT);
 }
 
 static int handle_end_map(void *ctx) {
+    context_t *c = ctx;
     yajl_val v;
 
     v = context_pop(ctx);
@@ -343,6 +797,18 @@ static int handle_end_map(void *ctx) {
         return (STATUS_ABORT);
     }
 
+    if (v->u.object.len > 0) {
+        c->keysUsed -= v->u.object.len;
+        v->u.object.keys =
+            shape_intern(c, c->keyStack + c->keysUsed, v->u.object.len);
+        if (v->u.object.keys == NULL) {
+            object_discard(v, c->keyStack + c->keysUsed);
+            RETURN_ERROR(c, STATUS_ABORT, "Out of memory");
+        }
+
+        v->u.object.flags = SHAPE_OBJECT_FLAGS;
+    }
+
     return ((context_add_value(ctx, v) == 0) ? STATUS_CONTINUE : STATUS_ABORT);
 }
 
@@ -390,11 +856,72 @@ static int handle_null(void *ctx) {
     return ((context_add_value(ctx, v) == 0) ? STATUS_CONTINUE : STATUS_ABORT);
 }
 
+/* free what had been built when parsing failed: the root, if it was
+ * complete, or the unfinished objects and arrays on the stack, innermost
+ * first */
+static void context_free(context_t *ctx) {
+    yajl_tree_free(ctx->root);
+    ctx->root = NULL;
+
+    while (ctx->stack != NULL) {
+        stack_elem_t *stack = ctx->stack;
+        yajl_val v = stack->value;
+
+        if (stack->key != NULL) {
+            key_release(stack->key);
+        }
+
+        if (YAJL_IS_OBJECT(v)) {
+            ctx->keysUsed -= v->u.object.len;
+            object_discard(v, ctx->keyStack + ctx->keysUsed);
+        } else {
+            yajl_tree_free(v);
+        }
+
+        ctx->stack = stack->next;
+        free(stack);
+    }
+}
+
 /*
  * Public functions
  */
-yajl_val yajl_tree_parse(const char *input, char *error_buffer,
-                         size_t error_buffer_size) {
+/* add up the heap blocks making up a finished tree, they are allocated
+ * once each except for the value arrays, which grow one element at a
+ * time.  keys and shapes are shared, they are counted from their tables. */
+static void tree_stats(yajl_val v, yajl_stats *stats) {
+    size_t i;
+
+    stats->allocations++;
+    stats->peakBytes += sizeof(*v);
+
+    if (YAJL_IS_STRING(v)) {
+        stats->allocations++;
+        stats->peakBytes += strlen(v->u.string) + 1;
+    } else if (YAJL_IS_NUMBER(v)) {
+        if (!(v->u.number.flags & YAJL_NUMBER_VIEW)) {
+            stats->peakBytes += v->u.number.len + 1;
+        }
+    } else if (YAJL_IS_OBJECT(v) && v->u.object.len) {
+        stats->allocations++;
+        stats->reallocs += v->u.object.len - 1;
+        stats->peakBytes += v->u.object.len * sizeof(*v->u.object.values);
+        for (i = 0; i < v->u.object.len; i++) {
+            tree_stats(v->u.object.values[i], stats);
+        }
+    } else if (YAJL_IS_ARRAY(v) && v->u.array.len) {
+        stats->allocations++;
+        stats->reallocs += v->u.array.len - 1;
+        stats->peakBytes += v->u.array.len * sizeof(*v->u.array.values);
+        for (i = 0; i < v->u.array.len; i++) {
+            tree_stats(v->u.array.values[i], stats);
+        }
+    }
+}
+
+static yajl_val tree_parse(const char *input, unsigned int options,
+                           char *error_buffer, size_t error_buffer_size,
+                           yajl_stats *stats) {
     static const yajl_callbacks callbacks = {
         /* null        = */ handle_null,
         /* boolean     = */ handle_boolean,
@@ -403,18 +930,23 @@ yajl_val yajl_tree_parse(const char *input, char *error_buffer,
         /* number      = */ handle_number,
         /* string      = */ handle_string,
         /* start map   = */ handle_start_map,
-        /* map key     = */ handle_string,
+        /* map key     = */ handle_map_key,
         /* end map     = */ handle_end_map,
         /* start array = */ handle_start_array,
-        /* end array   = */ handle_end_array};
+        /* end array   = */ handle_end_array,
+        /* unsigned    = */ NULL};
 
     yajl_handle handle;
     yajl_status status;
     char *internal_err_str;
-    context_t ctx = {NULL, NULL, NULL, 0};
+    context_t ctx = {NULL, NULL, NULL, 0, 0, NULL, 0, {NULL, 0, 0, 0},
+                     NULL, 0, 0, {NULL, 0, 0, 0, 0}};
 
     ctx.errbuf = error_buffer;
     ctx.errbuf_size = error_buffer_size;
+    ctx.options = options;
+    ctx.input = input;
+    ctx.input_length = strlen(input);
 
     if (error_buffer != NULL) {
         memset(error_buffer, 0, error_buffer_size);
@@ -423,12 +955,25 @@ yajl_val yajl_tree_parse(const char *input, char *error_buffer,
     handle = yajl_alloc(&callbacks, NULL, &ctx);
     yajl_config(handle, yajl_allow_comments, 1);
 
-    status = yajl_parse(handle, (unsigned char *)input, strlen(input));
+    status = yajl_parse(handle, (unsigned char *)input, ctx.input_length);
     status = yajl_complete_parse(handle);
+    if (stats != NULL) {
+        yajl_get_stats(handle, stats);
+    }
+
+    if (status != yajl_status_ok) {
+        context_free(&ctx);
+    }
+
+    /* the keys and shapes now belong to the objects using them */
+    free(ctx.keys.slots);
+    free(ctx.shapes.slots);
+    free((void *)ctx.keyStack);
+
     if (status != yajl_status_ok) {
         if (error_buffer != NULL && error_buffer_size > 0) {
             internal_err_str = (char *)yajl_get_error(
-                handle, 1, (const unsigned char *)input, strlen(input));
+                handle, 1, (const unsigned char *)input, ctx.input_length);
             snprintf(error_buffer, error_buffer_size, "%s", internal_err_str);
             YA_FREE(internal_err_str);
         }
@@ -438,9 +983,351 @@ yajl_val yajl_tree_parse(const char *input, char *error_buffer,
     }
 
     yajl_free(handle);
+    if (stats != NULL && ctx.root != NULL) {
+        tree_stats(ctx.root, stats);
+        stats->allocations +=
+            ctx.keys.count + ctx.shapes.count + ctx.shapes.indexes;
+        stats->peakBytes += ctx.keys.bytes + ctx.shapes.bytes;
+    }
+
     return (ctx.root);
 }
 
+yajl_val yajl_tree_parse(const char *input, char *error_buffer,
+                         size_t error_buffer_size) {
+    return tree_parse(input, 0, error_buffer, error_buffer_size, NULL);
+}
+
+yajl_val yajl_tree_parse_stats(const char *input, char *error_buffer,
+                               size_t error_buffer_size, yajl_stats *stats) {
+    return tree_parse(input, 0, error_buffer, error_buffer_size, stats);
+}
+
+yajl_val yajl_tree_parse_options(const char *input, unsigned int options,
+                                 char *error_buffer,
+                                 size_t error_buffer_size) {
+    return tree_parse(input, options, error_buffer, error_buffer_size, NULL);
+}
+
+unsigned int yajl_tree_number_flags(yajl_val v) {
+    number_convert(v);
+    return v->u.number.flags;
+}
+
+long long yajl_tree_get_integer(yajl_val v) {
+    number_convert(v);
+    return v->u.number.i;
+}
+
+double yajl_tree_get_double(yajl_val v) {
+    number_convert(v);
+    return v->u.number.d;
+}
+
+/* decimal128 holds up to 34 digits, with an exponent biased by 6176 */
+#define DEC128_DIGITS 34
+#define DEC128_BIAS 6176
+#define DEC128_MAX_BIASED 12287
+
+int yajl_tree_get_decimal128(yajl_val v, yajl_decimal128 *out) {
+    const char *p = v->u.number.r;
+    const char *end = p + v->u.number.len;
+    const char *first = NULL, *last = NULL;
+    unsigned long long hi = 0, lo = 0;
+    long exponent = 0, explicitExp = 0;
+    int negative = 0, expNegative = 0, afterPoint = 0;
+    size_t digits = 0, kept;
+
+    if (*p == '-') {
+        negative = 1;
+        p++;
+    }
+
+    /* find the significant digits, and how far the last is from the
+     * units */
+    for (; p < end && *p != 'e' && *p != 'E'; p++) {
+        if (*p == '.') {
+            afterPoint = 1;
+            continue;
+        }
+
+        if (afterPoint) {
+            exponent--;
+        }
+
+        if (first == NULL && *p == '0') {
+            continue;
+        }
+
+        if (first == NULL) {
+            first = p;
+        }
+
+        last = p;
+        digits++;
+    }
+
+    if (p < end) {
+        p++;
+        if (*p == '-' || *p == '+') {
+            expNegative = *p++ == '-';
+        }
+
+        for (; p < end; p++) {
+            if (explicitExp < 100000) {
+                explicitExp = explicitExp * 10 + (*p - '0');
+            }
+        }
+    }
+
+    exponent += expNegative ? -explicitExp : explicitExp;
+
+    /* too many digits are only alright if the extra ones are zeros */
+    kept = digits;
+    while (kept > DEC128_DIGITS && *last == '0') {
+        do {
+            last--;
+        } while (*last == '.');
+        kept--;
+        exponent++;
+    }
+
+    if (kept > DEC128_DIGITS) {
+        return 0;
+    }
+
+    if (first == NULL) {
+        /* zero, with whatever exponent is closest */
+        exponent = exponent < -DEC128_BIAS ? -DEC128_BIAS : exponent;
+        exponent = exponent > DEC128_MAX_BIASED - DEC128_BIAS
+                       ? DEC128_MAX_BIASED - DEC128_BIAS
+                       : exponent;
+    } else if (exponent < -DEC128_BIAS ||
+               exponent > DEC128_MAX_BIASED - DEC128_BIAS) {
+        return 0;
+    }
+
+    /* the coefficient, times ten and plus a digit in two 64 bit halves */
+    for (p = first; p != NULL && p <= last; p++) {
+        unsigned long long loTimes10, carry;
+
+        if (*p == '.') {
+            continue;
+        }
+
+        loTimes10 = (lo & 0xFFFFFFFFULL) * 10;
+        carry = (lo >> 32) * 10 + (loTimes10 >> 32);
+        lo = (carry << 32) | (loTimes10 & 0xFFFFFFFFULL);
+        hi = hi * 10 + (carry >> 32);
+
+        lo += (unsigned long long)(*p - '0');
+        if (lo < (unsigned long long)(*p - '0')) {
+            hi++;
+        }
+    }
+
+    /* any 34 digit coefficient is below 2^113, so it always takes the
+     * form with the exponent straight after the sign */
+    out->low = lo;
+    out->high = ((unsigned long long)negative << 63) |
+                ((unsigned long long)(exponent + DEC128_BIAS) << 49) | hi;
+    return 1;
+}
+
+/*
+ * Serializing.  Output goes through out_append(), which counts everything
+ * but only copies while it fits, so that one walk both measures and
+ * writes.
+ */
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    unsigned int options;
+} output_t;
+
+static void out_append(output_t *out, const void *data, size_t n) {
+    if (out->len + n <= out->cap) {
+        memcpy(out->buf + out->len, data, n);
+    } else {
+        /* nothing more is written once something didn't fit */
+        out->cap = 0;
+    }
+
+    out->len += n;
+}
+
+static void out_indent(output_t *out, size_t depth) {
+    static const char spaces[] = "                                ";
+    size_t n = depth * 4;
+
+    while (n > 0) {
+        const size_t chunk = n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1;
+        out_append(out, spaces, chunk);
+        n -= chunk;
+    }
+}
+
+/* a string, quoted and escaped as yajl_string_encode() would.  the runs
+ * needing no escapes are copied straight across. */
+static void out_string(output_t *out, const unsigned char *str, size_t len) {
+    static const char hexDigits[] = "0123456789ABCDEF";
+    const int escapeSolidus =
+        (out->options & yajl_tree_serialize_escape_solidus) != 0;
+
+    out_append(out, "\"", 1);
+    while (len > 0) {
+        const size_t clean = yajl_string_clean_prefix(str, len, escapeSolidus);
+        char escaped[6] = {'\\', 0, '0', '0', 0, 0};
+        size_t escapedLen = 2;
+
+        out_append(out, str, clean);
+        str += clean;
+        len -= clean;
+        if (len == 0) {
+            break;
+        }
+
+        switch (*str) {
+        case '\r':
+            escaped[1] = 'r';
+            break;
+        case '\n':
+            escaped[1] = 'n';
+            break;
+        case '\f':
+            escaped[1] = 'f';
+            break;
+        case '\b':
+            escaped[1] = 'b';
+            break;
+        case '\t':
+            escaped[1] = 't';
+            break;
+        case '\\':
+        case '/':
+        case '"':
+            escaped[1] = (char)*str;
+            break;
+        default:
+            escaped[1] = 'u';
+            escaped[4] = hexDigits[*str >> 4];
+            escaped[5] = hexDigits[*str & 0xF];
+            escapedLen = 6;
+            break;
+        }
+
+        out_append(out, escaped, escapedLen);
+        str++;
+        len--;
+    }
+
+    out_append(out, "\"", 1);
+}
+
+static void out_value(output_t *out, yajl_val v, size_t depth) {
+    const int beautify = (out->options & yajl_tree_serialize_beautify) != 0;
+    size_t i;
+
+    switch (v->type) {
+    case yajl_t_string:
+        out_string(out, (const unsigned char *)v->u.string,
+                   strlen(v->u.string));
+        break;
+    case yajl_t_number:
+        out_append(out, v->u.number.r, v->u.number.len);
+        break;
+    case yajl_t_true:
+        out_append(out, "true", 4);
+        break;
+    case yajl_t_false:
+        out_append(out, "false", 5);
+        break;
+    case yajl_t_null:
+        out_append(out, "null", 4);
+        break;
+    case yajl_t_object:
+    case yajl_t_array: {
+        const int isObject = v->type == yajl_t_object;
+        const size_t len = isObject ? v->u.object.len : v->u.array.len;
+
+        out_append(out, isObject ? "{" : "[", 1);
+        if (beautify) {
+            out_append(out, "\n", 1);
+        }
+
+        for (i = 0; i < len; i++) {
+            if (i > 0) {
+                out_append(out, beautify ? ",\n" : ",", beautify ? 2 : 1);
+            }
+
+            if (beautify) {
+                out_indent(out, depth + 1);
+            }
+
+            if (isObject) {
+                const char *key = v->u.object.keys[i];
+                out_string(out, (const unsigned char *)key, strlen(key));
+                out_append(out, beautify ? ": " : ":", beautify ? 2 : 1);
+                out_value(out, v->u.object.values[i], depth + 1);
+            } else {
+                out_value(out, v->u.array.values[i], depth + 1);
+            }
+        }
+
+        /* the generator leaves an empty line in empty containers too */
+        if (beautify) {
+            out_append(out, "\n", 1);
+            out_indent(out, depth);
+        }
+
+        out_append(out, isObject ? "}" : "]", 1);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+size_t yajl_tree_serialize(yajl_val v, unsigned int options, char *buf,
+                           size_t bufLen) {
+    output_t out;
+
+    out.buf = buf;
+    /* leave room for the terminator */
+    out.cap = bufLen > 0 ? bufLen - 1 : 0;
+    out.len = 0;
+    out.options = options;
+
+    out_value(&out, v, 0);
+    if (options & yajl_tree_serialize_beautify) {
+        out_append(&out, "\n", 1);
+    }
+
+    if (out.len < bufLen) {
+        buf[out.len] = 0;
+    }
+
+    return out.len;
+}
+
+char *yajl_tree_serialize_alloc(yajl_val v, unsigned int options,
+                                size_t *length) {
+    const size_t len = yajl_tree_serialize(v, options, NULL, 0);
+    char *buf = malloc(len + 1);
+
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    yajl_tree_serialize(v, options, buf, len + 1);
+    if (length != NULL) {
+        *length = len;
+    }
+
+    return buf;
+}
+
 yajl_val yajl_tree_get(yajl_val n, const char **path, yajl_type type) {
     if (!path) {
         return NULL;
@@ -455,17 +1342,13 @@ yajl_val yajl_tree_get(yajl_val n, const char **path, yajl_type type) {
         }
 
         len = n->u.object.len;
-        for (i = 0; i < len; i++) {
-            if (!strcmp(*path, n->u.object.keys[i])) {
-                n = n->u.object.values[i];
-                break;
-            }
-        }
-
+        i = object_find(n, *path);
         if (i == len) {
             return NULL;
         }
 
+        n = n->u.object.values[i];
+
         path++;
     }
 
@@ -476,6 +1359,34 @@ yajl_val yajl_tree_get(yajl_val n, const char **path, yajl_type type) {
     return n;
 }
 
+yajl_val yajl_tree_get_cached(yajl_val object, const char *key,
+                              yajl_tree_cache *cache) {
+    size_t slot;
+
+    if (object == NULL || !YAJL_IS_OBJECT(object)) {
+        return NULL;
+    }
+
+    /* the same keys array means the same keys in the same slots.  the
+     * key is checked, as the array may be another tree's at the same
+     * address */
+    slot = cache->slot;
+    if (object->u.object.keys != cache->keys || cache->keys == NULL ||
+        slot >= object->u.object.len ||
+        (object->u.object.keys[slot] != key &&
+         strcmp(object->u.object.keys[slot], key))) {
+        slot = object_find(object, key);
+        if (slot == object->u.object.len) {
+            return NULL;
+        }
+
+        cache->keys = object->u.object.keys;
+        cache->slot = slot;
+    }
+
+    return object->u.object.values[slot];
+}
+
 void yajl_tree_free(yajl_val v) {
     if (v == NULL) {
         return;
@@ -487,7 +1398,13 @@ void yajl_tree_free(yajl_val v) {
     }
 
     else if (YAJL_IS_NUMBER(v)) {
-        free(v->u.number.r);
+        /* the parser keeps the text after the node or in the input, a
+         * number built by hand has it allocated on its own */
+        if (v->u.number.r != (char *)(v + 1) &&
+            !(v->u.number.flags & YAJL_NUMBER_VIEW)) {
+            free(v->u.number.r);
+        }
+
         free(v);
     }
 
@@ -0,0 +1,519 @@
+/*
+ * Copyright (c) 2007-2014, Lloyd Hilaiel <me@lloyd.io>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "api/yajl_parse.h"
+#include "yajl_alloc.h"
+
+#include <string.h>
+
+/*
+ * The validator accepts exactly what yajl_parse() and yajl_complete_parse()
+ * accept with no callbacks, but with the whole text at hand it needn't be
+ * able to stop between any two bytes.  So there are no tokens and no
+ * carry-over buffer, and the only state is where it is in the grammar and
+ * which containers are open: one bit each, set for a map, kept on the C
+ * stack for the first 1024 levels.  Plain string characters, the bulk of
+ * most documents, are skipped eight at a time.
+ *
+ * Where the text ends is treated as the parser treats it, which is as if
+ * one more space followed.
+ */
+
+#define DEPTH_WORDS 16
+
+typedef struct {
+    unsigned long long *bits;
+    /* the number of open containers, and room for them in bits */
+    size_t depth;
+    size_t cap;
+    unsigned long long local[DEPTH_WORDS];
+} depth_stack;
+
+static int depth_push(depth_stack *s, int isMap) {
+    const size_t word = s->depth / 64;
+    const unsigned long long bit = 1ULL << (s->depth % 64);
+
+    if (s->depth == s->cap) {
+        unsigned long long *bits;
+
+        if (s->bits == s->local) {
+            bits = YA_REALLOC(NULL, 2 * sizeof(s->local));
+            if (bits != NULL) {
+                memcpy(bits, s->local, sizeof(s->local));
+            }
+        } else {
+            bits = YA_REALLOC(s->bits, 2 * s->cap / 8);
+        }
+
+        if (bits == NULL) {
+            return 0;
+        }
+
+        s->bits = bits;
+        s->cap *= 2;
+    }
+
+    if (isMap) {
+        s->bits[word] |= bit;
+    } else {
+        s->bits[word] &= ~bit;
+    }
+
+    s->depth++;
+    return 1;
+}
+
+static int depth_in_map(const depth_stack *s) {
+    const size_t top = s->depth - 1;
+    return (s->bits[top / 64] >> (top % 64)) & 1;
+}
+
+/* skip whitespace and, if they are allowed, comments.  A '/' which does
+ * not open a comment is left for the caller to reject.  A comment still
+ * open at the end of the text is skipped, as the parser would be waiting
+ * for the rest of it. */
+static const unsigned char *skip_space(const unsigned char *p,
+                                       const unsigned char *end,
+                                       int comments) {
+    while (p < end) {
+        switch (*p) {
+        case '\t':
+        case '\n':
+        case '\v':
+        case '\f':
+        case '\r':
+        case ' ':
+            p++;
+            break;
+        case '/':
+            if (!comments || end - p < 2) {
+                return p;
+            } else if (p[1] == '/') {
+                p = memchr(p + 2, '\n', end - (p + 2));
+                if (p == NULL) {
+                    return end;
+                }
+
+                p++;
+            } else if (p[1] == '*') {
+                const unsigned char *q = p + 2;
+
+                for (;;) {
+                    q = memchr(q, '*', end - q);
+                    if (q == NULL || end - q < 2) {
+                        return end;
+                    } else if (q[1] == '/') {
+                        break;
+                    }
+
+                    q++;
+                }
+
+                p = q + 2;
+            } else {
+                return p;
+            }
+
+            break;
+        default:
+            return p;
+        }
+    }
+
+    return p;
+}
+
+/* the common case of nothing to skip, without a call */
+#define SKIP_SPACE                                                             \
+    if (p < end && (*p <= ' ' || *p == '/')) {                                 \
+        p = skip_space(p, end, comments);                                      \
+    }
+
+typedef enum {
+    scan_ok,
+    scan_error,
+    /* the text ended where a space could follow */
+    scan_ran_out
+} scan_result;
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+/* non-zero if any byte of the word is below n, which is at most 128 */
+#define SWAR_ANY_BELOW(w, n) (((w) - ONES * (n)) & ~(w) & HIGHS)
+
+#define SWAR_ANY_EQUAL(w, c) SWAR_ANY_BELOW((w) ^ (ONES * (c)), 1)
+
+static int is_hex(unsigned char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+/* scan a string from just after its opening quote, leaving *pp after the
+ * closing one, or at the offending byte.  'highs' is HIGHS to check UTF-8
+ * or zero not to. */
+static scan_result scan_string(const unsigned char **pp,
+                               const unsigned char *end,
+                               unsigned long long highs) {
+    const unsigned char *p = *pp;
+
+    for (;;) {
+        unsigned char c;
+
+        /* the characters which need no more than skipping */
+        while (end - p >= 8) {
+            unsigned long long w;
+
+            memcpy(&w, p, 8);
+            if (SWAR_ANY_BELOW(w, 0x20) | SWAR_ANY_EQUAL(w, '"') |
+                SWAR_ANY_EQUAL(w, '\\') | (w & highs)) {
+                break;
+            }
+
+            p += 8;
+        }
+
+        while (p < end && *p >= 0x20 && *p != '"' && *p != '\\' &&
+               !(*p & 0x80 & highs)) {
+            p++;
+        }
+
+        if (p == end) {
+            *pp = p;
+            return scan_ran_out;
+        }
+
+        c = *p;
+        if (c == '"') {
+            *pp = p + 1;
+            return scan_ok;
+        } else if (c == '\\') {
+            if (++p == end) {
+                break;
+            }
+
+            switch (*p++) {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                break;
+            case 'u': {
+                int i;
+
+                for (i = 0; i < 4; i++, p++) {
+                    if (p == end || !is_hex(*p)) {
+                        *pp = p;
+                        return scan_error;
+                    }
+                }
+
+                break;
+            }
+            default:
+                p--;
+                *pp = p;
+                return scan_error;
+            }
+        } else if (c < 0x20) {
+            break;
+        } else {
+            /* the lead byte says how many continuation bytes follow */
+            int n;
+
+            if ((c >> 5) == 0x6) {
+                n = 1;
+            } else if ((c >> 4) == 0x0e) {
+                n = 2;
+            } else if ((c >> 3) == 0x1e) {
+                n = 3;
+            } else {
+                break;
+            }
+
+            for (p++; n > 0; n--, p++) {
+                if (p == end || (*p >> 6) != 0x2) {
+                    *pp = p;
+                    return scan_error;
+                }
+            }
+        }
+    }
+
+    *pp = p;
+    return scan_error;
+}
+
+/* the parser only finds a token out of place once it is complete, so a
+ * string still open at the end of the text is never an error, wherever
+ * it starts */
+static int unfinished_string(const unsigned char *p,
+                             const unsigned char *end,
+                             unsigned long long highs) {
+    if (*p != '"') {
+        return 0;
+    }
+
+    p++;
+    return scan_string(&p, end, highs) == scan_ran_out;
+}
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+/* skip a run of digits, of which there must be at least one */
+#define DIGITS                                                                 \
+    if (p == end || !IS_DIGIT(*p)) {                                           \
+        *pp = p;                                                               \
+        return scan_error;                                                     \
+    }                                                                          \
+                                                                               \
+    while (++p < end && IS_DIGIT(*p)) {                                        \
+    }
+
+/* scan a number from its first byte, which is a minus or a digit */
+static scan_result scan_number(const unsigned char **pp,
+                               const unsigned char *end) {
+    const unsigned char *p = *pp;
+
+    if (*p == '-') {
+        p++;
+    }
+
+    if (p < end && *p == '0') {
+        p++;
+    } else {
+        DIGITS;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        DIGITS;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        if (++p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+
+        DIGITS;
+    }
+
+    *pp = p;
+    return scan_ok;
+}
+
+static scan_result scan_literal(const unsigned char **pp,
+                                const unsigned char *end, const char *word) {
+    const unsigned char *p = *pp;
+
+    for (; *word; word++, p++) {
+        if (p == end || *p != (unsigned char)*word) {
+            *pp = p;
+            return scan_error;
+        }
+    }
+
+    *pp = p;
+    return scan_ok;
+}
+
+yajl_status yajl_validate(const unsigned char *jsonText, size_t jsonTextLength,
+                          unsigned int flags, size_t *errorOffset) {
+    const unsigned char *p = jsonText;
+    const unsigned char *const end = jsonText + jsonTextLength;
+    const int comments = (flags & yajl_allow_comments) != 0;
+    const unsigned long long highs =
+        (flags & yajl_dont_validate_strings) ? 0 : HIGHS;
+    /* a top-level value has been completed */
+    int gotValue = 0;
+    yajl_status status = yajl_status_ok;
+    depth_stack stack;
+    scan_result r;
+
+    stack.bits = stack.local;
+    stack.depth = 0;
+    stack.cap = 64 * DEPTH_WORDS;
+
+value:
+    SKIP_SPACE;
+    if (p == end) {
+        goto ran_out;
+    }
+
+    switch (*p) {
+    case '{':
+    case '[':
+        if (!depth_push(&stack, *p == '{')) {
+            goto failed;
+        }
+
+        p++;
+        SKIP_SPACE;
+        if (p == end) {
+            goto ran_out;
+        } else if (*p == (depth_in_map(&stack) ? '}' : ']')) {
+            p++;
+            stack.depth--;
+            goto got_value;
+        } else if (depth_in_map(&stack)) {
+            goto key;
+        }
+
+        goto value;
+    case '"':
+        p++;
+        r = scan_string(&p, end, highs);
+        if (r == scan_ran_out && gotValue && stack.depth == 0) {
+            /* nor is it a further value, the one before is complete */
+            goto done;
+        }
+
+        break;
+    case 't':
+        r = scan_literal(&p, end, "true");
+        break;
+    case 'f':
+        r = scan_literal(&p, end, "false");
+        break;
+    case 'n':
+        r = scan_literal(&p, end, "null");
+        break;
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        r = scan_number(&p, end);
+        break;
+    default:
+        goto failed;
+    }
+
+    if (r == scan_error) {
+        goto failed;
+    } else if (r == scan_ran_out) {
+        goto ran_out;
+    }
+
+got_value:
+    if (stack.depth == 0) {
+        goto top_level;
+    }
+
+    SKIP_SPACE;
+    if (p == end) {
+        goto ran_out;
+    } else if (*p == ',') {
+        p++;
+        if (!depth_in_map(&stack)) {
+            goto value;
+        }
+
+        SKIP_SPACE;
+        if (p == end) {
+            goto ran_out;
+        }
+
+        goto key;
+    } else if (*p != (depth_in_map(&stack) ? '}' : ']')) {
+        if (unfinished_string(p, end, highs)) {
+            p = end;
+            goto ran_out;
+        }
+
+        goto failed;
+    }
+
+    p++;
+    stack.depth--;
+    goto got_value;
+
+key:
+    if (*p != '"') {
+        goto failed;
+    }
+
+    p++;
+    r = scan_string(&p, end, highs);
+    if (r == scan_error) {
+        goto failed;
+    } else if (r == scan_ran_out) {
+        goto ran_out;
+    }
+
+    SKIP_SPACE;
+    if (p == end) {
+        goto ran_out;
+    } else if (*p != ':') {
+        if (unfinished_string(p, end, highs)) {
+            p = end;
+            goto ran_out;
+        }
+
+        goto failed;
+    }
+
+    p++;
+    goto value;
+
+top_level:
+    gotValue = 1;
+    if (flags & yajl_allow_multiple_values) {
+        SKIP_SPACE;
+        if (p == end) {
+            goto done;
+        }
+
+        goto value;
+    } else if (flags & yajl_allow_trailing_garbage) {
+        goto done;
+    }
+
+    SKIP_SPACE;
+    if (p == end || unfinished_string(p, end, highs)) {
+        goto done;
+    }
+
+    goto failed;
+
+ran_out:
+    /* the text ended part way through a value */
+    if (flags & yajl_allow_partial_values) {
+        goto done;
+    }
+
+failed:
+    status = yajl_status_error;
+    if (errorOffset) {
+        *errorOffset = (size_t)(p - jsonText);
+    }
+
+done:
+    if (stack.bits != stack.local) {
+        YA_FREE(stack.bits);
+    }
+
+    return status;
+}
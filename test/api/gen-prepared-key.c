@@ -0,0 +1,57 @@
+/* ensure that prepared keys generate exactly what yajl_gen_string does,
+ * both compact and beautified, at and away from key position */
+
+#include <yajl/yajl_gen.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHK(x) if ((x) != yajl_gen_status_ok) return 1;
+
+static int generate(yajl_gen g, yajl_gen_prepared_key k, int prepared) {
+    CHK(yajl_gen_map_open(g));
+    CHK(prepared ? yajl_gen_key(g, k) : yajl_gen_string(g, "a/\"b", 4));
+    CHK(yajl_gen_array_open(g));
+    CHK(prepared ? yajl_gen_key(g, k) : yajl_gen_string(g, "a/\"b", 4));
+    CHK(yajl_gen_array_close(g));
+    CHK(yajl_gen_string(g, "c", 1));
+    CHK(yajl_gen_map_open(g));
+    CHK(prepared ? yajl_gen_key(g, k) : yajl_gen_string(g, "a/\"b", 4));
+    CHK(yajl_gen_null(g));
+    CHK(yajl_gen_map_close(g));
+    CHK(prepared ? yajl_gen_key(g, k) : yajl_gen_string(g, "a/\"b", 4));
+    CHK(yajl_gen_integer(g, 1));
+    CHK(yajl_gen_map_close(g));
+    return 0;
+}
+
+int main(void) {
+    int beautify;
+
+    for (beautify = 0; beautify < 2; beautify++) {
+        yajl_gen expect = yajl_gen_alloc();
+        yajl_gen got = yajl_gen_alloc();
+        yajl_gen_prepared_key k;
+        const void *e, *o;
+        size_t elen, olen;
+
+        yajl_gen_config(expect, yajl_gen_beautify, beautify);
+        yajl_gen_config(got, yajl_gen_beautify, beautify);
+        k = yajl_gen_key_prepare(got, "a/\"b", 4);
+
+        if (generate(expect, NULL, 0) || generate(got, k, 1)) return 1;
+
+        yajl_gen_get_buf(expect, (void **)&e, &elen);
+        yajl_gen_get_buf(got, (void **)&o, &olen);
+        if (elen != olen || memcmp(e, o, elen)) {
+            printf("expected: %.*s\ngot: %.*s\n", (int)elen, (const char *)e,
+                   (int)olen, (const char *)o);
+            return 1;
+        }
+
+        yajl_gen_key_free(k);
+        yajl_gen_free(expect);
+        yajl_gen_free(got);
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+/* ensure that raw fragments are spliced in with the right separators and
+ * that the validating variant rejects anything but one complete value */
+
+#include <yajl/yajl_gen.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHK(x) if ((x) != yajl_gen_status_ok) return 1;
+
+int main(void) {
+    static const char *expect = "{\"a\":{\"cached\":[1,2]},\"b\":[true,3]}";
+    yajl_gen g = yajl_gen_alloc();
+    const void *buf;
+    size_t len;
+
+    CHK(yajl_gen_map_open(g));
+    /* a raw value is never a key */
+    if (yajl_gen_raw_value(g, "\"a\"", 3) != yajl_gen_keys_must_be_strings)
+        return 1;
+    CHK(yajl_gen_string(g, "a", 1));
+    CHK(yajl_gen_raw_value(g, "{\"cached\":[1,2]}", 16));
+    CHK(yajl_gen_string(g, "b", 1));
+    CHK(yajl_gen_array_open(g));
+    CHK(yajl_gen_raw_value_validate(g, "true", 4));
+    if (yajl_gen_raw_value_validate(g, "[1,", 3) != yajl_gen_invalid_value)
+        return 1;
+    if (yajl_gen_raw_value_validate(g, "1 2", 3) != yajl_gen_invalid_value)
+        return 1;
+    CHK(yajl_gen_integer(g, 3));
+    CHK(yajl_gen_array_close(g));
+    CHK(yajl_gen_map_close(g));
+
+    yajl_gen_get_buf(g, (void **)&buf, &len);
+    if (len != strlen(expect) || memcmp(buf, expect, len)) {
+        printf("unexpected output: %.*s\n", (int)len, (const char *)buf);
+        return 1;
+    }
+
+    yajl_gen_free(g);
+    return 0;
+}
@@ -0,0 +1,122 @@
+/* ensure that in sink mode output reaches the print callback (or fd) in
+ * bounded pieces, and that the pieces add up to the buffered output */
+
+/* for fileno() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <yajl/yajl_gen.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHK(x) if ((x) != yajl_gen_status_ok) return 1;
+
+typedef struct {
+    char out[1024];
+    size_t len;
+    size_t calls;
+    size_t largest;
+} collector;
+
+static void collect(void *ctx, const char *str, size_t len) {
+    collector *c = ctx;
+    if (c->len + len <= sizeof(c->out)) {
+        memcpy(c->out + c->len, str, len);
+    }
+    c->len += len;
+    c->calls++;
+    if (len > c->largest) c->largest = len;
+}
+
+static int generate(yajl_gen g) {
+    int i;
+    CHK(yajl_gen_map_open(g));
+    CHK(yajl_gen_string(g, "values", 6));
+    CHK(yajl_gen_array_open(g));
+    for (i = 0; i < 50; i++) {
+        CHK(yajl_gen_integer(g, i * 1000));
+    }
+    CHK(yajl_gen_array_close(g));
+    CHK(yajl_gen_map_close(g));
+    return 0;
+}
+
+int main(void) {
+    yajl_gen g;
+    collector c;
+    const void *expect;
+    size_t expectLen;
+    char fromFd[1024];
+    FILE *f;
+    void *buf;
+    size_t len;
+
+    /* reference output, buffered */
+    g = yajl_gen_alloc();
+    if (generate(g)) return 1;
+    yajl_gen_get_buf(g, (void **) &expect, &expectLen);
+
+    /* through a print callback, 16 bytes at a time */
+    memset(&c, 0, sizeof(c));
+    {
+        yajl_gen s = yajl_gen_alloc();
+        yajl_gen_config(s, yajl_gen_print_callback, collect, &c);
+        yajl_gen_config(s, yajl_gen_flush_threshold, (size_t) 16);
+        if (generate(s)) return 1;
+        if (yajl_gen_get_buf(s, &buf, &len) != yajl_gen_no_buf) return 1;
+        CHK(yajl_gen_flush(s));
+        yajl_gen_free(s);
+    }
+
+    if (c.len != expectLen || memcmp(c.out, expect, expectLen)) {
+        printf("callback output differs: %.*s\n", (int) c.len, c.out);
+        return 1;
+    }
+
+    /* each piece is at most the threshold plus one value */
+    if (c.calls < expectLen / 24 || c.largest > 16 + 8) {
+        printf("unexpected flushing: %zu calls, largest %zu\n", c.calls,
+               c.largest);
+        return 1;
+    }
+
+    /* straight to a file descriptor */
+    f = tmpfile();
+    if (!f) return 1;
+    {
+        yajl_gen s = yajl_gen_alloc();
+        yajl_gen_config(s, yajl_gen_output_fd, fileno(f));
+        yajl_gen_config(s, yajl_gen_flush_threshold, (size_t) 100);
+        if (generate(s)) return 1;
+        CHK(yajl_gen_flush(s));
+        yajl_gen_free(s);
+    }
+
+    rewind(f);
+    len = fread(fromFd, 1, sizeof(fromFd), f);
+    fclose(f);
+    if (len != expectLen || memcmp(fromFd, expect, expectLen)) {
+        printf("fd output differs: %.*s\n", (int) len, fromFd);
+        return 1;
+    }
+
+    /* switching sinks hands what's pending to the old one, and a NULL
+     * callback goes back to buffering even after an fd was set */
+    memset(&c, 0, sizeof(c));
+    {
+        yajl_gen s = yajl_gen_alloc();
+        yajl_gen_config(s, yajl_gen_output_fd, 1);
+        yajl_gen_config(s, yajl_gen_print_callback, collect, &c);
+        CHK(yajl_gen_array_open(s));
+        CHK(yajl_gen_integer(s, 1));
+        yajl_gen_config(s, yajl_gen_print_callback, NULL, NULL);
+        if (c.len != 2 || memcmp(c.out, "[1", 2)) return 1;
+        CHK(yajl_gen_integer(s, 2));
+        CHK(yajl_gen_array_close(s));
+        CHK(yajl_gen_get_buf(s, &buf, &len));
+        if (len != 3 || memcmp(buf, ",2]", 3)) return 1;
+        yajl_gen_free(s);
+    }
+
+    yajl_gen_free(g);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/* ensure that generating from a field table produces the same text as
+ * the equivalent sequence of yajl_gen calls */
+
+#include <yajl/yajl_bind.h>
+#include <yajl/yajl_gen.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    int x;
+    int y;
+} point;
+
+typedef struct {
+    long long id;
+    const char *name;
+    double score;
+    int active;
+    point origin;
+    point *path;
+    size_t pathLen;
+} shape;
+
+/* a struct nested in itself */
+typedef struct node {
+    int v;
+    struct node *kids;
+    size_t nkids;
+} node;
+
+static const yajl_bind_field pointFields[] = {
+    YAJL_BIND_FIELD(point, x, yajl_bind_int),
+    YAJL_BIND_FIELD(point, y, yajl_bind_int)};
+static const yajl_bind_table pointTable = YAJL_BIND_TABLE(point, pointFields);
+
+static const yajl_bind_field shapeFields[] = {
+    YAJL_BIND_FIELD(shape, id, yajl_bind_long_long),
+    YAJL_BIND_FIELD(shape, name, yajl_bind_cstring),
+    YAJL_BIND_FIELD(shape, score, yajl_bind_double),
+    YAJL_BIND_FIELD(shape, active, yajl_bind_bool),
+    YAJL_BIND_OBJECT(shape, origin, &pointTable),
+    YAJL_BIND_OBJECT_ARRAY(shape, path, pathLen, &pointTable)};
+static const yajl_bind_table shapeTable = YAJL_BIND_TABLE(shape, shapeFields);
+
+static const yajl_bind_table nodeTable;
+static const yajl_bind_field nodeFields[] = {
+    YAJL_BIND_FIELD(node, v, yajl_bind_int),
+    YAJL_BIND_OBJECT_ARRAY(node, kids, nkids, &nodeTable)};
+static const yajl_bind_table nodeTable = YAJL_BIND_TABLE(node, nodeFields);
+
+/* a key the prepared keys can't be used for when escaping solidi */
+static const yajl_bind_field slashFields[] = {
+    {"x/y", yajl_bind_int, offsetof(point, x), 0, NULL},
+    YAJL_BIND_FIELD(point, y, yajl_bind_int)};
+static const yajl_bind_table slashTable = YAJL_BIND_TABLE(point, slashFields);
+
+#define CHK(x) if ((x) != yajl_gen_status_ok) return 1;
+
+/* the same as the tables above, by hand */
+static int gen_node(yajl_gen g, const node *n) {
+    size_t i;
+
+    CHK(yajl_gen_map_open(g));
+    CHK(yajl_gen_string(g, (const unsigned char *)"v", 1));
+    CHK(yajl_gen_integer(g, n->v));
+    CHK(yajl_gen_string(g, (const unsigned char *)"kids", 4));
+    CHK(yajl_gen_array_open(g));
+    for (i = 0; i < n->nkids; i++) {
+        if (gen_node(g, &n->kids[i])) return 1;
+    }
+
+    CHK(yajl_gen_array_close(g));
+    CHK(yajl_gen_map_close(g));
+    return 0;
+}
+
+static int gen_slash(yajl_gen g, const point *p) {
+    CHK(yajl_gen_map_open(g));
+    CHK(yajl_gen_string(g, (const unsigned char *)"x/y", 3));
+    CHK(yajl_gen_integer(g, p->x));
+    CHK(yajl_gen_string(g, (const unsigned char *)"y", 1));
+    CHK(yajl_gen_integer(g, p->y));
+    CHK(yajl_gen_map_close(g));
+    return 0;
+}
+
+typedef int (*by_hand_fn)(yajl_gen g, const void *s);
+
+/* generate 's' with 'b' and by hand, beautified or not and escaping solidi
+ * or not, inside an array so that separators are covered, and compare */
+static int same_as_by_hand(yajl_bind b, const void *s, by_hand_fn byHand,
+                           int beautify, int escapeSolidus) {
+    yajl_gen g[2];
+    const unsigned char *buf[2];
+    size_t len[2];
+    int i, rv;
+
+    for (i = 0; i < 2; i++) {
+        g[i] = yajl_gen_alloc();
+        yajl_gen_config(g[i], yajl_gen_beautify, beautify);
+        yajl_gen_config(g[i], yajl_gen_escape_solidus, escapeSolidus);
+        CHK(yajl_gen_array_open(g[i]));
+        CHK(yajl_gen_integer(g[i], 0));
+        if (i == 0) {
+            CHK(yajl_gen_struct(g[i], b, s));
+        } else if (byHand(g[i], s)) {
+            return 1;
+        }
+
+        CHK(yajl_gen_array_close(g[i]));
+        yajl_gen_get_buf(g[i], (void **)&buf[i], &len[i]);
+    }
+
+    rv = len[0] != len[1] || memcmp(buf[0], buf[1], len[0]);
+    if (rv) {
+        printf("unexpected output: %.*s\nexpected: %.*s\n", (int)len[0],
+               (const char *)buf[0], (int)len[1], (const char *)buf[1]);
+    }
+
+    yajl_gen_free(g[0]);
+    yajl_gen_free(g[1]);
+    return rv;
+}
+
+static int node_by_hand(yajl_gen g, const void *s) {
+    return gen_node(g, s);
+}
+
+static int slash_by_hand(yajl_gen g, const void *s) {
+    return gen_slash(g, s);
+}
+
+int main(void) {
+    static const char *expect =
+        "[{\"id\":-42,\"name\":\"tab\\there\",\"score\":0.5,\"active\":true,"
+        "\"origin\":{\"x\":1,\"y\":2},\"path\":[{\"x\":3,\"y\":4},"
+        "{\"x\":5,\"y\":6}]},{\"id\":7,\"name\":null,\"score\":0.5,"
+        "\"active\":false,\"origin\":{\"x\":0,\"y\":0},\"path\":[]}]";
+    point path[] = {{3, 4}, {5, 6}};
+    shape shapes[] = {{-42, "tab\there", 0.5, 1, {1, 2}, path, 2},
+                      {7, NULL, 0.5, 0, {0, 0}, NULL, 0}};
+    node leaves[] = {{3, NULL, 0}, {4, NULL, 0}};
+    node kids[] = {{2, leaves, 2}, {5, NULL, 0}};
+    node tree = {1, kids, 2};
+    point slash = {1, 2};
+    yajl_bind b;
+    yajl_gen g;
+    void *buf;
+    size_t len;
+    int rv, opts;
+
+    b = yajl_bind_alloc(&shapeTable);
+    if (!b) return 1;
+
+    g = yajl_gen_alloc();
+    CHK(yajl_gen_struct_array(g, b, shapes, 2));
+    yajl_gen_get_buf(g, &buf, &len);
+
+    rv = !(len == strlen(expect) && !memcmp(buf, expect, len));
+    if (rv) {
+        printf("unexpected output: %.*s\n", (int)len, (const char *)buf);
+    }
+
+    yajl_gen_free(g);
+    yajl_bind_free(b);
+    if (rv) return rv;
+
+    /* a tree, and a key that needs escaping, compact and beautified,
+     * escaping solidi or not */
+    for (opts = 0; opts < 4; opts++) {
+        b = yajl_bind_alloc(&nodeTable);
+        if (!b) return 1;
+        rv = same_as_by_hand(b, &tree, node_by_hand, opts & 1, opts & 2);
+        yajl_bind_free(b);
+        if (rv) return rv;
+
+        b = yajl_bind_alloc(&slashTable);
+        if (!b) return 1;
+        rv = same_as_by_hand(b, &slash, slash_by_hand, opts & 1, opts & 2);
+        yajl_bind_free(b);
+        if (rv) return rv;
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/* ensure that in zero-copy mode long clean string runs are referenced in
+ * place, and that the iovec chain adds up to the regular output */
+
+#include <yajl/yajl_gen.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHK(x) if ((x) != yajl_gen_status_ok) return 1;
+
+static char blob[4096];
+
+typedef struct {
+    char out[2 * sizeof(blob)];
+    size_t len;
+} collector;
+
+static void collect(void *ctx, const char *str, size_t len) {
+    collector *c = ctx;
+    if (c->len + len <= sizeof(c->out)) {
+        memcpy(c->out + c->len, str, len);
+    }
+    c->len += len;
+}
+
+static int generate(yajl_gen g) {
+    CHK(yajl_gen_map_open(g));
+    CHK(yajl_gen_string(g, "payload", 7));
+    CHK(yajl_gen_string(g, blob, sizeof(blob)));
+    CHK(yajl_gen_string(g, "short", 5));
+    CHK(yajl_gen_string(g, "x\ty", 3));
+    CHK(yajl_gen_string(g, "raw", 3));
+    CHK(yajl_gen_raw_value(g, blob + 1000, 300));
+    CHK(yajl_gen_map_close(g));
+    return 0;
+}
+
+int main(void) {
+    static char out[2 * sizeof(blob)];
+    const yajl_gen_iovec *iov;
+    const void *expect;
+    size_t expectLen;
+    size_t count;
+    size_t len = 0;
+    size_t referenced = 0;
+    size_t i;
+    void *buf;
+    yajl_gen g;
+    yajl_gen z;
+
+    /* a long base64-ish run with a few characters that need escaping */
+    for (i = 0; i < sizeof(blob); i++) {
+        blob[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"[i % 52];
+    }
+    blob[10] = '"';
+    blob[2000] = '\n';
+    blob[2001] = '\\';
+    /* keep the raw fragment a valid string */
+    blob[1000] = blob[1299] = '"';
+
+    g = yajl_gen_alloc();
+    if (generate(g)) return 1;
+    yajl_gen_get_buf(g, (void **) &expect, &expectLen);
+
+    z = yajl_gen_alloc();
+    yajl_gen_config(z, yajl_gen_zero_copy_threshold, (size_t) 256);
+    if (generate(z)) return 1;
+    if (yajl_gen_get_buf(z, &buf, &len) != yajl_gen_no_buf) return 1;
+    CHK(yajl_gen_get_iov(z, &iov, &count));
+
+    len = 0;
+    for (i = 0; i < count; i++) {
+        const char *base = iov[i].base;
+        if (base >= blob && base < blob + sizeof(blob)) {
+            referenced += iov[i].len;
+        }
+        memcpy(out + len, base, iov[i].len);
+        len += iov[i].len;
+    }
+
+    if (len != expectLen || memcmp(out, expect, len)) {
+        printf("chained output differs: %.*s\n", (int) len, out);
+        return 1;
+    }
+
+    /* everything but the escaped characters, the first 11 bytes and the
+     * raw value's quotes should be in place */
+    if (referenced < sizeof(blob) - 20) {
+        printf("only %zu bytes referenced\n", referenced);
+        return 1;
+    }
+
+    /* after clearing the chain starts over */
+    yajl_gen_clear(z);
+    yajl_gen_reset(z, NULL);
+    CHK(yajl_gen_integer(z, 1));
+    CHK(yajl_gen_get_iov(z, &iov, &count));
+    if (count != 1 || iov[0].len != 1) return 1;
+
+    yajl_gen_free(z);
+
+    /* with a print callback, referenced runs go out right away */
+    {
+        static collector c;
+        z = yajl_gen_alloc();
+        yajl_gen_config(z, yajl_gen_zero_copy_threshold, (size_t) 256);
+        yajl_gen_config(z, yajl_gen_print_callback, collect, &c);
+        if (generate(z)) return 1;
+        CHK(yajl_gen_flush(z));
+        yajl_gen_free(z);
+        if (c.len != expectLen || memcmp(c.out, expect, expectLen)) {
+            printf("printed output differs: %.*s\n", (int) c.len, c.out);
+            return 1;
+        }
+    }
+
+    yajl_gen_free(g);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/* ensure an array of records is turned into columns as it is parsed,
+ * with the types inferred or declared, whatever the chunk size */
+
+#include <yajl/yajl_column.h>
+#include <yajl/yajl_parse.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+static const char records[] =
+    "[{\"id\": 1, \"price\": 2, \"name\": \"ab\", \"ok\": true},"
+    " {\"id\": 2, \"price\": 2.5, \"ok\": false, \"name\": null},"
+    " {\"name\": \"\", \"id\": 3, \"extra\": \"x\"},"
+    " {\"id\": 4, \"price\": 18446744073709551615, \"name\": \"cde\","
+    "  \"ok\": null}]";
+
+/* parse 'json' into 'c' in chunks of 'chunk' bytes */
+static yajl_status convert(yajl_columns c, const char *json, size_t chunk) {
+    yajl_handle h = yajl_alloc(yajl_columns_callbacks(c), NULL, c);
+    const size_t len = strlen(json);
+    yajl_status s = yajl_status_ok;
+    size_t i;
+
+    yajl_config(h, yajl_allow_multiple_values, 1);
+    for (i = 0; i < len && s == yajl_status_ok; i += chunk) {
+        s = yajl_parse(h, (const unsigned char *)json + i,
+                       len - i < chunk ? len - i : chunk);
+    }
+
+    if (s == yajl_status_ok) {
+        s = yajl_complete_parse(h);
+    }
+
+    yajl_free(h);
+    return s;
+}
+
+static int valid(const yajl_column *col, size_t row) {
+    return (col->validity[row / 8] >> (row % 8)) & 1;
+}
+
+/* the records, as inferred */
+static int check_inferred(yajl_columns c) {
+    yajl_column col;
+
+    CHECK(yajl_columns_rows(c) == 4);
+    CHECK(yajl_columns_count(c) == 5);
+
+    yajl_columns_get(c, 0, &col);
+    CHECK(!strcmp(col.name, "id") && col.type == yajl_column_int64);
+    CHECK(col.length == 4 && col.nulls == 0);
+    CHECK(col.integers[0] == 1 && col.integers[3] == 4);
+
+    /* an integer column which met a double */
+    yajl_columns_get(c, 1, &col);
+    CHECK(!strcmp(col.name, "price") && col.type == yajl_column_double);
+    CHECK(col.nulls == 1 && !valid(&col, 2));
+    CHECK(col.doubles[0] == 2.0 && col.doubles[1] == 2.5);
+    CHECK(col.doubles[3] == 18446744073709551615.0);
+
+    yajl_columns_get(c, 2, &col);
+    CHECK(col.type == yajl_column_string && col.nulls == 1);
+    CHECK(valid(&col, 0) && !valid(&col, 1) && valid(&col, 2));
+    CHECK(col.offsets[0] == 0 && col.offsets[1] == 2 && col.offsets[2] == 2);
+    CHECK(col.offsets[3] == 2 && col.offsets[4] == 5);
+    CHECK(!memcmp(col.data, "abcde", 5));
+
+    yajl_columns_get(c, 3, &col);
+    CHECK(col.type == yajl_column_bool && col.nulls == 2);
+    CHECK(col.booleans[0] == 1 && col.validity[0] == 3);
+
+    /* first seen in the third record */
+    yajl_columns_get(c, 4, &col);
+    CHECK(!strcmp(col.name, "extra") && col.nulls == 3);
+    CHECK(col.validity[0] == 4 && col.data[0] == 'x');
+
+    return 0;
+}
+
+static const char *failure(const char *json) {
+    yajl_columns c = yajl_columns_alloc();
+    static const char *error;
+
+    error = convert(c, json, strlen(json)) == yajl_status_client_canceled
+                ? yajl_columns_error(c)
+                : NULL;
+    yajl_columns_free(c);
+    return error;
+}
+
+int main(void) {
+    yajl_columns c;
+    yajl_column col;
+    size_t chunk;
+
+    for (chunk = 1; chunk <= sizeof(records); chunk++) {
+        c = yajl_columns_alloc();
+        CHECK(convert(c, records, chunk) == yajl_status_ok);
+        if (check_inferred(c)) {
+            printf("in chunks of %u\n", (unsigned)chunk);
+            return 1;
+        }
+
+        yajl_columns_free(c);
+    }
+
+    /* declared columns, and only those */
+    c = yajl_columns_alloc();
+    CHECK(yajl_columns_declare(c, "price", yajl_column_double));
+    CHECK(yajl_columns_declare(c, "id", yajl_column_int64));
+    CHECK(yajl_columns_declare(c, "tag", yajl_column_string));
+    CHECK(!yajl_columns_declare(c, "id", yajl_column_string));
+    CHECK(convert(c, "{\"id\": 7, \"skip\": {\"a\": [1, {}]}, \"price\": 3}"
+                     "{\"price\": 1e3, \"id\": -8}",
+                  4) == yajl_status_ok);
+    CHECK(yajl_columns_rows(c) == 2 && yajl_columns_count(c) == 3);
+    CHECK(!yajl_columns_declare(c, "late", yajl_column_null));
+
+    yajl_columns_get(c, 0, &col);
+    CHECK(col.doubles[0] == 3.0 && col.doubles[1] == 1000.0);
+    yajl_columns_get(c, 1, &col);
+    CHECK(col.integers[0] == 7 && col.integers[1] == -8);
+    yajl_columns_get(c, 2, &col);
+    CHECK(col.nulls == 2 && col.offsets[2] == 0 && col.validity[0] == 0);
+
+    /* a new batch keeps the columns */
+    yajl_columns_clear(c);
+    CHECK(yajl_columns_rows(c) == 0 && yajl_columns_count(c) == 3);
+    CHECK(convert(c, "[{\"tag\": \"t\"}]", 1) == yajl_status_ok);
+    yajl_columns_get(c, 2, &col);
+    CHECK(col.length == 1 && col.offsets[1] == 1 && col.data[0] == 't');
+
+    /* a declared integer column takes no doubles */
+    CHECK(convert(c, "[{\"id\": 1.5}]", 1) == yajl_status_client_canceled);
+    CHECK(yajl_columns_error(c) != NULL);
+    yajl_columns_free(c);
+
+    CHECK(failure("[1]") != NULL);
+    CHECK(failure("[[]]") != NULL);
+    CHECK(failure("[{\"a\": 1, \"a\": 2}]") != NULL);
+    CHECK(failure("[{\"a\": [1]}]") != NULL);
+    CHECK(failure("[{\"a\": 1}, {\"a\": \"x\"}]") != NULL);
+    CHECK(failure("[{\"a\": true}, {\"a\": 1}]") != NULL);
+    CHECK(failure("[{\"a\": null}, {\"a\": 1}, {\"a\": null}]") == NULL);
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+/* ensure doubles worked out by the lexer are exactly what strtod gives,
+ * however the text is split across chunks */
+
+#include <yajl/yajl_parse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *numbers[] = {
+    "0.1", "-0.0", "0e400", "1E+2", "4.35", "-123.456e-7", "1e22", "1e23",
+    "1e-22", "0.000001234", "9007199254740993.0", "9007199254740992e1",
+    "123456789012345678901234567890.5", "0.1234567890123456789012",
+    "1.7976931348623157e308", "2.2250738585072014e-308", "5e-324",
+    "3.141592653589793238462643383279"};
+
+static double got;
+
+static int got_double(void *ctx, double d) {
+    got = d;
+    return 1;
+}
+
+static yajl_callbacks callbacks = {
+    NULL, NULL, NULL, got_double, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL,
+    NULL
+};
+
+int main(void) {
+    static const size_t chunks[] = {1, 2, 4096};
+    size_t c, i, j;
+
+    for (c = 0; c < sizeof(chunks) / sizeof(*chunks); c++) {
+        for (i = 0; i < sizeof(numbers) / sizeof(*numbers); i++) {
+            const char *text = numbers[i];
+            const size_t len = strlen(text);
+            const double want = strtod(text, NULL);
+            yajl_handle h = yajl_alloc(&callbacks, NULL, NULL);
+
+            got = 42;
+            for (j = 0; j < len; j += chunks[c]) {
+                if (yajl_parse(h, (const unsigned char *) text + j,
+                               len - j < chunks[c] ? len - j : chunks[c]) !=
+                    yajl_status_ok) {
+                    return 1;
+                }
+            }
+
+            if (yajl_complete_parse(h) != yajl_status_ok) return 1;
+            yajl_free(h);
+
+            if (memcmp(&got, &want, sizeof(got))) {
+                printf("%s: got %.17g, want %.17g\n", text, got, want);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
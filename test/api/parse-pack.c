@@ -0,0 +1,128 @@
+/* ensure json is transcoded to the expected MessagePack and CBOR bytes,
+ * with MessagePack headers patched to their smallest form */
+
+#include <yajl/yajl_pack.h>
+#include <yajl/yajl_parse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+/* transcode 'json' and compare with the 'expected' bytes, printing the
+ * difference.  returns non-zero if they match */
+static int check(yajl_pack_format format, const char *json,
+                 const unsigned char *expected, size_t expectedLen) {
+    yajl_pack p = yajl_pack_alloc(format);
+    yajl_handle h = yajl_alloc(yajl_pack_callbacks(p), NULL, p);
+    const unsigned char *out;
+    size_t len, i;
+    int ok;
+
+    yajl_config(h, yajl_allow_multiple_values, 1);
+    ok = yajl_parse(h, (const unsigned char *)json, strlen(json)) ==
+             yajl_status_ok &&
+         yajl_complete_parse(h) == yajl_status_ok;
+    yajl_pack_get_buf(p, &out, &len);
+    ok = ok && len == expectedLen && !memcmp(out, expected, len);
+    if (!ok) {
+        printf("%s %s:\n", format == yajl_pack_cbor ? "cbor" : "msgpack",
+               json);
+        for (i = 0; i < len; i++) {
+            printf("%02x ", out[i]);
+        }
+        printf("\n");
+    }
+
+    yajl_free(h);
+    yajl_pack_free(p);
+    return ok;
+}
+
+#define CHECK_PACK(format, json, ...)                                          \
+    do {                                                                       \
+        static const unsigned char expected[] = {__VA_ARGS__};                 \
+        CHECK(check(format, json, expected, sizeof(expected)));                \
+    } while (0)
+
+int main(void) {
+    static const char doc[] = "{\"a\": [1, -1, true, null, 2.5], \"b\": \"x\"}";
+    char *big;
+    size_t i;
+
+    CHECK_PACK(yajl_pack_msgpack, doc, 0x82, 0xa1, 'a', 0x95, 0x01, 0xff,
+               0xc3, 0xc0, 0xcb, 0x40, 0x04, 0, 0, 0, 0, 0, 0, 0xa1, 'b',
+               0xa1, 'x');
+    CHECK_PACK(yajl_pack_cbor, doc, 0xbf, 0x61, 'a', 0x9f, 0x01, 0x20, 0xf5,
+               0xf6, 0xfb, 0x40, 0x04, 0, 0, 0, 0, 0, 0, 0xff, 0x61, 'b',
+               0x61, 'x', 0xff);
+
+    /* integers at the edges of each size */
+    CHECK_PACK(yajl_pack_msgpack,
+               "[127, 128, -32, -33, -129, 65536, -9223372036854775807,"
+               " 18446744073709551615]",
+               0x98, 0x7f, 0xcc, 0x80, 0xe0, 0xd0, 0xdf, 0xd1, 0xff, 0x7f,
+               0xce, 0, 1, 0, 0, 0xd3, 0x80, 0, 0, 0, 0, 0, 0, 1, 0xcf, 0xff,
+               0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff);
+    CHECK_PACK(yajl_pack_cbor,
+               "[23, 24, -24, -25, 256, -9223372036854775807,"
+               " 18446744073709551615]",
+               0x9f, 0x17, 0x18, 0x18, 0x37, 0x38, 0x18, 0x19, 0x01, 0x00,
+               0x3b, 0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0x1b,
+               0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff);
+
+    /* nesting, and one value after another */
+    CHECK_PACK(yajl_pack_msgpack, "[[[]], {}] 7 [\"\"]", 0x92, 0x91, 0x90,
+               0x80, 0x07, 0x91, 0xa0);
+    CHECK_PACK(yajl_pack_cbor, "[[{}]] 7", 0x9f, 0x9f, 0xbf, 0xff, 0xff, 0xff,
+               0x07);
+
+    /* headers beyond the fixed forms: 40 byte strings, 16 and 70000
+     * element arrays */
+    CHECK_PACK(yajl_pack_msgpack,
+               "[\"0123456789012345678901234567890123456789\"]", 0x91, 0xd9,
+               40, '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '0',
+               '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '1', '2',
+               '3', '4', '5', '6', '7', '8', '9', '0', '1', '2', '3', '4',
+               '5', '6', '7', '8', '9');
+    CHECK_PACK(yajl_pack_msgpack,
+               "[[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0], []]", 0x92, 0xdc, 0, 16,
+               0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x90);
+
+    CHECK_PACK(yajl_pack_msgpack,
+               "[[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0], 1,"
+               " [0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]]", 0x93, 0xdc, 0, 16,
+               0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0xdc, 0, 16,
+               0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    CHECK_PACK(yajl_pack_msgpack,
+               "[{\"k\":[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]},"
+               " 2,3,4,5,6,7,8,9,10,11,12,13,14,15,16]", 0xdc, 0, 16, 0x81,
+               0xa1, 'k', 0xdc, 0, 16, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+               0, 0, 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+
+    big = malloc(70000 * 2 + 2);
+    big[0] = '[';
+    for (i = 0; i < 70000; i++) {
+        big[1 + 2 * i] = '0';
+        big[2 + 2 * i] = ',';
+    }
+    big[70000 * 2] = ']';
+    big[70000 * 2 + 1] = 0;
+    {
+        unsigned char *expected = calloc(70000 + 5, 1);
+        expected[0] = 0xdd;
+        expected[1] = 0;
+        expected[2] = 1;
+        expected[3] = 0x11;
+        expected[4] = 0x70;
+        CHECK(check(yajl_pack_msgpack, big, expected, 70000 + 5));
+        free(expected);
+    }
+    free(big);
+
+    return 0;
+}
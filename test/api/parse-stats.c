@@ -0,0 +1,107 @@
+/* ensure the parser counts values, depth and tokens spliced across chunks,
+ * that the tree parser adds the tree's own allocations, and that a buffer
+ * grown once counts once */
+
+#include <yajl/yajl_gen.h>
+#include <yajl/yajl_parse.h>
+#include <yajl/yajl_tree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPECT(field, want)                                                    \
+    if (s.field != (want)) {                                                   \
+        printf(#field ": got %zu, want %zu\n", s.field, (size_t) (want));      \
+        return 1;                                                              \
+    }
+
+static const char doc[] =
+    "{\"a\": [1, 2.5, \"x\", true, false, null],"
+    " \"b\\u0041\": {\"c\": [[\"long string value\\n\"]]},"
+    " \"d\": -12345678901}";
+
+int main(void) {
+    yajl_handle h;
+    yajl_stats s;
+    yajl_val root;
+    size_t i, wholeAllocations;
+
+    /* all at once, nothing is spliced */
+    h = yajl_alloc(NULL, NULL, NULL);
+    if (yajl_parse(h, (const unsigned char *) doc, sizeof(doc) - 1) !=
+            yajl_status_ok ||
+        yajl_complete_parse(h) != yajl_status_ok) {
+        return 1;
+    }
+
+    yajl_get_stats(h, &s);
+    EXPECT(nulls, 1);
+    EXPECT(booleans, 2);
+    EXPECT(integers, 2);
+    EXPECT(doubles, 1);
+    EXPECT(strings, 2);
+    EXPECT(maps, 2);
+    EXPECT(arrays, 3);
+    EXPECT(keys, 4);
+    EXPECT(escapedStrings, 2);
+    EXPECT(maxDepth, 4);
+    EXPECT(splicedTokens, 0);
+    if (!s.allocations || !s.peakBytes) return 1;
+    wholeAllocations = s.allocations;
+    yajl_free(h);
+
+    /* three bytes at a time, the counts are the same but longer tokens are
+     * pieced together in the lexer */
+    h = yajl_alloc(NULL, NULL, NULL);
+    for (i = 0; i < sizeof(doc) - 1; i += 3) {
+        size_t len = sizeof(doc) - 1 - i < 3 ? sizeof(doc) - 1 - i : 3;
+        if (yajl_parse(h, (const unsigned char *) doc + i, len) !=
+            yajl_status_ok) {
+            return 1;
+        }
+    }
+
+    if (yajl_complete_parse(h) != yajl_status_ok) return 1;
+    yajl_get_stats(h, &s);
+    EXPECT(integers, 2);
+    EXPECT(strings, 2);
+    EXPECT(keys, 4);
+    EXPECT(maxDepth, 4);
+    if (s.splicedTokens < 5) {
+        printf("splicedTokens: got %zu\n", s.splicedTokens);
+        return 1;
+    }
+
+    /* the lexer's buffer is an extra allocation */
+    if (s.allocations != wholeAllocations + 1) return 1;
+    yajl_free(h);
+
+    /* a tree adds a node per value, and strings for keys and scalars */
+    root = yajl_tree_parse_stats(doc, NULL, 0, &s);
+    if (!root) return 1;
+    EXPECT(keys, 4);
+    if (s.allocations < wholeAllocations + 11 + 4 + 5) {
+        printf("allocations: got %zu\n", s.allocations);
+        return 1;
+    }
+
+    yajl_tree_free(root);
+
+    /* a megabyte appended at once grows the output buffer in one go */
+    {
+        const size_t len = 1024 * 1024;
+        char *big = malloc(len);
+        yajl_gen g = yajl_gen_alloc();
+
+        memset(big, '1', len);
+        if (yajl_gen_raw_value(g, big, len) != yajl_gen_status_ok) return 1;
+        yajl_gen_get_stats(g, &s);
+        EXPECT(allocations, 1);
+        EXPECT(reallocs, 1);
+        EXPECT(bufferGrowths, 1);
+        yajl_gen_free(g);
+        free(big);
+    }
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+/* ensure replaying a tape gives any set of callbacks the same events as
+ * parsing would, errors included */
+
+#include <yajl/yajl_parse.h>
+#include <yajl/yajl_tape.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char doc[] =
+    "{\"a\": [1, -1, 0, -0, 9223372036854775807, -9223372036854775808,"
+    " 18446744073709551615, -2.5, 1e-400, 0.1e1,"
+    " 0.1234567890123456789012345678901234567890123456789012345678901234567],"
+    " \"s\\u00e9\": \"x\\ny\","
+    " \"t\": true, \"f\": false, \"n\": null, \"e\": {}}";
+
+/* every event is written out as text, numbers as what they were given */
+typedef struct {
+    char log[2048];
+    size_t len;
+} events;
+
+static int put(void *ctx, const char *fmt, const void *s, size_t len) {
+    events *e = ctx;
+    e->len += snprintf(e->log + e->len, sizeof(e->log) - e->len, fmt,
+                       (int)len, (const char *)s);
+    return 1;
+}
+
+static int ev_null(void *ctx) { return put(ctx, "null%.*s ", "", 0); }
+static int ev_boolean(void *ctx, int b) {
+    return put(ctx, "bool:%.*s ", b ? "t" : "f", 1);
+}
+static int ev_integer(void *ctx, long long i) {
+    char s[32];
+    return put(ctx, "int:%.*s ", s, snprintf(s, sizeof(s), "%lld", i));
+}
+static int ev_double(void *ctx, double d) {
+    char s[32];
+    return put(ctx, "dbl:%.*s ", s, snprintf(s, sizeof(s), "%.17g", d));
+}
+static int ev_number(void *ctx, const char *s, size_t l) {
+    return put(ctx, "num:%.*s ", s, l);
+}
+static int ev_string(void *ctx, const unsigned char *s, size_t l) {
+    return put(ctx, "str:%.*s ", s, l);
+}
+static int ev_key(void *ctx, const unsigned char *s, size_t l) {
+    return put(ctx, "key:%.*s ", s, l);
+}
+static int ev_start_map(void *ctx) { return put(ctx, "{%.*s ", "", 0); }
+static int ev_end_map(void *ctx) { return put(ctx, "}%.*s ", "", 0); }
+static int ev_start_array(void *ctx) { return put(ctx, "[%.*s ", "", 0); }
+static int ev_end_array(void *ctx) { return put(ctx, "]%.*s ", "", 0); }
+static int ev_unsigned(void *ctx, unsigned long long u) {
+    char s[32];
+    return put(ctx, "uns:%.*s ", s, snprintf(s, sizeof(s), "%llu", u));
+}
+
+static yajl_callbacks all = {
+    ev_null,    ev_boolean,   ev_integer,     ev_double,
+    ev_number,  ev_string,    ev_start_map,   ev_key,
+    ev_end_map, ev_start_array, ev_end_array, ev_unsigned
+};
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+static yajl_tape record(const char *text) {
+    yajl_tape tape = yajl_tape_alloc();
+    yajl_handle h = yajl_alloc(yajl_tape_recorder(), NULL, tape);
+    yajl_status st = yajl_parse(h, (const unsigned char *)text, strlen(text));
+
+    if (st == yajl_status_ok) {
+        st = yajl_complete_parse(h);
+    }
+
+    yajl_free(h);
+    if (st != yajl_status_ok) {
+        yajl_tape_free(tape);
+        return NULL;
+    }
+
+    return tape;
+}
+
+/* parse and replay with the same callbacks, the logs must match */
+static int compare(yajl_tape tape, const char *text,
+                   const yajl_callbacks *cb) {
+    events parsed, replayed;
+    yajl_handle h = yajl_alloc(cb, NULL, &parsed);
+    yajl_status st, rst;
+
+    parsed.len = replayed.len = 0;
+    st = yajl_parse(h, (const unsigned char *)text, strlen(text));
+    if (st == yajl_status_ok) {
+        st = yajl_complete_parse(h);
+    }
+
+    yajl_free(h);
+    rst = yajl_tape_replay(tape, cb, &replayed);
+    if (st != rst || parsed.len != replayed.len ||
+        memcmp(parsed.log, replayed.log, parsed.len) != 0) {
+        printf("parsed (%d): %.*s\nreplayed (%d): %.*s\n", st,
+               (int)parsed.len, parsed.log, rst, (int)replayed.len,
+               replayed.log);
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(void) {
+    yajl_callbacks numbers = all, values = all, signedOnly = all;
+    yajl_callbacks doublesOnly = all;
+    yajl_tape tape = record(doc), big;
+    const unsigned char *data;
+    size_t len;
+    events e;
+
+    numbers.yajl_integer = NULL;
+    numbers.yajl_double = NULL;
+    numbers.yajl_unsigned_integer = NULL;
+    values.yajl_number = NULL;
+    signedOnly.yajl_number = NULL;
+    signedOnly.yajl_unsigned_integer = NULL;
+    doublesOnly.yajl_number = NULL;
+    doublesOnly.yajl_integer = NULL;
+    doublesOnly.yajl_unsigned_integer = NULL;
+
+    CHECK(tape);
+    CHECK(compare(tape, doc, &all));
+    CHECK(compare(tape, doc, &numbers));
+    CHECK(compare(tape, doc, &values));
+    CHECK(compare(tape, doc, &signedOnly));
+    CHECK(compare(tape, doc, &doublesOnly));
+    CHECK(yajl_tape_replay(tape, NULL, NULL) == yajl_status_ok);
+
+    /* too big to convert, fine as text */
+    big = record("[1e400, 99999999999999999999, -9223372036854775809]");
+    CHECK(big);
+    CHECK(compare(big, "[1e400]", &values));
+    CHECK(compare(big, "[1e400, 99999999999999999999, -9223372036854775809]",
+                  &numbers));
+    yajl_tape_free(big);
+    big = record("[99999999999999999999]");
+    CHECK(compare(big, "[99999999999999999999]", &values));
+    CHECK(compare(big, "[99999999999999999999]", &doublesOnly));
+
+    /* a callback stopping the replay */
+    values.yajl_boolean = NULL;
+    values.yajl_null = NULL;
+    CHECK(compare(tape, doc, &values));
+
+    /* the bytes replay the same, and damage is caught */
+    data = yajl_tape_data(tape, &len);
+    e.len = 0;
+    CHECK(yajl_tape_replay_buffer(data, len, &all, &e) == yajl_status_ok);
+    yajl_tape_free(big);
+    big = record("\"abcdef\"");
+    data = yajl_tape_data(big, &len);
+    CHECK(yajl_tape_replay_buffer(data, len - 1, &all, &e) ==
+          yajl_status_error);
+    CHECK(yajl_tape_replay_buffer((const unsigned char *)"\xff", 1, &all,
+                                  &e) == yajl_status_error);
+
+    yajl_tape_clear(tape);
+    data = yajl_tape_data(tape, &len);
+    CHECK(len == 0);
+    yajl_tape_free(tape);
+    yajl_tape_free(big);
+    return 0;
+}
@@ -0,0 +1,268 @@
+/* ensure MessagePack is read into callbacks as the parser would hand them
+ * the equivalent JSON, however the input is split into chunks */
+
+#include <yajl/yajl_gen.h>
+#include <yajl/yajl_pack.h>
+#include <yajl/yajl_parse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+/* write everything back out with a generator, numbers as text or typed */
+
+static int gen_null(void *ctx) {
+    return yajl_gen_null(ctx) == yajl_gen_status_ok;
+}
+
+static int gen_boolean(void *ctx, int b) {
+    return yajl_gen_bool(ctx, b) == yajl_gen_status_ok;
+}
+
+static int gen_integer(void *ctx, long long i) {
+    return yajl_gen_integer(ctx, i) == yajl_gen_status_ok;
+}
+
+static int gen_double(void *ctx, double d) {
+    return yajl_gen_double(ctx, d) == yajl_gen_status_ok;
+}
+
+static int gen_number(void *ctx, const char *s, size_t l) {
+    return yajl_gen_number(ctx, s, l) == yajl_gen_status_ok;
+}
+
+static int gen_string(void *ctx, const unsigned char *s, size_t l) {
+    return yajl_gen_string(ctx, s, l) == yajl_gen_status_ok;
+}
+
+static int gen_start_map(void *ctx) {
+    return yajl_gen_map_open(ctx) == yajl_gen_status_ok;
+}
+
+static int gen_end_map(void *ctx) {
+    return yajl_gen_map_close(ctx) == yajl_gen_status_ok;
+}
+
+static int gen_start_array(void *ctx) {
+    return yajl_gen_array_open(ctx) == yajl_gen_status_ok;
+}
+
+static int gen_end_array(void *ctx) {
+    return yajl_gen_array_close(ctx) == yajl_gen_status_ok;
+}
+
+static int gen_unsigned(void *ctx, unsigned long long u) {
+    char text[32];
+    int n = snprintf(text, sizeof(text), "%llu", u);
+    return yajl_gen_number(ctx, text, (size_t)n) == yajl_gen_status_ok;
+}
+
+static const yajl_callbacks textCallbacks = {
+    gen_null,        gen_boolean, NULL,          NULL,
+    gen_number,      gen_string,  gen_start_map, gen_string,
+    gen_end_map,     gen_start_array, gen_end_array, NULL};
+
+static const yajl_callbacks typedCallbacks = {
+    gen_null,        gen_boolean, gen_integer,   gen_double,
+    NULL,            gen_string,  gen_start_map, gen_string,
+    gen_end_map,     gen_start_array, gen_end_array, gen_unsigned};
+
+/* integers with nowhere to go but yajl_integer */
+static const yajl_callbacks integerCallbacks = {
+    NULL, NULL, gen_integer, NULL, NULL, NULL,
+    NULL, NULL, NULL,        NULL, NULL, NULL};
+
+/* read 'len' bytes in chunks of 'chunk' into a generator, returning what
+ * it wrote or NULL if reading failed */
+static char *unpack(const yajl_callbacks *cb, const unsigned char *data,
+                    size_t len, size_t chunk) {
+    yajl_gen g = yajl_gen_alloc();
+    yajl_unpack u = yajl_unpack_alloc(cb, g);
+    yajl_status s = yajl_status_ok;
+    void *buf;
+    size_t bufLen, i;
+    char *out = NULL;
+
+    for (i = 0; i < len && s == yajl_status_ok; i += chunk) {
+        s = yajl_unpack_parse(u, data + i, len - i < chunk ? len - i : chunk);
+    }
+
+    if (s == yajl_status_ok && yajl_unpack_complete(u) == yajl_status_ok) {
+        yajl_gen_get_buf(g, &buf, &bufLen);
+        out = malloc(bufLen + 1);
+        memcpy(out, buf, bufLen);
+        out[bufLen] = 0;
+    }
+
+    yajl_unpack_free(u);
+    yajl_gen_free(g);
+    return out;
+}
+
+/* pack 'json', then read it back in every chunk size with both sets of
+ * callbacks and compare with the generator fed by the parser */
+static int round_trip(const char *json) {
+    const yajl_callbacks *sets[] = {&textCallbacks, &typedCallbacks};
+    yajl_pack p = yajl_pack_alloc(yajl_pack_msgpack);
+    yajl_handle h = yajl_alloc(yajl_pack_callbacks(p), NULL, p);
+    const unsigned char *packed;
+    void *buf;
+    size_t packedLen, bufLen, chunk, i;
+    int ok = 1;
+
+    yajl_parse(h, (const unsigned char *)json, strlen(json));
+    yajl_complete_parse(h);
+    yajl_pack_get_buf(p, &packed, &packedLen);
+
+    for (i = 0; i < 2 && ok; i++) {
+        yajl_gen g = yajl_gen_alloc();
+        yajl_handle direct = yajl_alloc(sets[i], NULL, g);
+
+        yajl_parse(direct, (const unsigned char *)json, strlen(json));
+        yajl_complete_parse(direct);
+        yajl_gen_get_buf(g, &buf, &bufLen);
+
+        for (chunk = 1; chunk <= packedLen && ok; chunk++) {
+            char *out = unpack(sets[i], packed, packedLen, chunk);
+            ok = out != NULL && strlen(out) == bufLen &&
+                 !memcmp(out, buf, bufLen);
+            if (!ok) {
+                printf("%s in chunks of %u: %s\n", json, (unsigned)chunk,
+                       out ? out : "(failed)");
+            }
+            free(out);
+        }
+
+        yajl_free(direct);
+        yajl_gen_free(g);
+    }
+
+    yajl_free(h);
+    yajl_pack_free(p);
+    return ok;
+}
+
+/* read hand written bytes, comparing what the generator writes (NULL for
+ * a failed read) */
+static int check(const yajl_callbacks *cb, const unsigned char *data,
+                 size_t len, const char *expected) {
+    char *out = unpack(cb, data, len, len);
+    int ok = expected ? out && !strcmp(out, expected) : out == NULL;
+
+    if (!ok) {
+        printf("expected %s, got %s\n", expected ? expected : "(failure)",
+               out ? out : "(failure)");
+    }
+
+    free(out);
+    return ok;
+}
+
+#define CHECK_UNPACK(cb, expected, ...)                                        \
+    do {                                                                       \
+        static const unsigned char data[] = {__VA_ARGS__};                     \
+        CHECK(check(cb, data, sizeof(data), expected));                        \
+    } while (0)
+
+static int cancel_string(void *ctx, const unsigned char *s, size_t l) {
+    (void)ctx;
+    (void)s;
+    (void)l;
+    return 0;
+}
+
+static long long sum;
+
+static int add_integer(void *ctx, long long i) {
+    (void)ctx;
+    sum += i;
+    return 1;
+}
+
+static const unsigned char *seen;
+
+static int see_string(void *ctx, const unsigned char *s, size_t l) {
+    (void)ctx;
+    (void)l;
+    seen = s;
+    return 1;
+}
+
+int main(void) {
+    static const unsigned char str[] = {0x92, 0xa2, 'h', 'i', 0xa1, 'x'};
+    static const unsigned char values[] = {0x01, 0x91, 0x02,
+                                           0xcd, 0x01, 0x00};
+    yajl_callbacks cb;
+    yajl_unpack u;
+    size_t i;
+
+    CHECK(round_trip("{\"a\": [1, -1, true, false, null, 2.5],"
+                     " \"b\": \"x\"}"));
+    CHECK(round_trip("[127, 128, -32, -33, -129, 65536, -2147483649,"
+                     " -9223372036854775807, 18446744073709551615]"));
+    CHECK(round_trip("[[[]], {}, {\"\": {}}, [\"\"]]"));
+    CHECK(round_trip("\"only\""));
+    CHECK(round_trip("[0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,"
+                     " {\"k\":[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0], \"l\":-0.25},"
+                     " \"0123456789012345678901234567890123456789\"]"));
+
+    /* what the transcoder never writes */
+    CHECK_UNPACK(&typedCallbacks, "[1.5,-3,4294967295]", 0x93, 0xca, 0x3f,
+                 0xc0, 0, 0, 0xd1, 0xff, 0xfd, 0xce, 0xff, 0xff, 0xff, 0xff);
+    CHECK_UNPACK(&textCallbacks, "[1.5,-3,4294967295]", 0x93, 0xca, 0x3f,
+                 0xc0, 0, 0, 0xd1, 0xff, 0xfd, 0xce, 0xff, 0xff, 0xff, 0xff);
+    CHECK_UNPACK(&textCallbacks, "{\"k\":\"v\"}", 0xdf, 0, 0, 0, 1, 0xda, 0,
+                 1, 'k', 0xdb, 0, 0, 0, 1, 'v');
+
+    /* and what has no JSON equivalent */
+    CHECK_UNPACK(&textCallbacks, NULL, 0xc4, 0x01, 0x00);
+    CHECK_UNPACK(&textCallbacks, NULL, 0xd4, 0x01, 0x00);
+    CHECK_UNPACK(&textCallbacks, NULL, 0xc1);
+    CHECK_UNPACK(&textCallbacks, NULL, 0x81, 0x01, 0x02);
+    CHECK_UNPACK(&textCallbacks, NULL, 0xcb, 0x7f, 0xf8, 0, 0, 0, 0, 0, 0);
+    CHECK_UNPACK(&integerCallbacks, NULL, 0xcf, 0xff, 0xff, 0xff, 0xff, 0xff,
+                 0xff, 0xff, 0xff);
+    CHECK_UNPACK(&textCallbacks, "18446744073709551615", 0xcf, 0xff, 0xff,
+                 0xff, 0xff, 0xff, 0xff, 0xff, 0xff);
+
+    /* input which stops part way through a value */
+    CHECK_UNPACK(&textCallbacks, NULL, 0x92, 0x01);
+    CHECK_UNPACK(&textCallbacks, NULL, 0xa3, 'a', 'b');
+    CHECK_UNPACK(&textCallbacks, NULL, 0xda, 0x00);
+
+    /* one value after another */
+    memset(&cb, 0, sizeof(cb));
+    cb.yajl_integer = add_integer;
+    u = yajl_unpack_alloc(&cb, NULL);
+    for (i = 0; i < sizeof(values); i++) {
+        CHECK(yajl_unpack_parse(u, values + i, 1) == yajl_status_ok);
+    }
+    CHECK(yajl_unpack_complete(u) == yajl_status_ok);
+    CHECK(sum == 259);
+    yajl_unpack_free(u);
+
+    /* strings are handed over from the input itself */
+    cb.yajl_integer = NULL;
+    cb.yajl_string = see_string;
+    u = yajl_unpack_alloc(&cb, NULL);
+    CHECK(yajl_unpack_parse(u, str, sizeof(str)) == yajl_status_ok);
+    CHECK(seen == str + 5);
+    CHECK(yajl_unpack_error(u) == NULL);
+    yajl_unpack_free(u);
+
+    /* a callback can stop reading, which stays stopped */
+    cb.yajl_string = cancel_string;
+    u = yajl_unpack_alloc(&cb, NULL);
+    CHECK(yajl_unpack_parse(u, str, sizeof(str)) ==
+          yajl_status_client_canceled);
+    CHECK(yajl_unpack_error(u) != NULL);
+    CHECK(yajl_unpack_parse(u, str, sizeof(str)) == yajl_status_error);
+    yajl_unpack_free(u);
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+/* ensure integers are converted exactly at every length, that those beyond
+ * LLONG_MAX go to yajl_unsigned_integer, and that beyond ULLONG_MAX is
+ * still an overflow */
+
+#include <yajl/yajl_parse.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    long long i;
+    unsigned long long u;
+    int gotInteger, gotUnsigned;
+} result;
+
+static int got_integer(void *ctx, long long i) {
+    result *r = ctx;
+    r->i = i;
+    r->gotInteger++;
+    return 1;
+}
+
+static int got_unsigned(void *ctx, unsigned long long u) {
+    result *r = ctx;
+    r->u = u;
+    r->gotUnsigned++;
+    return 1;
+}
+
+static yajl_callbacks callbacks = {
+    NULL, NULL, got_integer, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL,
+    got_unsigned
+};
+
+/* parse 'text' a 'chunk' bytes at a time, returns the final status */
+static yajl_status parse(const char *text, size_t chunk, result *r) {
+    const size_t len = strlen(text);
+    yajl_handle h = yajl_alloc(&callbacks, NULL, r);
+    yajl_status st = yajl_status_ok;
+    size_t i;
+
+    memset(r, 0, sizeof(*r));
+    for (i = 0; i < len && st == yajl_status_ok; i += chunk) {
+        st = yajl_parse(h, (const unsigned char *) text + i,
+                        len - i < chunk ? len - i : chunk);
+    }
+
+    if (st == yajl_status_ok) st = yajl_complete_parse(h);
+    yajl_free(h);
+    return st;
+}
+
+int main(void) {
+    static const size_t chunks[] = {1, 3, 4096};
+    char text[32];
+    result r;
+    size_t c;
+
+    for (c = 0; c < sizeof(chunks) / sizeof(*chunks); c++) {
+        unsigned long long v = 0;
+        int digits;
+
+        /* every length from 1 to 20 digits, both signs where they fit */
+        for (digits = 1; digits <= 20; digits++) {
+            v = v * 10 + (unsigned long long) (digits % 10);
+            snprintf(text, sizeof(text), "%llu", v);
+            if (parse(text, chunks[c], &r) != yajl_status_ok) return 1;
+            if (v <= LLONG_MAX) {
+                if (r.gotInteger != 1 || r.i != (long long) v) return 1;
+                snprintf(text, sizeof(text), "-%llu", v);
+                if (parse(text, chunks[c], &r) != yajl_status_ok ||
+                    r.gotInteger != 1 || r.i != -(long long) v) {
+                    return 1;
+                }
+            } else if (r.gotUnsigned != 1 || r.u != v) {
+                printf("%s: got %llu\n", text, r.u);
+                return 1;
+            }
+        }
+
+        if (parse("9223372036854775807", chunks[c], &r) != yajl_status_ok ||
+            r.gotInteger != 1 || r.i != LLONG_MAX) {
+            return 1;
+        }
+
+        if (parse("9223372036854775808", chunks[c], &r) != yajl_status_ok ||
+            r.gotUnsigned != 1 || r.u != (unsigned long long) LLONG_MAX + 1) {
+            return 1;
+        }
+
+        if (parse("18446744073709551615", chunks[c], &r) != yajl_status_ok ||
+            r.gotUnsigned != 1 || r.u != ULLONG_MAX) {
+            return 1;
+        }
+
+        /* too big for either, or too small */
+        if (parse("18446744073709551616", chunks[c], &r) != yajl_status_error ||
+            parse("123456789012345678901", chunks[c], &r) !=
+                yajl_status_error ||
+            parse("-9223372036854775809", chunks[c], &r) != yajl_status_error) {
+            return 1;
+        }
+    }
+
+    /* without the callback a large positive integer is an overflow */
+    callbacks.yajl_unsigned_integer = NULL;
+    if (parse("9223372036854775808", 4096, &r) != yajl_status_error) return 1;
+
+    return 0;
+}
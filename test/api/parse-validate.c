@@ -0,0 +1,111 @@
+/* ensure yajl_validate() accepts what the parser accepts with the same
+ * options, and says where the text went wrong */
+
+#include <yajl/yajl_parse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+static int parses(const char *json, size_t len, unsigned int flags) {
+    yajl_handle h = yajl_alloc(NULL, NULL, NULL);
+    yajl_status s;
+    unsigned int opt;
+
+    for (opt = yajl_allow_comments; opt <= yajl_allow_partial_values;
+         opt <<= 1) {
+        yajl_config(h, (yajl_option)opt, (flags & opt) != 0);
+    }
+
+    s = yajl_parse(h, (const unsigned char *)json, len);
+    if (s == yajl_status_ok) {
+        s = yajl_complete_parse(h);
+    }
+
+    yajl_free(h);
+    return s == yajl_status_ok;
+}
+
+/* the validator and the parser agree on 'json' under every set of
+ * options */
+static int agree(const char *json) {
+    const size_t len = strlen(json);
+    unsigned int flags;
+
+    for (flags = 0; flags < 2 * yajl_allow_partial_values; flags++) {
+        const int valid = yajl_validate((const unsigned char *)json, len,
+                                         flags, NULL) == yajl_status_ok;
+        if (valid != parses(json, len, flags)) {
+            printf("'%s' with flags %u: validator says %s\n", json, flags,
+                   valid ? "valid" : "invalid");
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* where the validator says 'json' went wrong, -1 if it didn't */
+static long error_at(const char *json, unsigned int flags) {
+    size_t offset = 0;
+
+    if (yajl_validate((const unsigned char *)json, strlen(json), flags,
+                      &offset) == yajl_status_ok) {
+        return -1;
+    }
+
+    return (long)offset;
+}
+
+int main(void) {
+    static const char *texts[] = {
+        "", " ", "1", "-", "-0", "01", "1.", "1.5e", "1e+5", "-12.5E-3x",
+        "tru", "true", "truex", "nul", "null null", "[1,2]", "[1,]", "[,1]",
+        "{}", "{\"a\":1}", "{\"a\" 1}", "{\"a\":}", "{\"a\":1,}", "{1:2}",
+        "[{\"a\":[{}]}]", "[}", "{]", "[[]", "[]]", "\"\\u00e9\"", "\"\\u0g\"",
+        "\"\\x\"", "\"\\", "\"abc", "\"a\x01\"", "\"\xc3\xa9\"", "\"\xc3\"",
+        "\"\xc3(\"", "\"\x80\"", "\"\xf0\x9f\x98\x80\"", "\"\xff\"",
+        "1 \"abc", "[1 \"abc", "{\"a\" \"b", "1 /* open", "1 /", "1 //",
+        "/**/1/**/", "[1/*,*/]", "// only", "1 2", "[1][2]", "{}{}x",
+        "1 [", "\t\n\v\f\r1\r\n", "[\"aaaaaaaaaaaaaaaaaaaaaaaa\\\"aaaaaa\"]",
+        "[\"aaaaaaaaaaaaaaaa\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9" "aaaaaaaaaaa\"]"};
+    size_t i;
+    char *deep;
+
+    for (i = 0; i < sizeof(texts) / sizeof(*texts); i++) {
+        CHECK(agree(texts[i]));
+    }
+
+    /* where it went wrong */
+    CHECK(error_at("[1,2]", 0) == -1);
+    CHECK(error_at("[1,]", 0) == 3);
+    CHECK(error_at("{\"a\":1 x}", 0) == 7);
+    CHECK(error_at("\"ab\x01\"", 0) == 3);
+    CHECK(error_at("\"ab\xc3(\"", 0) == 4);
+    CHECK(error_at("\"ab\xc3(\"", yajl_dont_validate_strings) == -1);
+    CHECK(error_at("[1,2", 0) == 4);
+    CHECK(error_at("[1,2", yajl_allow_partial_values) == -1);
+    CHECK(error_at("1 x", 0) == 2);
+    CHECK(error_at("1 x", yajl_allow_trailing_garbage) == -1);
+
+    /* deeper than the validator keeps on the stack */
+    deep = malloc(2 * 5000 + 1);
+    for (i = 0; i < 5000; i++) {
+        deep[i] = '[';
+        deep[2 * 5000 - 1 - i] = ']';
+    }
+
+    deep[2 * 5000] = 0;
+    CHECK(agree(deep));
+    CHECK(error_at(deep, 0) == -1);
+    deep[2 * 5000 - 1] = '}';
+    CHECK(error_at(deep, 0) == 2 * 5000 - 1);
+    free(deep);
+
+    return 0;
+}
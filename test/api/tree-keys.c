@@ -0,0 +1,158 @@
+/* ensure repeated object keys in a tree share one copy, which outlives
+ * any one of the objects using it, and that objects with the same keys
+ * share one array of them */
+
+#include <yajl/yajl_tree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char doc[] =
+    "[{\"id\": 1, \"name\": \"a\", \"tags\": {\"id\": \"x\"}},"
+    " {\"name\": \"b\", \"id\": 2},"
+    " {\"i\": 3, \"idx\": 4, \"\": 5, \"\": 6}]";
+
+/* records with enough keys to be indexed, one with a repeated key */
+static const char records[] =
+    "[{\"a\":0,\"b\":1,\"c\":2,\"d\":3,\"e\":4,\"f\":5,\"g\":6,\"h\":7,"
+    "  \"i\":8},"
+    " {\"a\":10,\"b\":11,\"c\":12,\"d\":13,\"e\":14,\"f\":15,\"g\":16,"
+    "  \"h\":17,\"i\":18},"
+    " {\"i\":20,\"a\":21},"
+    " {\"a\":30,\"b\":31,\"c\":32,\"d\":33,\"e\":34,\"f\":35,\"g\":36,"
+    "  \"h\":37,\"i\":38,\"i\":39}]";
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+static char *copy(const char *s) {
+    char *c = malloc(strlen(s) + 1);
+    return c ? strcpy(c, s) : NULL;
+}
+
+int main(void) {
+    const char *path[] = {"id", NULL};
+    yajl_val root, first, second, third;
+
+    root = yajl_tree_parse(doc, NULL, 0);
+    CHECK(root && root->u.array.len == 3);
+    first = root->u.array.values[0];
+    second = root->u.array.values[1];
+    third = root->u.array.values[2];
+
+    /* the same key is the same pointer, at any depth */
+    CHECK(!strcmp(first->u.object.keys[0], "id"));
+    CHECK(first->u.object.keys[0] == second->u.object.keys[1]);
+    CHECK(first->u.object.flags & YAJL_OBJECT_SHARED_KEYS);
+    CHECK(first->u.object.keys[0] ==
+          first->u.object.values[2]->u.object.keys[0]);
+    CHECK(first->u.object.keys[1] == second->u.object.keys[0]);
+    CHECK(third->u.object.keys[2] == third->u.object.keys[3]);
+
+    /* and different keys are not, however alike */
+    CHECK(!strcmp(third->u.object.keys[0], "i"));
+    CHECK(!strcmp(third->u.object.keys[1], "idx"));
+    CHECK(!strcmp(third->u.object.keys[2], ""));
+    CHECK(third->u.object.keys[0] != first->u.object.keys[0]);
+
+    /* a key from the tree is found by its address */
+    path[0] = first->u.object.keys[0];
+    CHECK(YAJL_GET_INTEGER(yajl_tree_get(second, path, yajl_t_number)) == 2);
+    path[0] = "name";
+    CHECK(YAJL_GET_STRING(yajl_tree_get(second, path, yajl_t_string))[0] ==
+          'b');
+
+    /* objects with the same keys in the same order share them */
+    CHECK(first->u.object.keys != second->u.object.keys);
+    yajl_tree_free(root);
+
+    root = yajl_tree_parse(records, NULL, 0);
+    CHECK(root && root->u.array.len == 4);
+    CHECK(root->u.array.values[0]->u.object.keys ==
+          root->u.array.values[1]->u.object.keys);
+    CHECK(root->u.array.values[0]->u.object.keys !=
+          root->u.array.values[3]->u.object.keys);
+
+    /* by the index of a large object, the first of a repeated key */
+    path[0] = "i";
+    CHECK(YAJL_GET_INTEGER(yajl_tree_get(root->u.array.values[1], path,
+                                         yajl_t_number)) == 18);
+    CHECK(YAJL_GET_INTEGER(yajl_tree_get(root->u.array.values[3], path,
+                                         yajl_t_number)) == 38);
+    path[0] = "j";
+    CHECK(yajl_tree_get(root->u.array.values[3], path, yajl_t_any) == NULL);
+
+    /* a cached lookup follows the records through their shapes */
+    {
+        static const long long expected[] = {8, 18, 20, 38};
+        yajl_tree_cache cache;
+        size_t i;
+
+        memset(&cache, 0, sizeof(cache));
+        for (i = 0; i < 4; i++) {
+            yajl_val v = yajl_tree_get_cached(root->u.array.values[i], "i",
+                                              &cache);
+            CHECK(v && YAJL_GET_INTEGER(v) == expected[i]);
+        }
+
+        CHECK(cache.keys == root->u.array.values[3]->u.object.keys);
+        CHECK(yajl_tree_get_cached(root->u.array.values[3], "j", &cache) ==
+              NULL);
+        CHECK(yajl_tree_get_cached(root, "i", &cache) == NULL);
+
+        /* and is only trusted while the key is where it was */
+        cache.keys = root->u.array.values[0]->u.object.keys;
+        cache.slot = 0;
+        CHECK(YAJL_GET_INTEGER(yajl_tree_get_cached(root->u.array.values[0],
+                                                    "i", &cache)) == 8);
+    }
+
+    yajl_tree_free(root);
+
+    /* objects built by hand own their keys, and have no shape to index,
+     * even with flags left uninitialized.  their numbers own their text */
+    {
+        const char *key[] = {"b", NULL};
+        yajl_val obj = malloc(sizeof(*obj));
+        yajl_val val = calloc(1, sizeof(*val));
+        yajl_val num = calloc(1, sizeof(*num));
+        yajl_tree_cache cache = {NULL, 0};
+
+        memset(obj, 0xff, sizeof(*obj));
+        obj->type = yajl_t_object;
+        obj->u.object.keys = malloc(2 * sizeof(*obj->u.object.keys));
+        obj->u.object.values = malloc(2 * sizeof(*obj->u.object.values));
+        obj->u.object.keys[0] = copy("a");
+        obj->u.object.keys[1] = copy("b");
+        obj->u.object.values[0] = num;
+        obj->u.object.values[1] = val;
+        obj->u.object.len = 2;
+        val->type = yajl_t_null;
+        num->type = yajl_t_number;
+        num->u.number.r = copy("12");
+        num->u.number.len = 2;
+
+        CHECK(yajl_tree_get(obj, key, yajl_t_null) == val);
+        CHECK(yajl_tree_get_cached(obj, "b", &cache) == val);
+        yajl_tree_free(obj);
+    }
+
+    /* a failed parse gives back what it had built, including the keys of
+     * unfinished objects */
+    {
+        static const char *broken[] = {
+            "{\"a\":[{\"b\":1,\"c\":", "[{\"a\":1},{\"a\":{\"b\":[1,",
+            "{\"a\":1,\"a\"", "{\"a\":{} x", "[{\"a\":1}] x"};
+        char err[64];
+        size_t i;
+
+        for (i = 0; i < sizeof(broken) / sizeof(*broken); i++) {
+            CHECK(yajl_tree_parse(broken[i], err, sizeof(err)) == NULL);
+        }
+    }
+
+    return 0;
+}
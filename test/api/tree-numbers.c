@@ -0,0 +1,89 @@
+/* ensure numbers in a tree are converted as it's built unless they're
+ * asked to be left until wanted, that exact numbers are views into the
+ * input, and that they convert to decimal128 exactly */
+
+#include <yajl/yajl_tree.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char doc[] =
+    "[12, -0.5, 1e400, 12345678901234567890123456789012.34, "
+    "123456789012345678901234567890123456, "
+    "1.000000000000000000000000000000000000000]";
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+int main(void) {
+    yajl_val root, v;
+    yajl_decimal128 d;
+
+    root = yajl_tree_parse_options(
+        doc, yajl_tree_exact_numbers | yajl_tree_lazy_numbers, NULL, 0);
+    CHECK(root && root->u.array.len == 6);
+
+    /* nothing converted yet, and the text is the input's */
+    v = root->u.array.values[0];
+    CHECK(v->u.number.flags == (YAJL_NUMBER_LAZY | YAJL_NUMBER_VIEW));
+    CHECK(YAJL_GET_NUMBER(v) == doc + 1 && YAJL_GET_NUMBER_LENGTH(v) == 2);
+    CHECK(YAJL_IS_INTEGER(v) && YAJL_GET_INTEGER(v) == 12);
+    CHECK(!(v->u.number.flags & YAJL_NUMBER_LAZY));
+
+    v = root->u.array.values[1];
+    CHECK(!YAJL_IS_INTEGER(v) && YAJL_IS_DOUBLE(v));
+    CHECK(YAJL_GET_DOUBLE(v) == -0.5);
+    CHECK(yajl_tree_get_decimal128(v, &d));
+    CHECK(d.high == 0xB03E000000000000ULL && d.low == 5);
+
+    /* out of range as a double, but not as decimal128 */
+    v = root->u.array.values[2];
+    CHECK(!YAJL_IS_DOUBLE(v));
+    CHECK(yajl_tree_get_decimal128(v, &d));
+    CHECK(d.high == 0x3040000000000000ULL + (400ULL << 49) && d.low == 1);
+
+    /* 34 digits fit, 36 don't unless the extra are zeros */
+    v = root->u.array.values[3];
+    CHECK(yajl_tree_get_decimal128(v, &d));
+    CHECK(d.high == 0x303C3CDE6FFF9732ULL && d.low == 0xDE825CD07E96AFF2ULL);
+    CHECK(!yajl_tree_get_decimal128(root->u.array.values[4], &d));
+    CHECK(yajl_tree_get_decimal128(root->u.array.values[5], &d));
+    CHECK(d.high == 0x2FFE314DC6448D93ULL && d.low == 0x38C15B0A00000000ULL);
+    yajl_tree_free(root);
+
+    /* a number at the very end is pieced together, so it's copied */
+    root = yajl_tree_parse_options(
+        "1234", yajl_tree_exact_numbers | yajl_tree_lazy_numbers, NULL, 0);
+    CHECK(root && root->u.number.flags == YAJL_NUMBER_LAZY);
+    CHECK(!strcmp(YAJL_GET_NUMBER(root), "1234"));
+    CHECK(YAJL_GET_INTEGER(root) == 1234);
+    yajl_tree_free(root);
+
+    /* exact numbers are converted up front too, unless asked not to */
+    root = yajl_tree_parse_options(doc, yajl_tree_exact_numbers, NULL, 0);
+    v = root->u.array.values[0];
+    CHECK(v->u.number.flags == (YAJL_NUMBER_INT_VALID |
+                                YAJL_NUMBER_DOUBLE_VALID | YAJL_NUMBER_VIEW));
+    yajl_tree_free(root);
+
+    /* without options the text is a copy, and the members are filled in
+     * while parsing: integers are also doubles */
+    root = yajl_tree_parse(doc, NULL, 0);
+    v = root->u.array.values[0];
+    CHECK(v->u.number.flags ==
+          (YAJL_NUMBER_INT_VALID | YAJL_NUMBER_DOUBLE_VALID));
+    CHECK(!strcmp(YAJL_GET_NUMBER(v), "12"));
+    CHECK(v->u.number.i == 12 && v->u.number.d == 12.0);
+    CHECK(YAJL_IS_DOUBLE(v) && YAJL_GET_DOUBLE(v) == 12.0);
+    CHECK(YAJL_GET_INTEGER(v) == 12);
+    v = root->u.array.values[1];
+    CHECK(v->u.number.flags == YAJL_NUMBER_DOUBLE_VALID);
+    CHECK(v->u.number.d == -0.5 && !YAJL_IS_INTEGER(v));
+    v = root->u.array.values[2];
+    CHECK(v->u.number.flags == 0);
+    yajl_tree_free(root);
+
+    return 0;
+}
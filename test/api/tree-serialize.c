@@ -0,0 +1,104 @@
+/* ensure serializing a tree gives what the generator gives for the same
+ * document, and that the size can be found before anything is written */
+
+#include <yajl/yajl_gen.h>
+#include <yajl/yajl_tree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char doc[] =
+    "{\"a\": [1, -2.5e3, true, false, null, {}, [], [[]]],"
+    " \"esc\\\"aped\": \"tab\\tnew\\nline\\r\\f\\b\\\\ /\\u0001\\u001f\","
+    " \"utf\": \"\\u00e9\\ud83d\\ude00\", \"\": {\"x\": {\"y\": \"\"}}}";
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+static void gen_value(yajl_gen g, yajl_val v) {
+    size_t i;
+
+    if (YAJL_IS_OBJECT(v)) {
+        yajl_gen_map_open(g);
+        for (i = 0; i < v->u.object.len; i++) {
+            const char *key = v->u.object.keys[i];
+            yajl_gen_string(g, key, strlen(key));
+            gen_value(g, v->u.object.values[i]);
+        }
+        yajl_gen_map_close(g);
+    } else if (YAJL_IS_ARRAY(v)) {
+        yajl_gen_array_open(g);
+        for (i = 0; i < v->u.array.len; i++) {
+            gen_value(g, v->u.array.values[i]);
+        }
+        yajl_gen_array_close(g);
+    } else if (YAJL_IS_STRING(v)) {
+        yajl_gen_string(g, v->u.string, strlen(v->u.string));
+    } else if (YAJL_IS_NUMBER(v)) {
+        yajl_gen_number(g, YAJL_GET_NUMBER(v), YAJL_GET_NUMBER_LENGTH(v));
+    } else if (YAJL_IS_NULL(v)) {
+        yajl_gen_null(g);
+    } else {
+        yajl_gen_bool(g, YAJL_IS_TRUE(v));
+    }
+}
+
+/* serialize 'v' both ways and compare with the generator */
+static int check(yajl_val v, unsigned int options) {
+    yajl_gen g = yajl_gen_alloc();
+    void *expected;
+    size_t expectedLen, len;
+    char small[8], *text;
+    int ok;
+
+    yajl_gen_config(g, yajl_gen_beautify,
+                    (options & yajl_tree_serialize_beautify) != 0);
+    yajl_gen_config(g, yajl_gen_escape_solidus,
+                    (options & yajl_tree_serialize_escape_solidus) != 0);
+    gen_value(g, v);
+    yajl_gen_get_buf(g, &expected, &expectedLen);
+
+    /* measured exactly, and nothing written when it doesn't fit */
+    memset(small, 'x', sizeof(small));
+    len = yajl_tree_serialize(v, options, small, sizeof(small));
+    ok = len == expectedLen && small[sizeof(small) - 1] == 'x';
+    ok = ok && yajl_tree_serialize(v, options, NULL, 0) == expectedLen;
+
+    text = yajl_tree_serialize_alloc(v, options, &len);
+    ok = ok && text && len == expectedLen && text[len] == 0 &&
+         !memcmp(text, expected, len);
+    if (!ok) {
+        printf("options %u: expected\n%s\ngot\n%s\n", options,
+               (char *)expected, text ? text : "(null)");
+    }
+
+    free(text);
+    yajl_gen_free(g);
+    return ok;
+}
+
+int main(void) {
+    char buf[16];
+    yajl_val root;
+    unsigned int options;
+
+    root = yajl_tree_parse_options(doc, yajl_tree_exact_numbers, NULL, 0);
+    CHECK(root);
+    for (options = 0; options < 4; options++) {
+        CHECK(check(root, options));
+        CHECK(check(root->u.object.values[0], options));
+    }
+
+    /* a scalar on its own, into a buffer with exactly enough room */
+    CHECK(yajl_tree_serialize(root->u.object.values[0]->u.array.values[1], 0,
+                              buf, 7) == 6);
+    CHECK(!strcmp(buf, "-2.5e3"));
+    CHECK(yajl_tree_serialize(root->u.object.values[0]->u.array.values[1], 0,
+                              buf, 6) == 6);
+    yajl_tree_free(root);
+
+    return 0;
+}
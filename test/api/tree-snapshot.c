@@ -0,0 +1,109 @@
+/* ensure a snapshot of a tree reads back the same through its accessors,
+ * from memory and from a mapped file, and that damaged ones are caught */
+
+#include <yajl/yajl_snap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char doc[] =
+    "{\"name\": \"yajl\", \"port\": 8080, \"ratio\": -0.25, \"big\": 1e400,"
+    " \"tags\": [\"a\", \"\", true, false, null, [], {}],"
+    " \"nested\": {\"deeper\": {\"n\": 12345678901234}}}";
+
+#define CHECK(cond)                                                            \
+    if (!(cond)) {                                                             \
+        printf("failed: %s\n", #cond);                                         \
+        return 1;                                                              \
+    }
+
+/* an accessor gave 'expect', rather than NULL */
+static int same(const char *s, const char *expect) {
+    return s != NULL && !strcmp(s, expect);
+}
+
+static int check_root(yajl_snap_val root) {
+    static const char *port[] = {"port", NULL};
+    static const char *n[] = {"nested", "deeper", "n", NULL};
+    static const char *missing[] = {"nested", "nope", NULL};
+    yajl_snap_val v;
+
+    CHECK(YAJL_SNAP_IS_OBJECT(root) && YAJL_SNAP_GET_COUNT(root) == 6);
+    CHECK(same(YAJL_SNAP_GET_KEY(root, 0), "name"));
+    v = YAJL_SNAP_GET_VALUE(root, 0);
+    CHECK(same(YAJL_SNAP_GET_STRING(v), "yajl"));
+    CHECK(YAJL_SNAP_GET_LENGTH(v) == 4);
+
+    v = yajl_snap_get(root, port, yajl_t_number);
+    CHECK(YAJL_SNAP_IS_INTEGER(v) && YAJL_SNAP_GET_INTEGER(v) == 8080);
+    CHECK(YAJL_SNAP_GET_DOUBLE(v) == 8080.0);
+    CHECK(same(YAJL_SNAP_GET_NUMBER(v), "8080"));
+    CHECK(yajl_snap_get(root, port, yajl_t_string) == NULL);
+
+    v = YAJL_SNAP_GET_VALUE(root, 2);
+    CHECK(!YAJL_SNAP_IS_INTEGER(v) && YAJL_SNAP_GET_DOUBLE(v) == -0.25);
+    v = YAJL_SNAP_GET_VALUE(root, 3);
+    CHECK(YAJL_SNAP_IS_NUMBER(v) && !YAJL_SNAP_IS_DOUBLE(v));
+    CHECK(same(YAJL_SNAP_GET_NUMBER(v), "1e400"));
+
+    v = YAJL_SNAP_GET_VALUE(root, 4);
+    CHECK(YAJL_SNAP_IS_ARRAY(v) && YAJL_SNAP_GET_COUNT(v) == 7);
+    CHECK(same(YAJL_SNAP_GET_STRING(YAJL_SNAP_GET_ELEMENT(v, 1)), ""));
+    CHECK(YAJL_SNAP_IS_TRUE(YAJL_SNAP_GET_ELEMENT(v, 2)));
+    CHECK(YAJL_SNAP_IS_FALSE(YAJL_SNAP_GET_ELEMENT(v, 3)));
+    CHECK(YAJL_SNAP_IS_NULL(YAJL_SNAP_GET_ELEMENT(v, 4)));
+    CHECK(YAJL_SNAP_GET_COUNT(YAJL_SNAP_GET_ELEMENT(v, 5)) == 0);
+    CHECK(YAJL_SNAP_IS_OBJECT(YAJL_SNAP_GET_ELEMENT(v, 6)));
+
+    v = yajl_snap_get(root, n, yajl_t_any);
+    CHECK(YAJL_SNAP_GET_INTEGER(v) == 12345678901234LL);
+    CHECK(yajl_snap_get(root, missing, yajl_t_any) == NULL);
+    return 0;
+}
+
+int main(void) {
+    const char *filename = "tree-snapshot.snap";
+    yajl_val tree = yajl_tree_parse(doc, NULL, 0);
+    struct yajl_snap_node_s *node;
+    size_t size;
+    char err[256];
+    yajl_snap s;
+    char *buf;
+
+    CHECK(tree);
+    size = yajl_snap_serialize(tree, NULL, 0);
+    CHECK(size > 0 && size % 8 == 0);
+    buf = malloc(size);
+    CHECK(yajl_snap_serialize(tree, buf, size) == size);
+
+    s = yajl_snap_from_buffer(buf, size, err, sizeof(err));
+    CHECK(s && yajl_snap_verify(s));
+    CHECK(check_root(yajl_snap_root(s)) == 0);
+    yajl_snap_close(s);
+
+    /* short and damaged snapshots */
+    CHECK(!yajl_snap_from_buffer(buf, size - 8, err, sizeof(err)));
+    CHECK(!strcmp(err, "snapshot is truncated"));
+    CHECK(!yajl_snap_from_buffer(doc, sizeof(doc), NULL, 0));
+    s = yajl_snap_from_buffer(buf, size, NULL, 0);
+    node = (struct yajl_snap_node_s *)YAJL_SNAP_GET_VALUE(yajl_snap_root(s), 4);
+    node->off = -node->off;
+    CHECK(!yajl_snap_verify(s));
+    node->off = -node->off;
+    node->len = 1000;
+    CHECK(!yajl_snap_verify(s));
+    yajl_snap_close(s);
+
+    /* through a file */
+    CHECK(yajl_snap_save(tree, filename, err, sizeof(err)));
+    s = yajl_snap_open(filename, err, sizeof(err));
+    CHECK(s && yajl_snap_verify(s));
+    CHECK(check_root(yajl_snap_root(s)) == 0);
+    yajl_snap_close(s);
+    remove(filename);
+    CHECK(!yajl_snap_open(filename, err, sizeof(err)));
+
+    free(buf);
+    yajl_tree_free(tree);
+    return 0;
+}
@@ -145,7 +145,8 @@ static yajl_callbacks callbacks = {
     test_yajl_map_key,
     test_yajl_end_map,
     test_yajl_start_array,
-    test_yajl_end_array
+    test_yajl_end_array,
+    NULL
 };
 
 static void usage(const char * progname)
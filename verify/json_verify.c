@@ -14,71 +14,337 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#if defined(_WIN32) || defined(WIN32)
+/* files are read into memory and checked one after another */
+#define VERIFY_SERIAL 1
+#else
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <yajl/yajl_parse.h>
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#ifndef VERIFY_SERIAL
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 static void
 usage(const char * progname)
 {
-    fprintf(stderr, "%s: validate json from stdin\n"
-                    "usage: json_verify [options]\n"
+    fprintf(stderr, "%s: validate json from stdin or files\n"
+                    "usage: json_verify [options] [file ...]\n"
                     "    -c allow comments\n"
+                    "    -j N check files with N threads (default: one per cpu)\n"
+                    "    -l FILE check the files listed in FILE, one per line\n"
+                    "       (- for stdin)\n"
                     "    -q quiet mode\n"
                     "    -s verify a stream of multiple json entities\n"
+                    "    -t print totals with files/s and MB/s (not for stdin)\n"
                     "    -u allow invalid utf8 inside strings\n",
             progname);
     exit(1);
 }
 
-int
-main(int argc, char ** argv)
+/* a parser without callbacks, with the options in 'flags' */
+static yajl_handle
+parser_alloc(unsigned int flags)
 {
-    yajl_status stat;
-    size_t rd;
-    yajl_handle hand;
-    static unsigned char fileData[65536];
-    int quiet = 0;
-    int retval = 0;
-    int a = 1;
+    yajl_handle hand = yajl_alloc(NULL, NULL, NULL);
+    unsigned int opt;
 
-    /* allocate a parser */
-    hand = yajl_alloc(NULL, NULL, NULL);
+    for (opt = yajl_allow_comments; opt <= yajl_allow_partial_values;
+         opt <<= 1) {
+        if (flags & opt) yajl_config(hand, (yajl_option) opt, 1);
+    }
 
-    /* check arguments.*/
-    while ((a < argc) && (argv[a][0] == '-') && (strlen(argv[a]) > 1)) {
-        unsigned int i;
-        for ( i=1; i < strlen(argv[a]); i++) {
-            switch (argv[a][i]) {
-                case 'q':
-                    quiet = 1;
-                    break;
-                case 'c':
-                    yajl_config(hand, yajl_allow_comments, 1);
-                    break;
-                case 'u':
-                    yajl_config(hand, yajl_dont_validate_strings, 1);
-                    break;
-                case 's':
-                    yajl_config(hand, yajl_allow_multiple_values, 1);
-                    break;
-                default:
-                    fprintf(stderr, "unrecognized option: '%c'\n\n", argv[a][i]);
-                    usage(argv[0]);
+    return hand;
+}
+
+/* the validator only says where the text went wrong, the parser says
+ * what was wrong with it.  returns the message, which the caller frees */
+static char *
+describe_error(const unsigned char * text, size_t len, unsigned int flags)
+{
+    yajl_handle hand = parser_alloc(flags);
+    unsigned char * str;
+    char * copy;
+
+    if (yajl_parse(hand, text, len) == yajl_status_ok) {
+        yajl_complete_parse(hand);
+    }
+
+    str = yajl_get_error(hand, 1, text, len);
+    copy = malloc(strlen((const char *) str) + 1);
+    if (copy) strcpy(copy, (const char *) str);
+    yajl_free_error(hand, str);
+    yajl_free(hand);
+    return copy;
+}
+
+/* read all of 'f' into a buffer, which the caller frees, with room for a
+ * terminator after the text.  returns NULL with errno set on failure,
+ * when *len is left alone */
+static unsigned char *
+read_all(FILE * f, size_t * len)
+{
+    unsigned char * text = NULL;
+    size_t cap = 0, got = 0, rd;
+
+    do {
+        if (got == cap) {
+            unsigned char * grown;
+            cap = cap ? cap * 2 : 65536;
+            grown = realloc(text, cap);
+            if (grown == NULL) {
+                free(text);
+                errno = ENOMEM;
+                return NULL;
             }
+            text = grown;
         }
-        ++a;
+        rd = fread((void *) (text + got), 1, cap - got, f);
+        got += rd;
+    } while (rd > 0);
+
+    if (ferror(f)) {
+        free(text);
+        errno = EIO;
+        return NULL;
     }
-    if (a < argc) {
-        usage(argv[0]);
+
+    *len = got;
+    return text;
+}
+
+/* a file's text, mapped where mmap() is available.  returns NULL with
+ * errno set on failure, when *len is left alone; an empty file is an
+ * empty text */
+static const unsigned char *
+open_text(const char * name, size_t * len)
+{
+#ifndef VERIFY_SERIAL
+    struct stat st;
+    void * base;
+    int fd;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        *len = 0;
+        return (const unsigned char *) "";
     }
 
+    base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    /* the validator reads front to back, once */
+    *len = (size_t) st.st_size;
+    posix_madvise(base, *len, POSIX_MADV_SEQUENTIAL);
+    return (const unsigned char *) base;
+#else
+    FILE * f = fopen(name, "rb");
+    unsigned char * text;
+
+    if (f == NULL) return NULL;
+    text = read_all(f, len);
+    fclose(f);
+    return text;
+#endif
+}
+
+static void
+close_text(const unsigned char * text, size_t len)
+{
+#ifndef VERIFY_SERIAL
+    if (len > 0) munmap((void *) text, len);
+#else
+    free((void *) text);
+#endif
+}
+
+static double
+now(void)
+{
+#ifndef VERIFY_SERIAL
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* the files to check, shared by the workers.  the lock guards everything
+ * below it */
+typedef struct {
+    char ** names;
+    size_t count;
+    unsigned int flags;
+    int quiet;
+#ifndef VERIFY_SERIAL
+    pthread_mutex_t lock;
+#endif
+    size_t next;
+    size_t invalid;
+    size_t bytes;
+} batch;
+
+static void
+lock(batch * b)
+{
+#ifndef VERIFY_SERIAL
+    pthread_mutex_lock(&b->lock);
+#else
+    (void) b;
+#endif
+}
+
+static void
+unlock(batch * b)
+{
+#ifndef VERIFY_SERIAL
+    pthread_mutex_unlock(&b->lock);
+#else
+    (void) b;
+#endif
+}
+
+/* take files off the batch until none are left, reporting on each as it
+ * is done.  reports are written under the lock so lines don't interleave,
+ * in the order the files finish */
+static void *
+worker(void * ctx)
+{
+    batch * b = (batch *) ctx;
+
     for (;;) {
-        rd = fread((void *) fileData, 1, sizeof(fileData) - 1, stdin);
+        const unsigned char * text;
+        const char * name;
+        char * message = NULL;
+        size_t len = 0;
+        int valid = 0, err = 0;
+
+        lock(b);
+        name = b->next < b->count ? b->names[b->next++] : NULL;
+        unlock(b);
+        if (name == NULL) break;
+
+        text = open_text(name, &len);
+        if (text == NULL) {
+            err = errno;
+        } else {
+            valid = yajl_validate(text, len, b->flags, NULL) == yajl_status_ok;
+            if (!valid && !b->quiet) {
+                message = describe_error(text, len, b->flags);
+            }
+        }
+
+        lock(b);
+        b->invalid += !valid;
+        b->bytes += len;
+        if (!b->quiet) {
+            if (err) {
+                fprintf(stderr, "%s: %s\n", name, strerror(err));
+            } else if (message) {
+                fprintf(stderr, "%s: %s", name, message);
+            }
+            printf("%s: JSON is %s\n", name, valid ? "valid" : "invalid");
+        }
+        unlock(b);
+
+        free(message);
+        if (text) close_text(text, len);
+    }
+
+    return NULL;
+}
+
+static void
+run_workers(batch * b, long jobs)
+{
+#ifndef VERIFY_SERIAL
+    pthread_t * threads;
+    long i, started = 0;
+
+    if (jobs <= 0) jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs <= 0) jobs = 1;
+    if ((size_t) jobs > b->count) jobs = (long) b->count;
+
+    /* this thread is one of the workers */
+    threads = malloc(jobs * sizeof(pthread_t));
+    pthread_mutex_init(&b->lock, NULL);
+    for (i = 1; i < jobs; i++) {
+        if (pthread_create(&threads[started], NULL, worker, b) != 0) break;
+        started++;
+    }
+
+    worker(b);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&b->lock);
+    free(threads);
+#else
+    (void) jobs;
+    worker(b);
+#endif
+}
+
+/* add the paths listed in 'f', one per line, to 'names'.  returns the
+ * text of the list, which the names point into, or NULL on failure */
+static unsigned char *
+read_list(FILE * f, char *** names, size_t * count, size_t * cap)
+{
+    size_t len, start = 0, i;
+    unsigned char * list = read_all(f, &len);
 
-        retval = 0;
+    if (list == NULL) return NULL;
+
+    for (i = 0; i <= len; i++) {
+        if (i < len && list[i] != '\n') continue;
+        if (i > start && list[i - 1] == '\r') list[i - 1] = 0;
+        if (i > start && list[start] != 0) {
+            if (*count == *cap) {
+                *cap = *cap ? *cap * 2 : 64;
+                *names = realloc(*names, *cap * sizeof(char *));
+            }
+            (*names)[(*count)++] = (char *) list + start;
+        }
+        list[i] = 0;
+        start = i + 1;
+    }
+
+    return list;
+}
+
+static int
+verify_stdin(unsigned int flags, int quiet)
+{
+    static unsigned char fileData[65536];
+    yajl_handle hand = parser_alloc(flags);
+    yajl_status stat;
+    size_t rd = 0;
+    int retval = 0;
+
+    /* stdin may be a stream of values that never ends, so it is parsed
+     * a piece at a time rather than read whole for the validator */
+    for (;;) {
+        rd = fread((void *) fileData, 1, sizeof(fileData) - 1, stdin);
 
         if (rd == 0) {
             if (!feof(stdin)) {
@@ -91,7 +357,6 @@ main(int argc, char ** argv)
         }
         fileData[rd] = 0;
 
-        /* read file data, pass to parser */
         stat = yajl_parse(hand, fileData, rd);
 
         if (stat != yajl_status_ok) break;
@@ -118,3 +383,119 @@ main(int argc, char ** argv)
 
     return retval;
 }
+
+int
+main(int argc, char ** argv)
+{
+    batch b;
+    char ** names = NULL;
+    unsigned char * lists[16];
+    size_t count = 0, cap = 0, listed = 0;
+    unsigned int flags = 0;
+    long jobs = 0;
+    int quiet = 0;
+    int totals = 0;
+    int a = 1;
+    double start, elapsed;
+
+    /* check arguments.  -j and -l take the rest of the option, or the
+     * next argument */
+    while ((a < argc) && (argv[a][0] == '-') && (strlen(argv[a]) > 1)) {
+        const char * opt = argv[a++];
+        const char * value = NULL;
+        unsigned int i;
+        for ( i=1; value == NULL && i < strlen(opt); i++) {
+            switch (opt[i]) {
+                case 'q':
+                    quiet = 1;
+                    break;
+                case 'c':
+                    flags |= yajl_allow_comments;
+                    break;
+                case 'u':
+                    flags |= yajl_dont_validate_strings;
+                    break;
+                case 's':
+                    flags |= yajl_allow_multiple_values;
+                    break;
+                case 't':
+                    totals = 1;
+                    break;
+                case 'j':
+                case 'l':
+                    if (opt[i + 1]) {
+                        value = opt + i + 1;
+                    } else if (a < argc) {
+                        value = argv[a++];
+                    } else {
+                        usage(argv[0]);
+                    }
+                    if (opt[i] == 'j') {
+                        jobs = atol(value);
+                        if (jobs <= 0) usage(argv[0]);
+                    } else {
+                        FILE * f = strcmp(value, "-") ? fopen(value, "r")
+                                                      : stdin;
+                        if (listed == sizeof(lists) / sizeof(*lists)) {
+                            fprintf(stderr, "too many lists\n");
+                            return 1;
+                        }
+                        lists[listed] = f ? read_list(f, &names, &count,
+                                                      &cap)
+                                          : NULL;
+                        if (lists[listed] == NULL) {
+                            fprintf(stderr, "%s: %s\n", value,
+                                    strerror(errno));
+                            return 1;
+                        }
+                        if (f != stdin) fclose(f);
+                        listed++;
+                    }
+                    break;
+                default:
+                    fprintf(stderr, "unrecognized option: '%c'\n\n", opt[i]);
+                    usage(argv[0]);
+            }
+        }
+    }
+
+    if (!listed && a == argc) {
+        /* a stream has no files to total */
+        if (totals) {
+            fprintf(stderr, "-t needs files to check\n\n");
+            usage(argv[0]);
+        }
+        return verify_stdin(flags, quiet);
+    }
+
+    for (; a < argc; a++) {
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            names = realloc(names, cap * sizeof(char *));
+        }
+        names[count++] = argv[a];
+    }
+
+    b.names = names;
+    b.count = count;
+    b.flags = flags;
+    b.quiet = quiet;
+    b.next = b.invalid = b.bytes = 0;
+
+    start = now();
+    if (b.count > 0) run_workers(&b, jobs);
+    elapsed = now() - start;
+
+    if (totals) {
+        printf("%lu files, %lu invalid, %.1f MB in %.3f s: "
+               "%.0f files/s, %.1f MB/s\n",
+               (unsigned long) b.count, (unsigned long) b.invalid,
+               b.bytes / 1e6, elapsed,
+               elapsed > 0 ? b.count / elapsed : 0.0,
+               elapsed > 0 ? b.bytes / 1e6 / elapsed : 0.0);
+    }
+
+    while (listed > 0) free(lists[--listed]);
+    free(names);
+    return b.invalid ? 1 : 0;
+}